@@ -36,7 +36,7 @@ printf "Compiling \"$BOLD_ON$YELLOW_ON$UNDER_ON$EXE_PATH$FMT_OFF\" \n"
 rm -f $EXE_PATH
 
 #SRCS="`ls *.cpp`"
-SRCS="plot_prog.cpp drac_info.cpp crosscore.cpp"
+SRCS="plot_prog.cpp plop_pack.cpp drac_info.cpp crosscore.cpp"
 INCS="-I $CROSSCORE_DIR"
 $CXX -pthread -ggdb -ffast-math -ftree-vectorize -std=c++11 $INCS $SRCS -o $EXE_PATH $*
 
@@ -56,7 +56,7 @@ printf "Compiling \"$BOLD_ON$YELLOW_ON$UNDER_ON$EXE_PATH$FMT_OFF\" \n"
 rm -f $EXE_PATH
 
 #SRCS="`ls *.cpp`"
-SRCS="plot_prog.cpp plop_info.cpp crosscore.cpp"
+SRCS="plot_prog.cpp plop_pack.cpp plop_info.cpp crosscore.cpp"
 INCS="-I $CROSSCORE_DIR"
 $CXX -pthread -ggdb -ffast-math -ftree-vectorize -std=c++11 $INCS $SRCS -o $EXE_PATH $*
 
@@ -67,3 +67,60 @@ else
 	printf "$BOLD_ON$RED_ON""Failure""$FMT_OFF :("
 fi
 echo ""
+
+### drac_build ###
+EXE_NAME="drac_build"
+EXE_PATH="$EXE_DIR/$EXE_NAME"
+
+printf "Compiling \"$BOLD_ON$YELLOW_ON$UNDER_ON$EXE_PATH$FMT_OFF\" \n"
+rm -f $EXE_PATH
+
+SRCS="plop_build.cpp drac_build.cpp crosscore.cpp"
+INCS="-I $CROSSCORE_DIR"
+$CXX -pthread -ggdb -O2 -std=c++11 $INCS $SRCS -o $EXE_PATH $*
+
+echo -n "Build result: "
+if [ -f "$EXE_PATH" ]; then
+	printf "$BOLD_ON$GREEN_ON""Success""$FMT_OFF!"
+else
+	printf "$BOLD_ON$RED_ON""Failure""$FMT_OFF :("
+fi
+echo ""
+
+### drac_play ###
+EXE_NAME="drac_play"
+EXE_PATH="$EXE_DIR/$EXE_NAME"
+
+printf "Compiling \"$BOLD_ON$YELLOW_ON$UNDER_ON$EXE_PATH$FMT_OFF\" \n"
+rm -f $EXE_PATH
+
+SRCS="plot_prog.cpp plop_pack.cpp drama_rt.cpp pint/src/pint.cpp drac_play.cpp crosscore.cpp"
+INCS="-I $CROSSCORE_DIR"
+$CXX -pthread -ggdb -O2 -std=c++11 $INCS $SRCS -o $EXE_PATH $*
+
+echo -n "Build result: "
+if [ -f "$EXE_PATH" ]; then
+	printf "$BOLD_ON$GREEN_ON""Success""$FMT_OFF!"
+else
+	printf "$BOLD_ON$RED_ON""Failure""$FMT_OFF :("
+fi
+echo ""
+
+### drac_explore ###
+EXE_NAME="drac_explore"
+EXE_PATH="$EXE_DIR/$EXE_NAME"
+
+printf "Compiling \"$BOLD_ON$YELLOW_ON$UNDER_ON$EXE_PATH$FMT_OFF\" \n"
+rm -f $EXE_PATH
+
+SRCS="plot_prog.cpp plop_pack.cpp drama_rt.cpp pint/src/pint.cpp drac_explore.cpp crosscore.cpp"
+INCS="-I $CROSSCORE_DIR"
+$CXX -pthread -ggdb -O2 -std=c++11 $INCS $SRCS -o $EXE_PATH $*
+
+echo -n "Build result: "
+if [ -f "$EXE_PATH" ]; then
+	printf "$BOLD_ON$GREEN_ON""Success""$FMT_OFF!"
+else
+	printf "$BOLD_ON$RED_ON""Failure""$FMT_OFF :("
+fi
+echo ""
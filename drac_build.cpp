@@ -0,0 +1,564 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// Native replacement for drac.py: reads the ;$-prefixed .drama markup in a
+// single pass (no temporary XML, no DOM) and compiles node scripts on all
+// cores. The resulting .drac matches the one produced by drac.py.
+
+#include <crosscore.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "plot_prog.hpp"
+#include "plop_build.hpp"
+
+using PlopBuild::BinWriter;
+using PlopBuild::StrList;
+using PlopBuild::PlopExporter;
+
+struct DramaNode {
+	std::string mName;
+	std::string mTexts[4];
+	int32_t mId;
+	int32_t mBefore;
+	int32_t mAfter;
+	int32_t mPlSay;
+	int32_t mSay;
+};
+
+class DramaExporter : public PlopBuild::DataExporter {
+protected:
+	std::vector<DramaNode> mNodes;
+	std::vector<std::string> mPlopSrcs;
+	std::vector<BinWriter> mPlops;
+	std::unordered_map<std::string, int> mProfile;
+	size_t mNodesOffsPos;
+	size_t mDialogueOffsPos;
+	size_t mPlopCatPos;
+	bool mUseProfile;
+
+	virtual void write_head(BinWriter& bw, const size_t top);
+	virtual void write_data(BinWriter& bw, const size_t top);
+
+public:
+	enum Text {
+		BEFORE = 0,
+		AFTER,
+		PLSAY,
+		SAY,
+		TEXT_NUM
+	};
+
+	DramaExporter() : DataExporter("DRAC"), mNodesOffsPos(0), mDialogueOffsPos(0), mPlopCatPos(0), mUseProfile(false) {}
+
+	void add_node(const std::string& id, const std::string* pTexts);
+
+	bool load_profile(const char* pPath);
+
+	void layout();
+
+	uint32_t get_node_num() const { return uint32_t(mNodes.size()); }
+	uint32_t get_plop_num() const { return uint32_t(mPlopSrcs.size()); }
+
+	bool compile_plops(const int nthreads);
+};
+
+// Node.from_xml
+void DramaExporter::add_node(const std::string& id, const std::string* pTexts) {
+	DramaNode node;
+	node.mName = id;
+	if (id.empty()) {
+		::fprintf(stderr, "A drama node should have an 'id' attribute specified\n");
+	} else {
+		for (int i = 0; i < TEXT_NUM; ++i) {
+			node.mTexts[i] = pTexts[i];
+		}
+	}
+	node.mId = -1;
+	node.mBefore = -1;
+	node.mAfter = -1;
+	node.mPlSay = -1;
+	node.mSay = -1;
+	mNodes.push_back(node);
+}
+
+bool DramaExporter::load_profile(const char* pPath) {
+	size_t size = 0;
+	char* pText = reinterpret_cast<char*>(nxCore::raw_bin_load(pPath, &size));
+	if (!pText) {
+		return false;
+	}
+	std::string text(pText, size);
+	nxCore::bin_unload(pText);
+
+	// node visit counts, one "<node id> <count>" per line
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		std::string line = text.substr(pos, end - pos);
+		pos = end + 1;
+		size_t cntEnd = line.find_last_not_of(" \t\r");
+		if (cntEnd == std::string::npos) continue;
+		size_t cntTop = line.find_last_of(" \t", cntEnd);
+		if (cntTop == std::string::npos) continue;
+		size_t nameTop = line.find_first_not_of(" \t");
+		size_t nameEnd = line.find_last_not_of(" \t", cntTop);
+		std::string name = line.substr(nameTop, nameEnd - nameTop + 1);
+		mProfile[name] = ::atoi(line.substr(cntTop + 1, cntEnd - cntTop).c_str());
+	}
+	mUseProfile = true;
+	return true;
+}
+
+// DramaExporter.layout
+void DramaExporter::layout() {
+	if (mUseProfile) {
+		// most visited first, ties keep the source order
+		std::vector<std::pair<int, size_t> > order;
+		for (size_t i = 0; i < mNodes.size(); ++i) {
+			std::unordered_map<std::string, int>::const_iterator it = mProfile.find(mNodes[i].mName);
+			order.push_back(std::make_pair(it != mProfile.end() ? -it->second : 0, i));
+		}
+		std::stable_sort(order.begin(), order.end());
+		std::vector<DramaNode> nodes;
+		for (size_t i = 0; i < order.size(); ++i) {
+			nodes.push_back(mNodes[order[i].second]);
+		}
+		mNodes.swap(nodes);
+	}
+
+	// node ids go first, so that they end up together in the string list
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		DramaNode& node = mNodes[i];
+		if (!node.mName.empty()) {
+			node.mId = mStrs.add(node.mName);
+		}
+	}
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		DramaNode& node = mNodes[i];
+		if (!node.mTexts[BEFORE].empty()) {
+			node.mBefore = int32_t(mPlopSrcs.size());
+			mPlopSrcs.push_back(node.mTexts[BEFORE]);
+		}
+		if (!node.mTexts[AFTER].empty()) {
+			node.mAfter = int32_t(mPlopSrcs.size());
+			mPlopSrcs.push_back(node.mTexts[AFTER]);
+		}
+	}
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		DramaNode& node = mNodes[i];
+		node.mPlSay = node.mTexts[PLSAY].empty() ? -1 : mStrs.add(node.mTexts[PLSAY]);
+		node.mSay = node.mTexts[SAY].empty() ? -1 : mStrs.add(node.mTexts[SAY]);
+	}
+}
+
+bool DramaExporter::compile_plops(const int nthreads) {
+	uint32_t nplops = get_plop_num();
+	mPlops.clear();
+	mPlops.resize(nplops);
+	std::vector<std::string> errs(nplops);
+	std::atomic<uint32_t> next(0);
+
+	auto worker = [&]() {
+		while (true) {
+			uint32_t i = next.fetch_add(1);
+			if (i >= nplops) break;
+			PlopExporter plop;
+			if (plop.compile(mPlopSrcs[i])) {
+				plop.write(mPlops[i]);
+			} else {
+				errs[i] = plop.get_error();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nthreads; ++i) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	bool res = true;
+	for (uint32_t i = 0; i < nplops; ++i) {
+		if (!errs[i].empty()) {
+			::fprintf(stderr, "plop %d: %s\n", i, errs[i].c_str());
+			res = false;
+		}
+	}
+	return res;
+}
+
+void DramaExporter::write_head(BinWriter& bw, const size_t top) {
+	bw.write_fourcc("head");
+	bw.write_u32(get_node_num());
+	bw.write_u32(get_plop_num());
+	mNodesOffsPos = bw.pos();
+	bw.write_u32(0); // -> nodes
+	mDialogueOffsPos = bw.pos();
+	bw.write_u32(0); // -> dialogue
+	mPlopCatPos = bw.pos();
+	for (uint32_t i = 0; i < get_plop_num(); ++i) {
+		bw.write_u32(0); // -> plop prog
+	}
+}
+
+void DramaExporter::write_data(BinWriter& bw, const size_t top) {
+	if (mNodes.empty()) return;
+	bw.align(0x10);
+	bw.write_fourcc("body");
+
+	// transition data: ids, before, after
+	bw.patch(mNodesOffsPos, uint32_t(bw.pos() - top));
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		bw.write_i32(mStrs.get_write_id(mNodes[i].mId));
+	}
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		bw.write_i32(mNodes[i].mBefore);
+	}
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		bw.write_i32(mNodes[i].mAfter);
+	}
+
+	for (size_t i = 0; i < mPlops.size(); ++i) {
+		// plops start 16-aligned, so they can be compiled separately
+		bw.align(0x10);
+		bw.patch(mPlopCatPos + i * 4, uint32_t(bw.pos() - top));
+		bw.append(mPlops[i]);
+	}
+
+	// dialogue: plsay, say
+	bw.align(0x10);
+	bw.patch(mDialogueOffsPos, uint32_t(bw.pos() - top));
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		bw.write_i32(mStrs.get_write_id(mNodes[i].mPlSay));
+	}
+	for (size_t i = 0; i < mNodes.size(); ++i) {
+		bw.write_i32(mStrs.get_write_id(mNodes[i].mSay));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Streaming reader for the markup part of .drama files, follows what
+// drac.py gets from minidom: the id attribute of every <node> and the
+// leading text of the first <before>, <after>, <plsay> and <say> in it.
+class DramaReader {
+protected:
+	DramaExporter& mExp;
+	std::string mMarkup;
+	std::string mText;
+	std::string mNodeId;
+	std::string mNodeTexts[DramaExporter::TEXT_NUM];
+	bool mNodeSeen[DramaExporter::TEXT_NUM];
+	int mCapture;
+	bool mInMarkup;
+	bool mInNode;
+
+	void begin_node(const std::string& attrs);
+	void end_node();
+	void process_markup();
+
+public:
+	DramaReader(DramaExporter& exp) : mExp(exp), mCapture(-1), mInMarkup(false), mInNode(false) {}
+
+	void feed(const std::string& str);
+	void finish();
+};
+
+static bool is_xml_space(const char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void append_utf8(std::string& str, uint32_t code) {
+	if (code < 0x80) {
+		str += char(code);
+	} else if (code < 0x800) {
+		str += char(0xC0 | (code >> 6));
+		str += char(0x80 | (code & 0x3F));
+	} else if (code < 0x10000) {
+		str += char(0xE0 | (code >> 12));
+		str += char(0x80 | ((code >> 6) & 0x3F));
+		str += char(0x80 | (code & 0x3F));
+	} else {
+		str += char(0xF0 | (code >> 18));
+		str += char(0x80 | ((code >> 12) & 0x3F));
+		str += char(0x80 | ((code >> 6) & 0x3F));
+		str += char(0x80 | (code & 0x3F));
+	}
+}
+
+static std::string decode_entities(const std::string& raw) {
+	static const struct {
+		const char* pName;
+		char c;
+	} s_ents[] = {
+		{ "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' }
+	};
+	std::string str;
+	size_t i = 0;
+	while (i < raw.size()) {
+		size_t semi = raw[i] == '&' ? raw.find(';', i) : std::string::npos;
+		if (semi == std::string::npos) {
+			str += raw[i++];
+			continue;
+		}
+		std::string name = raw.substr(i + 1, semi - i - 1);
+		bool found = false;
+		if (name.size() > 1 && name[0] == '#') {
+			bool hex = name[1] == 'x';
+			uint32_t code = uint32_t(::strtoul(name.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10));
+			append_utf8(str, code);
+			found = true;
+		} else {
+			for (size_t j = 0; j < XD_ARY_LEN(s_ents); ++j) {
+				if (name == s_ents[j].pName) {
+					str += s_ents[j].c;
+					found = true;
+					break;
+				}
+			}
+		}
+		if (found) {
+			i = semi + 1;
+		} else {
+			str += raw[i++];
+		}
+	}
+	return str;
+}
+
+void DramaReader::begin_node(const std::string& attrs) {
+	if (mInNode) {
+		end_node();
+	}
+	mInNode = true;
+	mNodeId.clear();
+	for (int i = 0; i < DramaExporter::TEXT_NUM; ++i) {
+		mNodeTexts[i].clear();
+		mNodeSeen[i] = false;
+	}
+
+	size_t i = 0;
+	while (i < attrs.size()) {
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		size_t nameTop = i;
+		while (i < attrs.size() && attrs[i] != '=' && !is_xml_space(attrs[i])) ++i;
+		std::string name = attrs.substr(nameTop, i - nameTop);
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		if (i >= attrs.size() || attrs[i] != '=') break;
+		++i;
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		if (i >= attrs.size()) break;
+		char quote = attrs[i++];
+		size_t valEnd = attrs.find(quote, i);
+		if (valEnd == std::string::npos) break;
+		std::string val = decode_entities(attrs.substr(i, valEnd - i));
+		i = valEnd + 1;
+		if (name == "id") {
+			for (size_t j = 0; j < val.size(); ++j) {
+				if (is_xml_space(val[j])) val[j] = ' ';
+			}
+			mNodeId = val;
+		}
+	}
+}
+
+void DramaReader::end_node() {
+	if (mInNode) {
+		mExp.add_node(mNodeId, mNodeTexts);
+		mInNode = false;
+	}
+}
+
+void DramaReader::process_markup() {
+	const std::string& m = mMarkup;
+	if (m.empty() || m[0] == '!' || m[0] == '?') return; // comments, declarations
+
+	bool endTag = m[0] == '/';
+	size_t nameTop = endTag ? 1 : 0;
+	size_t nameEnd = nameTop;
+	while (nameEnd < m.size() && !is_xml_space(m[nameEnd]) && m[nameEnd] != '/') ++nameEnd;
+	std::string name = m.substr(nameTop, nameEnd - nameTop);
+
+	if (name == "node") {
+		if (endTag) {
+			end_node();
+		} else {
+			bool empty = m[m.size() - 1] == '/';
+			begin_node(m.substr(nameEnd, m.size() - nameEnd - (empty ? 1 : 0)));
+			if (empty) {
+				end_node();
+			}
+		}
+		return;
+	}
+
+	if (endTag || !mInNode) return;
+	static const char* s_textTags[] = { "before", "after", "plsay", "say" };
+	for (int i = 0; i < DramaExporter::TEXT_NUM; ++i) {
+		if (name == s_textTags[i] && !mNodeSeen[i]) {
+			mNodeSeen[i] = true;
+			if (m[m.size() - 1] != '/') {
+				mCapture = i;
+				mText.clear();
+			}
+			break;
+		}
+	}
+}
+
+void DramaReader::feed(const std::string& str) {
+	for (size_t i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		if (mInMarkup) {
+			mMarkup += c;
+			if (c == '>') {
+				bool comment = mMarkup.compare(0, 3, "!--") == 0;
+				if (!comment || (mMarkup.size() >= 6 && mMarkup.compare(mMarkup.size() - 3, 3, "-->") == 0)) {
+					mMarkup.resize(mMarkup.size() - 1);
+					mInMarkup = false;
+					process_markup();
+				}
+			}
+		} else if (c == '<') {
+			if (mCapture >= 0) {
+				// only the first child text node is used
+				mNodeTexts[mCapture] = decode_entities(mText);
+				mCapture = -1;
+			}
+			mInMarkup = true;
+			mMarkup.clear();
+		} else if (mCapture >= 0) {
+			mText += c;
+		}
+	}
+}
+
+void DramaReader::finish() {
+	end_node();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool is_py_space(const char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r') || (c >= '\x1c' && c <= '\x1f');
+}
+
+static void lstrip(std::string& line) {
+	size_t n = 0;
+	while (n < line.size() && is_py_space(line[n])) ++n;
+	line.erase(0, n);
+}
+
+static void tabs_to_spaces(std::string& line) {
+	for (size_t i = 0; i < line.size(); ++i) {
+		if (line[i] == '\t') line[i] = ' ';
+	}
+}
+
+// DramaExporter.prepare_xml, line by line
+static bool read_drama(const char* pSrcPath, DramaReader& reader) {
+	size_t srcSize = 0;
+	char* pSrc = reinterpret_cast<char*>(nxCore::raw_bin_load(pSrcPath, &srcSize));
+	if (!pSrc) {
+		return false;
+	}
+
+	size_t pos = 0;
+	while (pos < srcSize) {
+		size_t end = pos;
+		while (end < srcSize && pSrc[end] != '\n' && pSrc[end] != '\r') ++end;
+		std::string line(pSrc + pos, end - pos);
+		if (end < srcSize) {
+			// universal newlines
+			line += '\n';
+			end += (pSrc[end] == '\r' && end + 1 < srcSize && pSrc[end + 1] == '\n') ? 2 : 1;
+		}
+		pos = end;
+
+		tabs_to_spaces(line);
+		lstrip(line);
+		if (line.compare(0, 2, ";$") == 0) {
+			line.erase(0, 2);
+		}
+		tabs_to_spaces(line);
+		lstrip(line);
+		if (!line.empty()) {
+			reader.feed(line);
+		}
+	}
+	reader.finish();
+
+	nxCore::bin_unload(pSrc);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	nxApp::init_params(argc, argv);
+
+	const char* pSrcPath = nxApp::get_arg(0);
+	if (!pSrcPath) {
+		::printf("drac_build <src.drama> [-out:<path.drac>] [-j:<threads>] [-profile:<visits.txt>]\n");
+		nxApp::reset();
+		return 1;
+	}
+
+	std::string outPath;
+	const char* pOutPath = nxApp::get_opt("out");
+	if (pOutPath) {
+		outPath = pOutPath;
+	} else {
+		outPath = pSrcPath;
+		size_t dot = outPath.rfind('.');
+		size_t sep = outPath.find_last_of("/\\");
+		if (dot != std::string::npos && (sep == std::string::npos || dot > sep)) {
+			outPath.resize(dot);
+		}
+		outPath += ".drac";
+	}
+
+	int nthreads = nxApp::get_int_opt("j", 0);
+	if (nthreads <= 0) {
+		nthreads = nxCalc::max(int(std::thread::hardware_concurrency()), 1);
+	}
+
+	int res = 1;
+	DramaExporter drama;
+	DramaReader reader(drama);
+	const char* pProfilePath = nxApp::get_opt("profile");
+	if (pProfilePath && !drama.load_profile(pProfilePath)) {
+		::fprintf(stderr, "Unable to load profile \"%s\"\n", pProfilePath);
+	}
+	double t0 = nxSys::time_micros();
+	if (read_drama(pSrcPath, reader)) {
+		drama.layout();
+		double t1 = nxSys::time_micros();
+		if (drama.compile_plops(nthreads)) {
+			double t2 = nxSys::time_micros();
+			BinWriter bw;
+			drama.write(bw);
+			if (bw.save(outPath.c_str())) {
+				double t3 = nxSys::time_micros();
+				::printf("%s: %d nodes, %d plops, %d bytes\n", outPath.c_str(), drama.get_node_num(), drama.get_plop_num(), int(bw.pos()));
+				::printf("read %.1f ms, compile %.1f ms (%d threads), write %.1f ms, total %.1f ms\n",
+				         (t1 - t0) * 1e-3, (t2 - t1) * 1e-3, nthreads, (t3 - t2) * 1e-3, (t3 - t0) * 1e-3);
+				res = 0;
+			} else {
+				::fprintf(stderr, "Unable to write \"%s\"\n", outPath.c_str());
+			}
+		}
+	} else {
+		::fprintf(stderr, "Unable to load \"%s\"\n", pSrcPath);
+	}
+
+	nxApp::reset();
+	return res;
+}
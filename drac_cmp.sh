@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Checks that drac_build writes the same starboard.drac as drac.py.
+# Run after build.sh, which downloads xcore.py for drac.py.
+
+BOLD_ON="\e[1m"
+RED_ON="\e[31m"
+GREEN_ON="\e[32m"
+FMT_OFF="\e[0m"
+
+EXE_DIR=bin/prog
+PY=${PY:-python3}
+NATIVE_PATH="$EXE_DIR/starboard_native.drac"
+
+if [ ! -f "xcore.py" ] || [ ! -f "$EXE_DIR/drac_build" ]; then
+	printf "$BOLD_ON$RED_ON""Run build.sh first.""$FMT_OFF\n"
+	exit 1
+fi
+
+$PY drac.py || exit 1
+$EXE_DIR/drac_build starboard.drama -out:$NATIVE_PATH -j:1 || exit 1
+
+echo -n "Compare result: "
+if cmp starboard.drac $NATIVE_PATH; then
+	printf "$BOLD_ON$GREEN_ON""Identical""$FMT_OFF\n"
+else
+	printf "$BOLD_ON$RED_ON""Different""$FMT_OFF :(\n"
+	exit 1
+fi
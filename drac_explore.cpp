@@ -0,0 +1,574 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// drac_explore <drama.drac> -samples:<file> [-j:<threads>] [-sample:<n>] [-seed:<n>] [-maxstates:<n>] [-out:<report.txt>]
+// Offline reachability analysis: walks every branch of a compiled drama from its start node.
+//
+// The samples file lists the inputs, one "<name> <value> [<value> ...]" per line, where a value
+// is a number, a "string" or an integer range lo..hi. Each input is defined as a context variable
+// and initial states are made for all combinations of the values; get_personal("<name>")
+// branches over the same values. Ranges are enumerated unless -sample:<n> is given, then n values
+// are drawn from each range.
+//
+// Branching on get_personal is done by replay: a task carries the choices made by the calls
+// seen so far, the first visit of a new call takes value 0 and queues its siblings.
+
+#include <crosscore.hpp>
+#include "plot_prog.hpp"
+#include "plop_pack.hpp"
+#include "pint/src/pint.hpp"
+#include "drama_rt.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct InputVal {
+	bool isStr;
+	double num;
+	std::string str;
+};
+
+struct Input {
+	std::string name;
+	std::vector<InputVal> vals;
+};
+
+// States are copy-on-write forks of the worker context that produced them. They are never
+// written and have no string store of their own, so any thread can fork from them.
+struct ExploreState {
+	int32_t node; // -1: before the start node
+	Pint::ExecContext ctx;
+	std::string cond; // inputs and get_personal picks that led here
+	uint64_t hash;
+};
+
+typedef std::shared_ptr<ExploreState> StatePtr;
+
+struct Task {
+	StatePtr state;
+	std::vector<uint16_t> choices;
+};
+
+class TaskDeque {
+protected:
+	std::mutex mMtx;
+	std::deque<Task> mTasks;
+
+public:
+	void push(Task&& task) {
+		std::lock_guard<std::mutex> lk(mMtx);
+		mTasks.push_back(std::move(task));
+	}
+
+	// the owner works depth-first from the back, thieves take the oldest tasks
+	bool pop(Task* pTask) {
+		std::lock_guard<std::mutex> lk(mMtx);
+		if (mTasks.empty()) return false;
+		*pTask = std::move(mTasks.back());
+		mTasks.pop_back();
+		return true;
+	}
+
+	bool steal(Task* pTask) {
+		std::lock_guard<std::mutex> lk(mMtx);
+		if (mTasks.empty()) return false;
+		*pTask = std::move(mTasks.front());
+		mTasks.pop_front();
+		return true;
+	}
+};
+
+class StateSet {
+protected:
+	static const uint32_t SHARD_NUM = 64;
+
+	struct Shard {
+		std::mutex mtx;
+		std::unordered_set<uint64_t> hashes;
+	};
+
+	Shard mShards[SHARD_NUM];
+	std::atomic<uint32_t> mCount;
+
+public:
+	StateSet() : mCount(0) {}
+
+	bool insert(const uint64_t hash) {
+		Shard& shard = mShards[(hash >> 32) % SHARD_NUM];
+		std::lock_guard<std::mutex> lk(shard.mtx);
+		bool added = shard.hashes.insert(hash).second;
+		if (added) {
+			++mCount;
+		}
+		return added;
+	}
+
+	uint32_t size() const { return mCount; }
+};
+
+static uint64_t mix64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t hash_bytes(const void* pData, const size_t size, uint64_t h = 0xCBF29CE484222325ULL) {
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pData);
+	for (size_t i = 0; i < size; ++i) {
+		h ^= pBytes[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static uint64_t hash_value(const Pint::Value& val, uint64_t h) {
+	// integers hash as the equal float, states compare numbers by value
+	Pint::Value::Type type = val.is_num() ? Pint::Value::Type::NUM : val.get_type();
+	h = hash_bytes(&type, sizeof(type), h);
+	if (val.is_str()) {
+		h = hash_bytes(val.get_str(), nxCore::str_len(val.get_str()), h);
+	} else if (val.is_num()) {
+		double num = val.get_num();
+		h = hash_bytes(&num, sizeof(num), h);
+	} else if (val.is_list()) {
+		const Pint::ListHead* pLst = val.get_list();
+		h = hash_bytes(&pLst->count, sizeof(pLst->count), h);
+		for (uint32_t i = 0; i < pLst->count; ++i) {
+			h = hash_value(pLst->items()[i], h);
+		}
+	}
+	return h;
+}
+
+class Explorer;
+
+struct Worker {
+	Explorer* pExp;
+	uint32_t idx;
+	Pint::ExecContext ctx;
+	const std::vector<uint16_t>* pChoices;
+	std::vector<uint16_t> picks;    // choices made by the current step
+	std::vector<uint16_t> branches; // number of alternatives at each get_personal call
+	std::string cond;
+};
+
+class Explorer {
+protected:
+	const Drama* mpDrama;
+	Pint::FuncLibrary mFuncLib;
+	std::vector<Input> mInputs;
+	std::vector<std::unique_ptr<TaskDeque>> mQueues;
+	StateSet mVisited;
+	std::atomic<int64_t> mPending;
+	std::atomic<uint64_t> mSteps;
+	std::unique_ptr<std::atomic<uint32_t>[]> mpReached;
+	std::unique_ptr<std::atomic<uint32_t>[]> mpErrors;
+	std::vector<std::string> mWitness;
+	std::vector<std::string> mDangling;
+	std::mutex mDanglingMtx;
+	uint32_t mMaxStates;
+	std::atomic<bool> mTruncated;
+	int32_t mStartIdx;
+
+	void push(const uint32_t queueIdx, Task&& task) {
+		++mPending;
+		mQueues[queueIdx]->push(std::move(task));
+	}
+
+	bool fetch(const uint32_t queueIdx, Task* pTask) {
+		if (mQueues[queueIdx]->pop(pTask)) return true;
+		uint32_t nqueues = uint32_t(mQueues.size());
+		for (uint32_t i = 1; i < nqueues; ++i) {
+			if (mQueues[(queueIdx + i) % nqueues]->steal(pTask)) return true;
+		}
+		return false;
+	}
+
+	StatePtr save_state(Pint::ExecContext& ctx, const int32_t node, const std::string& cond);
+	bool run(Worker& wk, const int32_t plopId, const int32_t node);
+	void step(Worker& wk, const Task& task);
+	void work(const uint32_t idx);
+
+	static Pint::Value get_personal(Pint::ExecContext& ctx, const uint32_t nargs, Pint::Value* pArgs);
+
+public:
+	Explorer(const Drama* pDrama);
+	~Explorer() { mFuncLib.reset(); }
+
+	bool load_samples(const char* pPath, const int sampleNum, const uint64_t seed);
+	void explore(const uint32_t nthreads, const uint32_t maxStates);
+	void report(FILE* pOut, const bool full) const;
+
+	uint32_t get_state_count() const { return mVisited.size(); }
+	uint64_t get_step_count() const { return mSteps; }
+};
+
+Explorer::Explorer(const Drama* pDrama)
+	:
+	mpDrama(pDrama),
+	mPending(0),
+	mSteps(0),
+	mMaxStates(0),
+	mTruncated(false)
+{
+	static const Pint::FuncDef funcs[] = {
+		{ "get_personal", get_personal, 1, Pint::Value::Type::NON, {Pint::Value::Type::STR} },
+	};
+	mFuncLib.init();
+	mFuncLib.register_func(funcs, XD_ARY_LEN(funcs));
+	mFuncLib.freeze(); // shared by the workers
+	uint32_t nnodes = mpDrama->mNodeNum;
+	mpReached.reset(new std::atomic<uint32_t>[nnodes]);
+	mpErrors.reset(new std::atomic<uint32_t>[nnodes]);
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		mpReached[i] = 0;
+		mpErrors[i] = 0;
+	}
+	mWitness.resize(nnodes);
+	mStartIdx = mpDrama->find_node("start");
+}
+
+static bool parse_value(const char* pTok, InputVal* pVal) {
+	pVal->isStr = pTok[0] == '"';
+	pVal->num = 0.0;
+	pVal->str.clear();
+	if (pVal->isStr) {
+		pVal->str = pTok + 1;
+		if (!pVal->str.empty() && pVal->str.back() == '"') {
+			pVal->str.pop_back();
+		}
+		return true;
+	}
+	char* pEnd = nullptr;
+	pVal->num = ::strtod(pTok, &pEnd);
+	return pEnd != pTok;
+}
+
+bool Explorer::load_samples(const char* pPath, const int sampleNum, const uint64_t seed) {
+	FILE* pIn = pPath ? ::fopen(pPath, "r") : nullptr;
+	if (!pIn) return false;
+	sxRNG rng;
+	nxCore::rng_seed(&rng, seed);
+	char line[1024];
+	while (::fgets(line, sizeof(line), pIn)) {
+		char* pTok = ::strtok(line, " \t\r\n");
+		if (!pTok || pTok[0] == ';') continue;
+		Input input;
+		input.name = pTok;
+		while ((pTok = ::strtok(nullptr, " \t\r\n")) != nullptr) {
+			InputVal val;
+			const char* pRange = ::strstr(pTok, "..");
+			if (pRange && pTok[0] != '"') {
+				int lo = ::atoi(pTok);
+				int hi = ::atoi(pRange + 2);
+				int n = hi - lo + 1;
+				val.isStr = false;
+				if (sampleNum > 0 && sampleNum < n) {
+					for (int i = 0; i < sampleNum; ++i) {
+						val.num = double(lo + int(nxCore::rng_next(&rng) % uint64_t(n)));
+						input.vals.push_back(val);
+					}
+				} else {
+					for (int i = lo; i <= hi; ++i) {
+						val.num = double(i);
+						input.vals.push_back(val);
+					}
+				}
+			} else if (parse_value(pTok, &val)) {
+				input.vals.push_back(val);
+			}
+		}
+		if (!input.vals.empty()) {
+			mInputs.push_back(input);
+		}
+	}
+	::fclose(pIn);
+	return true;
+}
+
+StatePtr Explorer::save_state(Pint::ExecContext& ctx, const int32_t node, const std::string& cond) {
+	StatePtr pState = std::make_shared<ExploreState>();
+	ctx.fork(&pState->ctx);
+	pState->node = node;
+	pState->cond = cond;
+	// variable order depends on the path, so the state hash is a sum of per-variable hashes
+	uint64_t hash = mix64(uint64_t(node) + 1);
+	for (uint32_t i = 0; i < ctx.get_scope_depth(); ++i) {
+		const char* pDomName = ctx.get_domain_name(ctx.get_scope_domain(i));
+		hash = hash_bytes(pDomName, nxCore::str_len(pDomName) + 1, hash);
+	}
+	uint32_t nvars = ctx.get_var_count();
+	for (uint32_t i = 0; i < nvars; ++i) {
+		const char* pDomName = ctx.get_domain_name(ctx.get_var_domain(int(i)));
+		const char* pName = ctx.get_var_name(int(i));
+		const Pint::Value* pVal = ctx.get_val(int(i));
+		uint64_t h = hash_bytes(pDomName, nxCore::str_len(pDomName) + 1);
+		h = hash_bytes(pName, nxCore::str_len(pName), h);
+		hash += mix64(hash_value(*pVal, h));
+	}
+	pState->hash = hash;
+	return pState;
+}
+
+Pint::Value Explorer::get_personal(Pint::ExecContext& ctx, const uint32_t nargs, Pint::Value* pArgs) {
+	Worker* pWk = reinterpret_cast<Worker*>(ctx.get_local_binding());
+	Pint::Value res;
+	res.set_none();
+	const Input* pInput = nullptr;
+	for (size_t i = 0; i < pWk->pExp->mInputs.size(); ++i) {
+		if (pWk->pExp->mInputs[i].name == pArgs[0].get_str()) {
+			pInput = &pWk->pExp->mInputs[i];
+			break;
+		}
+	}
+	if (!pInput) return res;
+
+	size_t callIdx = pWk->picks.size();
+	uint16_t pick = callIdx < pWk->pChoices->size() ? (*pWk->pChoices)[callIdx] : 0;
+	uint16_t nalt = uint16_t(nxCalc::min(pInput->vals.size(), size_t(0xFFFF)));
+	pWk->picks.push_back(pick);
+	pWk->branches.push_back(callIdx < pWk->pChoices->size() ? 1 : nalt);
+
+	const InputVal& val = pInput->vals[pick];
+	char buf[64];
+	if (val.isStr) {
+		res.set_str(val.str.c_str());
+		pWk->cond += " get_personal(" + pInput->name + ")=\"" + val.str + "\"";
+	} else {
+		res.set_num(val.num);
+		XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "%g", val.num);
+		pWk->cond += " get_personal(" + pInput->name + ")=" + buf;
+	}
+	return res;
+}
+
+bool Explorer::run(Worker& wk, const int32_t plopId, const int32_t node) {
+	PlopExec exec(wk.ctx, &mFuncLib);
+	bool res = exec.exec(mpDrama->get_plop_data(plopId));
+	if (!res) {
+		++mpErrors[node];
+	}
+	return res;
+}
+
+void Explorer::step(Worker& wk, const Task& task) {
+	ExploreState& state = *task.state;
+	wk.pChoices = &task.choices;
+	wk.picks.clear();
+	wk.branches.clear();
+	wk.cond = state.cond;
+	state.ctx.fork(&wk.ctx);
+	wk.ctx.set_local_binding(&wk);
+
+	int nextId = wk.ctx.find_var("next");
+	if (nextId < 0) {
+		nextId = wk.ctx.add_var("next");
+	}
+	wk.ctx.var_val(nextId)->set_none();
+
+	int32_t nodeIdx = mStartIdx;
+	if (state.node >= 0) {
+		run(wk, mpDrama->get_node_after(state.node), state.node);
+		const Pint::Value* pNext = wk.ctx.get_val(nextId);
+		nodeIdx = pNext->is_str() ? mpDrama->find_node(pNext->get_str()) : -1;
+		if (nodeIdx < 0 && pNext->is_str()) {
+			std::string ref = std::string(mpDrama->get_str(mpDrama->get_node_id(state.node))) + " -> " + pNext->get_str();
+			std::lock_guard<std::mutex> lk(mDanglingMtx);
+			if (std::find(mDangling.begin(), mDangling.end(), ref) == mDangling.end()) {
+				mDangling.push_back(ref);
+			}
+		}
+	}
+	if (nodeIdx >= 0) {
+		run(wk, mpDrama->get_node_before(nodeIdx), nodeIdx);
+		StatePtr pNew = save_state(wk.ctx, nodeIdx, wk.cond);
+		if (mVisited.size() < mMaxStates) {
+			if (mVisited.insert(pNew->hash)) {
+				if (mpReached[nodeIdx]++ == 0) {
+					mWitness[nodeIdx] = pNew->cond;
+				}
+				Task next;
+				next.state = pNew;
+				push(wk.idx, std::move(next));
+			}
+		} else {
+			mTruncated = true;
+		}
+	}
+	++mSteps;
+
+	// siblings of the get_personal calls first seen in this step
+	for (size_t i = task.choices.size(); i < wk.branches.size(); ++i) {
+		for (uint16_t alt = 1; alt < wk.branches[i]; ++alt) {
+			Task sib;
+			sib.state = task.state;
+			sib.choices.assign(wk.picks.begin(), wk.picks.begin() + i);
+			sib.choices.push_back(alt);
+			push(wk.idx, std::move(sib));
+		}
+	}
+}
+
+void Explorer::work(const uint32_t idx) {
+	Worker wk;
+	wk.pExp = this;
+	wk.idx = idx;
+	wk.ctx.init(&wk);
+	Task task;
+	while (true) {
+		if (fetch(idx, &task)) {
+			step(wk, task);
+			task.state.reset();
+			--mPending;
+		} else if (mPending == 0) {
+			break;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	wk.ctx.reset();
+}
+
+void Explorer::explore(const uint32_t nthreads, const uint32_t maxStates) {
+	mMaxStates = maxStates;
+	mQueues.clear();
+	for (uint32_t i = 0; i < nthreads; ++i) {
+		mQueues.push_back(std::unique_ptr<TaskDeque>(new TaskDeque()));
+	}
+	if (mStartIdx < 0) return;
+
+	// initial states: all combinations of the input values, spread over the queues
+	size_t ninputs = mInputs.size();
+	std::vector<size_t> digits(ninputs, 0);
+	Pint::ExecContext ctx;
+	ctx.init();
+	for (uint32_t n = 0; ; ++n) {
+		ctx.clear_vars();
+		std::string cond;
+		for (size_t i = 0; i < ninputs; ++i) {
+			const InputVal& val = mInputs[i].vals[digits[i]];
+			Pint::Value* pVal = ctx.var_val(ctx.add_var(mInputs[i].name.c_str()));
+			char buf[64];
+			if (val.isStr) {
+				*pVal = ctx.intern(val.str.c_str());
+				cond += " " + mInputs[i].name + "=\"" + val.str + "\"";
+			} else {
+				pVal->set_num(val.num);
+				XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "%g", val.num);
+				cond += " " + mInputs[i].name + "=" + buf;
+			}
+		}
+		Task task;
+		task.state = save_state(ctx, -1, cond);
+		push(n % nthreads, std::move(task));
+
+		size_t i = 0;
+		for (; i < ninputs; ++i) {
+			if (++digits[i] < mInputs[i].vals.size()) break;
+			digits[i] = 0;
+		}
+		if (i == ninputs || mPending >= int64_t(maxStates)) break;
+	}
+	ctx.reset();
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < nthreads; ++i) {
+		threads.push_back(std::thread(&Explorer::work, this, i));
+	}
+	work(0);
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+}
+
+void Explorer::report(FILE* pOut, const bool full) const {
+	uint32_t nnodes = mpDrama->mNodeNum;
+	uint32_t nreached = 0;
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		nreached += mpReached[i] > 0 ? 1 : 0;
+	}
+	::fprintf(pOut, "coverage: %d/%d nodes (%.1f%%)%s\n", nreached, nnodes, nnodes ? 100.0 * nreached / nnodes : 0.0,
+	          mTruncated ? ", state limit reached" : "");
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		if (mpReached[i] == 0) {
+			::fprintf(pOut, "dead: %s\n", mpDrama->get_str(mpDrama->get_node_id(i)));
+		}
+	}
+	for (size_t i = 0; i < mDangling.size(); ++i) {
+		::fprintf(pOut, "missing node: %s\n", mDangling[i].c_str());
+	}
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		if (mpErrors[i] > 0) {
+			::fprintf(pOut, "script errors: %s (%d)\n", mpDrama->get_str(mpDrama->get_node_id(i)), uint32_t(mpErrors[i]));
+		}
+	}
+	if (full) {
+		for (uint32_t i = 0; i < nnodes; ++i) {
+			if (mpReached[i] > 0) {
+				::fprintf(pOut, "%s: %d states, first reached with%s\n", mpDrama->get_str(mpDrama->get_node_id(i)),
+				          uint32_t(mpReached[i]), mWitness[i].c_str());
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	nxApp::init_params(argc, argv);
+
+	const char* pPath = nxApp::get_arg(0);
+	sxData* pData = pPath ? PlopPack::load(pPath) : nullptr;
+	if (!pData) {
+		::printf("drac_explore <drama.drac> -samples:<file> [-j:<threads>] [-sample:<n>] [-seed:<n>] [-maxstates:<n>] [-out:<report.txt>]\n");
+		nxApp::reset();
+		return 1;
+	}
+
+	int nthreads = nxApp::get_int_opt("j", 0);
+	if (nthreads <= 0) {
+		nthreads = nxCalc::max(int(std::thread::hardware_concurrency()), 1);
+	}
+	int maxStates = nxApp::get_int_opt("maxstates", 1000000);
+
+	// contexts are created and grown from several threads
+	sxLock* pMemLock = nxSys::lock_create();
+	Pint::set_mem_lock(pMemLock);
+
+	{
+		Explorer exp(pData->as<Drama>());
+		const char* pSamplesPath = nxApp::get_opt("samples");
+		if (pSamplesPath && !exp.load_samples(pSamplesPath, nxApp::get_int_opt("sample", 0), uint64_t(nxApp::get_int_opt("seed", 1)))) {
+			nxCore::dbg_msg("Unable to load \"%s\"\n", pSamplesPath);
+		}
+
+		double t0 = nxSys::time_micros();
+		exp.explore(uint32_t(nthreads), uint32_t(nxCalc::max(maxStates, 1)));
+		double t = (nxSys::time_micros() - t0) * 1e-6;
+
+		exp.report(stdout, false);
+		::printf("%d states, %d steps in %.3f s (%d threads): %.0f states/s\n", exp.get_state_count(), int(exp.get_step_count()),
+		         t, nthreads, t > 0.0 ? exp.get_state_count() / t : 0.0);
+
+		const char* pOutPath = nxApp::get_opt("out");
+		if (pOutPath) {
+			FILE* pOut = nxSys::fopen_w_txt(pOutPath);
+			if (pOut) {
+				exp.report(pOut, true);
+				::fclose(pOut);
+			}
+		}
+	}
+
+	Pint::set_mem_lock(nullptr);
+	nxSys::lock_destroy(pMemLock);
+	PlopPack::unload(pData);
+	nxApp::reset();
+	return 0;
+}
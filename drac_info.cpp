@@ -1,106 +1,102 @@
-/* SPDX-License-Identifier: MIT */
-/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
-
-#include <crosscore.hpp>
-#include "plot_prog.hpp"
-
-
-struct Drama : sxData {
-
-	static const uint32_t KIND = XD_FOURCC('D', 'R', 'A', 'C');
-
-	uint32_t mHeadTag;
-	uint32_t mNodeNum;
-	uint32_t mPlopNum;
-	uint32_t mNodesOffs;
-	uint32_t mPlopCat[1];
-
-	struct NodeInfo {
-		int32_t mId;
-		int32_t mBefore;
-		int32_t mAfter;
-		int32_t mPlSay;
-		int32_t mSay;
-	};
-
-	NodeInfo* get_node_top() const {
-		return mNodesOffs ? reinterpret_cast<NodeInfo*>(XD_INCR_PTR(this, mNodesOffs)) : nullptr;
-	}
-
-	PlopData* get_plop_data(const int32_t plopId) const {
-		return (plopId < mPlopNum) && (plopId >= 0) ? reinterpret_cast<PlopData*>(XD_INCR_PTR(this, mPlopCat[plopId])) : nullptr;
-	}
-
-	void dump_plop_info(FILE* pOut, PlopData* pPlop, const uint32_t id, const char* pBinName) {
-		if (pPlop) {
-			::fprintf(pOut, "[ plop id:[%d] ; nblk: %d ]\n", id,  pPlop ? pPlop->mBlkNum : 0);
-			if (pBinName) {
-				pPlop->save(pBinName);
-			}
-		}
-	}
-
-	void dump_info(FILE* pOut, const bool savePlops) {
-		char buf[32] = {};
-		nxCore::dbg_msg("Dumping %s", pOut);
-		::fprintf(pOut, "Total %d nodes\n", mNodeNum);
-		NodeInfo* pNodes = get_node_top();
-		for(uint32_t i = 0; i < mNodeNum; ++i) {
-			::fprintf(pOut, "____________________________________\n");
-			NodeInfo* pNode = &pNodes[i];
-			::fprintf(pOut, "Node %d id='%s'\n\n", i, get_str(pNode->mId));
-			::fprintf(pOut, "[Before]: ");
-
-			PlopData* pPlop = get_plop_data(pNode->mBefore);
-			if (pPlop) {
-				XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "before_%d.plop", i);
-				dump_plop_info(pOut, pPlop, pNode->mBefore, savePlops ? buf : nullptr);
-
-				XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "before_%d.dpl", i);
-				pPlop->disasm(buf);
-			} else {
-				::fprintf(pOut, "[NONE]\n");
-			}
-
-			::fprintf(pOut, "[Player says]: %s\n", pNode->mPlSay >= 0 ? get_str(pNode->mPlSay) : "[NONE]");
-			::fprintf(pOut, "[Character says]: %s\n", pNode->mSay >= 0 ? get_str(pNode->mSay) : "[NONE]");
-
-			::fprintf(pOut, "[After]: ");
-
-			pPlop = get_plop_data(pNode->mAfter);
-			if (pPlop) {
-				XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "after_%d.plop", i);
-				dump_plop_info(pOut, pPlop, pNode->mAfter, savePlops ? buf : nullptr);
-
-				XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "after_%d.dpl", i);
-				pPlop->disasm(buf);
-			}
-
-		}
-	}
-
-	void dump_info(const char* pOutPath, bool savePlop) {
-		FILE* pOut = nxSys::fopen_w_txt(pOutPath);
-		if (!pOut) {
-			return;
-		}
-		dump_info(pOut, savePlop);
-		::fclose(pOut);
-	}
-};
-
-int main(int argc, char* argv[]) {
-	nxApp::init_params(argc, argv);
-
-	const char* pPath = nxApp::get_arg(0);
-	const char* pOutPath = nxApp::get_opt("out");
-	bool savePlops = nxApp::get_bool_opt("saveplop");
-	sxData* pData = nxData::load(pPath);
-	if (pData) {
-		Drama* pDrama = pData->as<Drama>();
-		pDrama->dump_info(pOutPath ? pOutPath : "drama_dump.txt", savePlops);
-	}
-
-	nxApp::reset();
-	return 0;
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+#include <crosscore.hpp>
+#include "plot_prog.hpp"
+#include "plop_pack.hpp"
+
+#if defined(__linux__)
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+
+static void drop_file_cache(const char* pPath) {
+#if defined(__linux__)
+	int fd = ::open(pPath, O_RDONLY);
+	if (fd >= 0) {
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+	}
+#endif
+}
+
+static double time_load(const char* pPath, const bool cold) {
+	if (cold) {
+		drop_file_cache(pPath);
+	}
+	double t0 = nxSys::time_micros();
+	sxData* pData = PlopPack::load(pPath);
+	double t = nxSys::time_micros() - t0;
+	PlopPack::unload(pData);
+	return t;
+}
+
+// drac_info <raw.drac> <packed.drac> ... -bench:<runs>
+static void load_bench(const int nruns) {
+	for (int i = 0; i < nxApp::get_args_count(); ++i) {
+		const char* pPath = nxApp::get_arg(i);
+		for (int cold = 0; cold < 2; ++cold) {
+			double tmin = 0.0;
+			double tsum = 0.0;
+			for (int j = 0; j < nruns; ++j) {
+				double t = time_load(pPath, !!cold);
+				tmin = j > 0 ? nxCalc::min(tmin, t) : t;
+				tsum += t;
+			}
+			::printf("%s, %s cache: min %.1f us, avg %.1f us (%d runs)\n", pPath, cold ? "cold" : "warm", tmin, tsum / nruns, nruns);
+		}
+	}
+}
+
+// drac_info <raw.drac> <packed.drac> -verify: the packed file must load into the raw image
+static bool verify_pack() {
+	const char* pRawPath = nxApp::get_arg(0);
+	const char* pPackPath = nxApp::get_arg(1);
+	if (!pRawPath || !pPackPath) return false;
+	bool res = false;
+	size_t rawSize = 0;
+	void* pRaw = nxCore::raw_bin_load(pRawPath, &rawSize);
+	sxData* pData = PlopPack::load(pPackPath);
+	if (pRaw && pData) {
+		res = pData->mFileSize == rawSize && nxCore::mem_eq(pData, pRaw, rawSize);
+	}
+	::printf("%s -> %s: %s\n", pRawPath, pPackPath, res ? "same" : "DIFFERENT");
+	if (pData) {
+		PlopPack::unload(pData);
+	}
+	if (pRaw) {
+		nxCore::bin_unload(pRaw);
+	}
+	return res;
+}
+
+int main(int argc, char* argv[]) {
+	nxApp::init_params(argc, argv);
+
+	if (nxApp::get_bool_opt("verify")) {
+		bool res = verify_pack();
+		nxApp::reset();
+		return res ? 0 : 1;
+	}
+
+	int benchRuns = nxApp::get_int_opt("bench", 0);
+	if (benchRuns > 0) {
+		load_bench(benchRuns);
+		nxApp::reset();
+		return 0;
+	}
+
+	const char* pPath = nxApp::get_arg(0);
+	const char* pOutPath = nxApp::get_opt("out");
+	bool savePlops = nxApp::get_bool_opt("saveplop");
+	sxData* pData = PlopPack::load(pPath);
+	if (pData) {
+		Drama* pDrama = pData->as<Drama>();
+		pDrama->dump_info(pOutPath ? pOutPath : "drama_dump.txt", savePlops);
+		PlopPack::unload(pData);
+	}
+
+	nxApp::reset();
+	return 0;
 }
\ No newline at end of file
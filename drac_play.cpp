@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// drac_play <drama.drac> -vars:<file> -read:<ms> -spec:<0|1> -steps:<n> -profile:<out>
+// Walks a compiled drama from its start node, printing the dialogue and node entry latency.
+
+#include <crosscore.hpp>
+#include "plot_prog.hpp"
+#include "plop_pack.hpp"
+#include "pint/src/pint.hpp"
+#include "drama_rt.hpp"
+
+#include <chrono>
+
+// personal data is looked up among the context variables, see -vars
+static Pint::Value get_personal(Pint::ExecContext& ctx, const uint32_t nargs, Pint::Value* pArgs) {
+	Pint::Value res;
+	res.set_none();
+	const Pint::Value* pVal = ctx.get_val(pArgs[0].get_str());
+	if (pVal) {
+		res = *pVal;
+	}
+	return res;
+}
+
+static const Pint::FuncDef s_playFuncs[] = {
+	{ "get_personal", get_personal, 1, Pint::Value::Type::NON, {Pint::Value::Type::STR} },
+};
+
+// "<name> <value>" per line, quoted values are strings
+static void load_vars(Pint::ExecContext& ctx, const char* pPath) {
+	FILE* pIn = pPath ? ::fopen(pPath, "r") : nullptr;
+	if (!pIn) return;
+	char line[256];
+	while (::fgets(line, sizeof(line), pIn)) {
+		char name[64];
+		char val[192];
+		if (::sscanf(line, "%63s %191[^\r\n]", name, val) != 2) continue;
+		int id = ctx.find_var(name);
+		if (id < 0) {
+			id = ctx.add_var(name);
+		}
+		Pint::Value* pVal = ctx.var_val(id);
+		if (!pVal) continue;
+		if (val[0] == '"') {
+			char* pEnd = ::strrchr(val + 1, '"');
+			if (pEnd) *pEnd = 0;
+			*pVal = ctx.intern(val + 1);
+		} else {
+			pVal->set_num(::atof(val));
+		}
+	}
+	::fclose(pIn);
+}
+
+int main(int argc, char* argv[]) {
+	nxApp::init_params(argc, argv);
+
+	const char* pPath = nxApp::get_arg(0);
+	int readMillis = nxApp::get_int_opt("read", 0);
+	int maxSteps = nxApp::get_int_opt("steps", 1000);
+	bool spec = nxApp::get_int_opt("spec", 1) != 0;
+	const char* pProfPath = nxApp::get_opt("profile");
+
+	sxData* pData = PlopPack::load(pPath);
+	if (!pData) {
+		nxCore::dbg_msg("Unable to load \"%s\"\n", pPath ? pPath : "");
+		nxApp::reset();
+		return 1;
+	}
+	Drama* pDrama = pData->as<Drama>();
+
+	Pint::FuncLibrary funcLib;
+	funcLib.init();
+	funcLib.register_func(s_playFuncs, XD_ARY_LEN(s_playFuncs));
+	funcLib.freeze();
+
+	DramaRuntime rt;
+	rt.init(pDrama, &funcLib);
+	load_vars(rt.get_context(), nxApp::get_opt("vars"));
+	rt.enable_speculation(spec);
+
+	double tsum = 0.0;
+	double tmax = 0.0;
+	int steps = 0;
+	bool running = rt.start();
+	while (running && steps < maxSteps) {
+		const char* pPlSay = rt.get_plsay();
+		const char* pSay = rt.get_say();
+		::printf("[%s]\n", rt.get_node_name());
+		if (pPlSay) ::printf("  > %s\n", pPlSay);
+		if (pSay) ::printf("  < %s\n", pSay);
+
+		if (readMillis > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(readMillis));
+		}
+
+		double t0 = nxSys::time_micros();
+		running = rt.advance();
+		double t = nxSys::time_micros() - t0;
+		if (running) {
+			tsum += t;
+			tmax = nxCalc::max(tmax, t);
+			++steps;
+		}
+	}
+
+	const DramaRuntime::Stats& stats = rt.get_stats();
+	::printf("%d transitions, node entry: avg %.2f us, max %.2f us\n", steps, steps ? tsum / steps : 0.0, tmax);
+	::printf("speculation %s: %d runs, %d hits, %d stale, %d failed\n", spec ? "on" : "off",
+	         stats.specRuns, stats.specHits, stats.specStale, stats.specFailed);
+
+	if (pProfPath) {
+		rt.save_profile(pProfPath);
+	}
+
+	rt.reset();
+	funcLib.reset();
+	PlopPack::unload(pData);
+	nxApp::reset();
+	return 0;
+}
@@ -0,0 +1,759 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+#include <crosscore.hpp>
+#include "plot_prog.hpp"
+#include "pint/src/pint.hpp"
+#include "drama_rt.hpp"
+
+typedef PlopData::Op Op;
+
+static bool value_eq(const Pint::Value& valA, const Pint::Value& valB) {
+	if (valA.is_num() && valB.is_num()) return valA.get_num() == valB.get_num();
+	if (valA.get_type() != valB.get_type()) return false;
+	if (valA.is_str()) return Pint::str_eq(valA, valB);
+	if (valA.is_list()) return Pint::list_eq(valA.get_list(), valB.get_list());
+	return true;
+}
+
+static bool value_true(const Pint::Value& val) {
+	return val.is_str() || val.is_list() || (val.is_num() && val.get_num() != 0.0);
+}
+
+static bool list_op(const Op op, Pint::ListOp* pListOp) {
+	switch (op) {
+		case Op::ADD: *pListOp = Pint::ListOp::ADD; return true;
+		case Op::SUB: *pListOp = Pint::ListOp::SUB; return true;
+		case Op::MUL: *pListOp = Pint::ListOp::MUL; return true;
+		case Op::DIV: *pListOp = Pint::ListOp::DIV; return true;
+		case Op::MIN: *pListOp = Pint::ListOp::MIN; return true;
+		case Op::MAX: *pListOp = Pint::ListOp::MAX; return true;
+		default: return false;
+	}
+}
+
+static bool fold(Pint::ExecContext& ctx, const Op op, Pint::Value& acc, const Pint::Value& arg) {
+	if (op == Op::AND || op == Op::OR || op == Op::XOR) {
+		bool a = value_true(acc);
+		bool b = value_true(arg);
+		acc.set_num(double(op == Op::AND ? (a && b) : op == Op::OR ? (a || b) : (a != b)));
+		return true;
+	}
+	Pint::ListOp listOp;
+	if ((acc.is_list() || arg.is_list()) && list_op(op, &listOp)) {
+		// element-wise, as Pint numeric ops on lists
+		acc = Pint::list_arith(ctx, listOp, acc, arg);
+		return true;
+	}
+	if (!acc.is_num() || !arg.is_num()) {
+		// non-numeric operands give none, as in Pint::NumOpInfo::apply
+		acc.set_none();
+		return true;
+	}
+	double a = acc.get_num();
+	double b = arg.get_num();
+	switch (op) {
+		case Op::ADD: acc.set_num(a + b); break;
+		case Op::SUB: acc.set_num(a - b); break;
+		case Op::MUL: acc.set_num(a * b); break;
+		case Op::DIV: acc.set_num(a / b); break;
+		case Op::LT: acc.set_num(double(a < b)); break;
+		case Op::GT: acc.set_num(double(a > b)); break;
+		case Op::LE: acc.set_num(double(a <= b)); break;
+		case Op::GE: acc.set_num(double(a >= b)); break;
+		case Op::MIN: acc.set_num(nxCalc::min(a, b)); break;
+		case Op::MAX: acc.set_num(nxCalc::max(a, b)); break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+PlopExec::PlopExec(Pint::ExecContext& ctx, Pint::FuncLibrary* pFuncLib)
+	:
+	mCtx(ctx),
+	mpFuncLib(pFuncLib),
+	mpPlop(nullptr),
+	mpCode(nullptr),
+	mpReadMask(nullptr),
+	mpFuncPlop(nullptr),
+	mScopeGen(0),
+	mNoCalls(false),
+	mAborted(false),
+	mDefined(false)
+{
+	clear_var_cache();
+}
+
+void PlopExec::mark_read(const int varId) {
+	if (mpReadMask && (varId >= 0) && (varId < int(READ_MASK_SIZE * 64))) {
+		XD_BIT_ARY_ST(uint64_t, mpReadMask, varId);
+	}
+}
+
+bool PlopExec::fail(const Pint::EvalError err) {
+	mCtx.set_error(err);
+	return false;
+}
+
+void PlopExec::clear_var_cache() {
+	for (uint32_t i = 0; i < VAR_CACHE_SIZE; ++i) {
+		mVarIds[i] = -2;
+	}
+	mScopeGen = mCtx.get_scope_gen();
+}
+
+// names are looked up through the domain stack once per scope change, later reads index the pages directly
+int PlopExec::resolve_var(const uint32_t sid) {
+	if (mScopeGen != mCtx.get_scope_gen()) {
+		clear_var_cache();
+	}
+	if (sid < VAR_CACHE_SIZE && mVarIds[sid] != -2) {
+		return mVarIds[sid];
+	}
+	int varId = mCtx.find_var(mpPlop->get_str(sid));
+	if (sid < VAR_CACHE_SIZE) {
+		mVarIds[sid] = int16_t(varId);
+	}
+	return varId;
+}
+
+// function indices of a frozen library don't change, they're kept while the same code runs
+const Pint::FuncDef* PlopExec::resolve_func(const uint32_t sid) {
+	const char* pName = mpPlop->get_str(sid);
+	if (!mpFuncLib || !pName) return nullptr;
+	if (!mpFuncLib->is_frozen() || sid >= VAR_CACHE_SIZE) {
+		return mpFuncLib->find_func(pName);
+	}
+	if (mpFuncPlop != mpPlop) {
+		for (uint32_t i = 0; i < VAR_CACHE_SIZE; ++i) {
+			mFuncIds[i] = -2;
+		}
+		mpFuncPlop = mpPlop;
+	}
+	if (mFuncIds[sid] == -2) {
+		mFuncIds[sid] = int16_t(mpFuncLib->find_index(pName));
+	}
+	return mpFuncLib->get_func(mFuncIds[sid]);
+}
+
+Pint::Value PlopExec::read_var(const uint32_t sid) {
+	Pint::Value val;
+	val.set_none();
+	int varId = resolve_var(sid);
+	if (varId >= 0) {
+		mark_read(varId);
+		val = *mCtx.get_val(varId);
+	} else {
+		fail(Pint::EvalError::VAR_NOT_FOUND);
+	}
+	return val;
+}
+
+Pint::Value PlopExec::eval(uint32_t& ip) {
+	Pint::Value val;
+	val.set_none();
+	Op op = Op(mpCode[ip]);
+	switch (op) {
+		case Op::BEGIN: {
+				uint32_t eloc = mpCode[ip + 1];
+				val = eval_form(ip + 2, eloc);
+				ip = eloc + 1;
+			}
+			break;
+		case Op::SYM:
+			val = read_var(mpCode[ip + 1]);
+			ip += 2;
+			break;
+		case Op::FVAL:
+			val.set_num(nxCore::f32_set_bits(mpCode[ip + 1]));
+			ip += 2;
+			break;
+		case Op::SVAL:
+			val.set_str(mpPlop->get_str(mpCode[ip + 1]));
+			ip += 2;
+			break;
+		case Op::NOP:
+			ip += 1;
+			break;
+		default:
+			fail(Pint::EvalError::BAD_OPERAND_TYPE_SYM);
+			break;
+	}
+	return val;
+}
+
+Pint::Value PlopExec::eval_form(uint32_t ip, const uint32_t eloc) {
+	Pint::Value val;
+	val.set_none();
+	Op op = Op(mpCode[ip]);
+	switch (op) {
+		case Op::VAR:
+		case Op::SET: {
+				uint32_t sid = mpCode[ip + 1];
+				ip += 2;
+				val = eval(ip);
+				if (mCtx.should_break()) break;
+				// set finds the variable in any visible domain, defvar defines it in the current one
+				int varId = op == Op::SET ? resolve_var(sid) : mCtx.add_var(mpPlop->get_str(sid));
+				mDefined = mDefined || op == Op::VAR;
+				if (varId < 0) {
+					fail(op == Op::SET ? Pint::EvalError::VAR_NOT_FOUND : Pint::EvalError::VAR_CTX_ADD);
+					break;
+				}
+				mark_read(varId);
+				*mCtx.var_val(varId) = val;
+			}
+			break;
+
+		case Op::IF: {
+				uint32_t yes = mpCode[ip + 1];
+				uint32_t alt = mpCode[ip + 2];
+				ip += 3;
+				Pint::Value cond = eval(ip);
+				if (mCtx.should_break()) break;
+				ip = value_true(cond) ? yes : alt;
+				val = eval(ip);
+			}
+			break;
+
+		case Op::LSET: {
+				// the variable gets a copy of its list with the item replaced or appended
+				uint32_t sid = mpCode[ip + 1];
+				ip += 3;
+				Pint::Value idx = eval(ip);
+				Pint::Value item;
+				item.set_none();
+				if (ip < eloc && !mCtx.should_break()) {
+					item = eval(ip);
+				}
+				if (mCtx.should_break()) break;
+				int varId = resolve_var(sid);
+				if (varId < 0) {
+					fail(Pint::EvalError::VAR_NOT_FOUND);
+					break;
+				}
+				mark_read(varId);
+				Pint::Value lst = Pint::list_set(mCtx, *mCtx.get_val(varId), idx, item);
+				if (lst.is_list()) {
+					*mCtx.var_val(varId) = lst;
+					val = item;
+				}
+			}
+			break;
+
+		case Op::LGET: {
+				Pint::Value lst = read_var(mpCode[ip + 1]);
+				ip += 2;
+				Pint::Value idx;
+				idx.set_none();
+				if (ip < eloc && !mCtx.should_break()) {
+					idx = eval(ip);
+				}
+				if (mCtx.should_break()) break;
+				val = Pint::list_get(mCtx, lst, idx);
+			}
+			break;
+
+		case Op::CALL: {
+				if (mNoCalls) {
+					mAborted = true;
+					mCtx.set_break();
+					break;
+				}
+				uint32_t nargs = mpCode[ip + 1];
+				ip += 2;
+				const Pint::FuncDef* pFunc = Op(mpCode[ip]) == Op::SYM ? resolve_func(mpCode[ip + 1]) : nullptr;
+				ip += 2;
+				if (!pFunc) {
+					fail(Pint::EvalError::FUNC_NOT_FOUND);
+					break;
+				}
+				Pint::Value args[Pint::FuncDef::MAX_ARGS];
+				uint32_t n = 0;
+				while (ip < eloc && !mCtx.should_break()) {
+					Pint::Value arg = eval(ip);
+					if (n < Pint::FuncDef::MAX_ARGS) {
+						args[n++] = arg;
+					}
+				}
+				if (mCtx.should_break()) break;
+				if (n != nargs || !mpFuncLib->check_func_args(*pFunc, n, args)) {
+					fail(Pint::EvalError::BAD_FUNC_ARGS);
+					break;
+				}
+				val = mpFuncLib->invoke(*pFunc, mCtx, n, args);
+			}
+			break;
+
+		case Op::LIST: {
+				Pint::ListHead* pLst = mCtx.new_list(mpCode[ip + 1]);
+				uint32_t n = 0;
+				ip += 2;
+				while (ip < eloc && !mCtx.should_break()) {
+					Pint::Value item = eval(ip);
+					if (pLst && n < pLst->count) {
+						pLst->items()[n++] = item;
+					}
+				}
+				if (pLst && !mCtx.should_break()) {
+					pLst->seal();
+					val.set_list(pLst);
+				}
+			}
+			break;
+
+		case Op::NOP:
+			ip += 2;
+			while (ip < eloc && !mCtx.should_break()) {
+				eval(ip);
+			}
+			break;
+
+		default: {
+				// arithmetic and logic, folded left to right like Pint numeric ops
+				uint32_t nargs = mpCode[ip + 1];
+				ip += 2;
+				if (nargs == 0) {
+					fail(Pint::EvalError::BAD_OPERAND_COUNT);
+					break;
+				}
+				Pint::Value acc = eval(ip);
+				if (op == Op::EQ || op == Op::NE) {
+					bool res = true;
+					while (ip < eloc && !mCtx.should_break()) {
+						Pint::Value arg = eval(ip);
+						res = res && value_eq(acc, arg);
+					}
+					val.set_num(double(op == Op::EQ ? res : !res));
+					break;
+				}
+				if (op == Op::AND || op == Op::OR) {
+					// the operands after the one that decides the result aren't evaluated
+					bool res = value_true(acc);
+					while (res == (op == Op::AND) && ip < eloc && !mCtx.should_break()) {
+						res = value_true(eval(ip));
+					}
+					val.set_num(double(res));
+					break;
+				}
+				if ((op == Op::LT || op == Op::GT || op == Op::LE || op == Op::GE) && nargs > 1) {
+					// (< a b c) compares neighbouring operands, as Pint comparisons
+					bool num = acc.is_num();
+					bool res = true;
+					while (ip < eloc && !mCtx.should_break()) {
+						Pint::Value arg = eval(ip);
+						if (num && arg.is_num()) {
+							Pint::Value cmp = acc;
+							fold(mCtx, op, cmp, arg);
+							res = res && cmp.get_num() != 0.0;
+							acc = arg;
+						} else {
+							num = false;
+						}
+					}
+					if (num) {
+						val.set_num(double(res));
+					}
+					break;
+				}
+				if (op == Op::NOT || op == Op::NEG) {
+					if (op == Op::NEG && acc.is_list()) {
+						Pint::Value zero;
+						zero.set_num(0.0);
+						val = Pint::list_arith(mCtx, Pint::ListOp::SUB, zero, acc);
+					} else if (acc.is_num()) {
+						val.set_num(op == Op::NOT ? double(acc.get_num() == 0.0) : -acc.get_num());
+					} else if (op == Op::NOT) {
+						val.set_num(double(!value_true(acc)));
+					}
+					break;
+				}
+				if (nargs == 1) {
+					// (- x) is 0 - x, (/ x) is 1 / x, same as Pint unary forms
+					Pint::Value arg = acc;
+					acc.set_num((op == Op::MUL || op == Op::DIV || op == Op::AND) ? 1.0 : 0.0);
+					if (op == Op::MIN || op == Op::MAX) {
+						// the smallest/largest item of a single list
+						acc = arg.is_list() ? Pint::list_reduce(mCtx, op == Op::MIN ? Pint::ListOp::MIN : Pint::ListOp::MAX, arg) : arg;
+					} else if (!fold(mCtx, op, acc, arg)) {
+						fail(Pint::EvalError::BAD_OPERAND_TYPE_SYM);
+					}
+				}
+				while (ip < eloc && !mCtx.should_break()) {
+					Pint::Value arg = eval(ip);
+					if (!fold(mCtx, op, acc, arg)) {
+						fail(Pint::EvalError::BAD_OPERAND_TYPE_SYM);
+					}
+				}
+				val = acc;
+			}
+			break;
+	}
+	return val;
+}
+
+bool PlopExec::exec(const PlopData* pPlop) {
+	mAborted = false;
+	mDefined = false;
+	mCtx.set_error(Pint::EvalError::NONE);
+	mCtx.set_break(false);
+	if (!pPlop) return true;
+
+	mpPlop = pPlop;
+	clear_var_cache();
+	for (uint32_t bkid = 0; bkid < pPlop->mBlkNum && !mCtx.should_break(); ++bkid) {
+		mpCode = pPlop->get_block_code(bkid);
+		if (pPlop->mBlks[bkid].mLen > 0) {
+			uint32_t ip = 0;
+			eval(ip);
+		}
+	}
+	mpCode = nullptr;
+	mpPlop = nullptr;
+	return !mAborted && mCtx.get_error() == Pint::EvalError::NONE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+DramaRuntime::DramaRuntime()
+	:
+	mpDrama(nullptr),
+	mpFuncLib(nullptr),
+	mNodeIdx(-1),
+	mNextVarId(-1),
+	mpVisits(nullptr),
+	mpCandOrg(nullptr),
+	mpCands(nullptr),
+	mSpecNum(0),
+	mSpecNext(0),
+	mpMemLock(nullptr),
+	mSpecEnabled(false),
+	mSpecBusy(false),
+	mSpecQuit(false)
+{
+	nxCore::mem_zero(&mStats, sizeof(mStats));
+}
+
+DramaRuntime::~DramaRuntime() {
+	reset();
+}
+
+void DramaRuntime::init(const Drama* pDrama, Pint::FuncLibrary* pFuncLib, void* pBinding) {
+	reset();
+	mpDrama = pDrama;
+	mpFuncLib = pFuncLib;
+	mCtx.init(pBinding);
+	if (mpDrama && mpDrama->mNodeNum > 0) {
+		mpVisits = reinterpret_cast<uint32_t*>(nxCore::mem_alloc(mpDrama->mNodeNum * sizeof(uint32_t), "Drama:visits"));
+		nxCore::mem_zero(mpVisits, mpDrama->mNodeNum * sizeof(uint32_t));
+		build_candidates();
+	}
+}
+
+void DramaRuntime::reset() {
+	enable_speculation(false);
+	for (uint32_t i = 0; i < SPEC_MAX; ++i) {
+		mSpecs[i].ctx.reset();
+		mSpecs[i].base.reset();
+	}
+	mCtx.reset();
+	if (mpVisits) {
+		nxCore::mem_free(mpVisits);
+		mpVisits = nullptr;
+	}
+	if (mpCandOrg) {
+		nxCore::mem_free(mpCandOrg);
+		mpCandOrg = nullptr;
+	}
+	if (mpCands) {
+		nxCore::mem_free(mpCands);
+		mpCands = nullptr;
+	}
+	mpDrama = nullptr;
+	mpFuncLib = nullptr;
+	mNodeIdx = -1;
+	mNextVarId = -1;
+	nxCore::mem_zero(&mStats, sizeof(mStats));
+}
+
+struct CandidateCollector {
+	const Drama* pDrama;
+	int32_t* pCands;
+	uint32_t num;
+	uint32_t max;
+
+	void operator()(const PlopData* pPlop, const uint32_t sid) {
+		int32_t nodeIdx = pDrama->find_node(pPlop->get_str(sid));
+		if (nodeIdx < 0 || pDrama->get_node_before(nodeIdx) < 0) return;
+		for (uint32_t i = 0; i < num; ++i) {
+			if (pCands[i] == nodeIdx) return;
+		}
+		if (pCands && num < max) {
+			pCands[num] = nodeIdx;
+		}
+		++num;
+	}
+};
+
+void DramaRuntime::build_candidates() {
+	// nodes named by string constants in 'after' are the possible transitions,
+	// only the ones having a 'before' script are worth speculating on
+	uint32_t nnodes = mpDrama->mNodeNum;
+	mpCandOrg = reinterpret_cast<uint32_t*>(nxCore::mem_alloc((nnodes + 1) * sizeof(uint32_t), "Drama:candOrg"));
+	int32_t cands[SPEC_MAX];
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		CandidateCollector collect = { mpDrama, cands, 0, SPEC_MAX };
+		PlopExec::for_each_str(mpDrama->get_plop_data(mpDrama->get_node_after(i)), collect);
+		mpCandOrg[i] = total;
+		total += nxCalc::min(collect.num, SPEC_MAX);
+	}
+	mpCandOrg[nnodes] = total;
+	mpCands = reinterpret_cast<int32_t*>(nxCore::mem_alloc(nxCalc::max(total, 1U) * sizeof(int32_t), "Drama:cands"));
+	for (uint32_t i = 0; i < nnodes; ++i) {
+		CandidateCollector collect = { mpDrama, &mpCands[mpCandOrg[i]], 0, mpCandOrg[i + 1] - mpCandOrg[i] };
+		PlopExec::for_each_str(mpDrama->get_plop_data(mpDrama->get_node_after(i)), collect);
+	}
+}
+
+void DramaRuntime::enable_speculation(const bool enable) {
+	if (enable == mSpecEnabled) return;
+	if (enable) {
+		// forks allocate from the worker thread
+		if (!Pint::get_mem_lock()) {
+			mpMemLock = nxSys::lock_create();
+			Pint::set_mem_lock(mpMemLock);
+		}
+		mSpecQuit = false;
+		mSpecNum = 0;
+		mSpecNext = 0;
+		mWorker = std::thread(&DramaRuntime::spec_worker, this);
+		mSpecEnabled = true;
+	} else {
+		{
+			std::unique_lock<std::mutex> lk(mSpecMtx);
+			mSpecQuit = true;
+		}
+		mSpecCv.notify_all();
+		mWorker.join();
+		mSpecNum = 0;
+		mSpecEnabled = false;
+		if (mpMemLock) {
+			Pint::set_mem_lock(nullptr);
+			nxSys::lock_destroy(mpMemLock);
+			mpMemLock = nullptr;
+		}
+	}
+}
+
+void DramaRuntime::spec_worker() {
+	std::unique_lock<std::mutex> lk(mSpecMtx);
+	while (true) {
+		mSpecCv.wait(lk, [this] { return mSpecQuit || mSpecNext < mSpecNum; });
+		if (mSpecQuit) break;
+		Speculation& spec = mSpecs[mSpecNext++];
+		mSpecBusy = true;
+		lk.unlock();
+
+		PlopExec exec(spec.ctx);
+		exec.set_no_calls(true);
+		exec.set_read_mask(spec.readMask);
+		spec.ok = exec.exec(mpDrama->get_plop_data(mpDrama->get_node_before(spec.nodeIdx)));
+		spec.defs = exec.defined();
+		spec.done = true;
+
+		lk.lock();
+		mSpecBusy = false;
+		mSpecCv.notify_all();
+	}
+}
+
+void DramaRuntime::spec_post() {
+	if (!mSpecEnabled || mNodeIdx < 0) return;
+	uint32_t org = mpCandOrg[mNodeIdx];
+	uint32_t num = mpCandOrg[mNodeIdx + 1] - org;
+	if (num == 0) return;
+
+	// forks are made here while the worker is idle, so it never sees the main context
+	for (uint32_t i = 0; i < num; ++i) {
+		Speculation& spec = mSpecs[i];
+		mCtx.fork(&spec.ctx);
+		mCtx.fork(&spec.base);
+		nxCore::mem_zero(spec.readMask, sizeof(spec.readMask));
+		spec.nodeIdx = mpCands[org + i];
+		spec.done = false;
+		spec.ok = false;
+		spec.defs = false;
+	}
+	// most visited candidates first
+	for (uint32_t i = 1; i < num; ++i) {
+		for (uint32_t j = i; j > 0 && mpVisits[mSpecs[j].nodeIdx] > mpVisits[mSpecs[j - 1].nodeIdx]; --j) {
+			std::swap(mSpecs[j].nodeIdx, mSpecs[j - 1].nodeIdx);
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(mSpecMtx);
+		mSpecNext = 0;
+		mSpecNum = num;
+	}
+	mSpecCv.notify_all();
+}
+
+void DramaRuntime::spec_cancel() {
+	if (!mSpecEnabled) return;
+	std::unique_lock<std::mutex> lk(mSpecMtx);
+	mSpecNum = mSpecNext;
+	mSpecCv.wait(lk, [this] { return !mSpecBusy; });
+}
+
+bool DramaRuntime::spec_commit(const int32_t nodeIdx) {
+	Speculation* pSpec = nullptr;
+	for (uint32_t i = 0; i < mSpecNum; ++i) {
+		if (mSpecs[i].done) {
+			++mStats.specRuns;
+			if (mSpecs[i].nodeIdx == nodeIdx) {
+				pSpec = &mSpecs[i];
+			}
+		}
+	}
+	mSpecNum = 0;
+	mSpecNext = 0;
+	if (!pSpec) return false;
+	if (!pSpec->ok) {
+		++mStats.specFailed;
+		return false;
+	}
+
+	// valid if nothing the script used has changed since the fork and its names still
+	// resolve to the same variables: the domain stack may have changed, or an inner domain
+	// may have got a variable hiding an outer one
+	const Pint::ExecContext& base = pSpec->base;
+	uint32_t baseCnt = base.get_var_count();
+	bool valid = !pSpec->defs || mCtx.get_domain() == base.get_domain();
+	for (uint32_t id = 0; valid && id < PlopExec::READ_MASK_SIZE * 64; ++id) {
+		if (id == baseCnt) {
+			id = Pint::ExecContext::GLOBAL_ID_BASE;
+		}
+		if (XD_BIT_ARY_CK(uint64_t, pSpec->readMask, id)) {
+			const Pint::Value* pCur = mCtx.get_val(int(id));
+			valid = pCur && value_eq(*pCur, *base.get_val(int(id))) && mCtx.find_var(base.get_var_name(int(id))) == int(id);
+		}
+	}
+	if (!valid) {
+		++mStats.specStale;
+		return false;
+	}
+
+	// apply the writes, variables added after the fork are matched by domain and name
+	const Pint::ExecContext& spec = pSpec->ctx;
+	uint32_t cnt = spec.get_var_count();
+	for (uint32_t id = 0; id < cnt; ++id) {
+		const Pint::Value& val = *spec.get_val(int(id));
+		if (id < baseCnt && value_eq(val, *base.get_val(int(id)))) continue;
+		int dstId = int(id);
+		if (id >= baseCnt) {
+			int dom = mCtx.add_domain(spec.get_domain_name(spec.get_var_domain(int(id))));
+			dstId = mCtx.add_var(dom, spec.get_var_name(int(id)));
+			if (dstId < 0) continue;
+		}
+		*mCtx.var_val(dstId) = mCtx.copy_value(val);
+	}
+	// staged global assignments
+	for (uint32_t i = 0; i < Pint::GlobalStore::VAR_MAX; ++i) {
+		int id = Pint::ExecContext::GLOBAL_ID_BASE + int(i);
+		const Pint::Value* pVal = spec.get_val(id);
+		if (!pVal) break;
+		if (value_eq(*pVal, *base.get_val(id))) continue;
+		Pint::Value* pDst = mCtx.var_val(id);
+		if (!pDst) continue;
+		*pDst = mCtx.copy_value(*pVal);
+	}
+	mCtx.set_error(Pint::EvalError::NONE);
+	mCtx.set_break(false);
+	++mStats.specHits;
+	return true;
+}
+
+bool DramaRuntime::run_script(const int32_t plopId) {
+	PlopExec exec(mCtx, mpFuncLib);
+	bool res = exec.exec(mpDrama->get_plop_data(plopId));
+	if (!res) {
+		nxCore::dbg_msg("Drama: script %d stopped with error %d\n", plopId, int(mCtx.get_error()));
+	}
+	return res;
+}
+
+void DramaRuntime::enter(const int32_t nodeIdx, const bool runBefore) {
+	mNodeIdx = nodeIdx;
+	++mpVisits[nodeIdx];
+	if (runBefore) {
+		run_script(mpDrama->get_node_before(nodeIdx));
+	}
+	spec_post();
+}
+
+bool DramaRuntime::start(const char* pNodeName) {
+	if (!mpDrama) return false;
+	spec_cancel();
+	mSpecNum = 0;
+	mCtx.sync_globals();
+	mNextVarId = mCtx.find_var("next");
+	if (mNextVarId < 0) {
+		mNextVarId = mCtx.add_var("next");
+	}
+	int32_t nodeIdx = mpDrama->find_node(pNodeName);
+	if (nodeIdx < 0) {
+		mNodeIdx = -1;
+		return false;
+	}
+	enter(nodeIdx, true);
+	return true;
+}
+
+bool DramaRuntime::advance() {
+	if (!mpDrama || mNodeIdx < 0) return false;
+	spec_cancel();
+	if (mCtx.get_globals()) {
+		mCtx.commit_globals();
+	}
+
+	mCtx.var_val(mNextVarId)->set_none();
+	run_script(mpDrama->get_node_after(mNodeIdx));
+	const Pint::Value* pNext = mCtx.get_val(mNextVarId);
+	int32_t nodeIdx = pNext->is_str() ? mpDrama->find_node(pNext->get_str()) : -1;
+	if (nodeIdx < 0) {
+		spec_commit(-1);
+		mNodeIdx = -1;
+		return false;
+	}
+	++mStats.transitions;
+	enter(nodeIdx, !spec_commit(nodeIdx));
+	return true;
+}
+
+const char* DramaRuntime::get_node_name() const {
+	return mNodeIdx >= 0 ? mpDrama->get_str(mpDrama->get_node_id(mNodeIdx)) : nullptr;
+}
+
+const char* DramaRuntime::get_plsay() const {
+	int32_t sid = mNodeIdx >= 0 ? mpDrama->get_node_plsay(mNodeIdx) : -1;
+	return sid >= 0 ? mpDrama->get_str(sid) : nullptr;
+}
+
+const char* DramaRuntime::get_say() const {
+	int32_t sid = mNodeIdx >= 0 ? mpDrama->get_node_say(mNodeIdx) : -1;
+	return sid >= 0 ? mpDrama->get_str(sid) : nullptr;
+}
+
+bool DramaRuntime::save_profile(const char* pOutPath) const {
+	if (!mpDrama || !mpVisits) return false;
+	FILE* pOut = nxSys::fopen_w_txt(pOutPath);
+	if (!pOut) return false;
+	for (uint32_t i = 0; i < mpDrama->mNodeNum; ++i) {
+		::fprintf(pOut, "%s %d\n", mpDrama->get_str(mpDrama->get_node_id(i)), mpVisits[i]);
+	}
+	::fclose(pOut);
+	return true;
+}
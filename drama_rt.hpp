@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// Drama runtime: runs DRAC node scripts (compiled PLOP code) on top of a Pint
+// execution context. Expects crosscore.hpp, plot_prog.hpp and pint.hpp to be
+// included before this header.
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Evaluates PLOP bytecode in a Pint::ExecContext.
+class PlopExec {
+public:
+	static const uint32_t READ_MASK_SIZE = uint32_t((Pint::ExecContext::CODE_VAR_MAX + Pint::GlobalStore::VAR_MAX) / 64);
+	static const uint32_t VAR_CACHE_SIZE = 64;
+
+protected:
+	Pint::ExecContext& mCtx;
+	Pint::FuncLibrary* mpFuncLib;
+	const PlopData* mpPlop;
+	const uint32_t* mpCode;
+	uint64_t* mpReadMask;
+	int16_t mVarIds[VAR_CACHE_SIZE]; // symbol sid -> variable id, valid for mScopeGen
+	int16_t mFuncIds[VAR_CACHE_SIZE]; // symbol sid -> function index, frozen libraries only
+	const PlopData* mpFuncPlop;       // code mFuncIds were resolved for
+	uint32_t mScopeGen;
+	bool mNoCalls;
+	bool mAborted;
+	bool mDefined;
+
+	void mark_read(const int varId);
+	bool fail(const Pint::EvalError err);
+
+	void clear_var_cache();
+	int resolve_var(const uint32_t sid);
+	const Pint::FuncDef* resolve_func(const uint32_t sid);
+
+	Pint::Value read_var(const uint32_t sid);
+	Pint::Value eval(uint32_t& ip);
+	Pint::Value eval_form(uint32_t ip, const uint32_t eloc);
+
+public:
+	PlopExec(Pint::ExecContext& ctx, Pint::FuncLibrary* pFuncLib = nullptr);
+
+	// ids of variables read or assigned by the executed code are accumulated into pMask[READ_MASK_SIZE]
+	void set_read_mask(uint64_t* pMask) { mpReadMask = pMask; }
+
+	// function calls may have side effects outside of the context, in this mode they abort execution
+	void set_no_calls(const bool noCalls) { mNoCalls = noCalls; }
+
+	bool aborted() const { return mAborted; }
+
+	// defvar was executed: the result depends on the current domain
+	bool defined() const { return mDefined; }
+
+	bool exec(const PlopData* pPlop);
+
+	// calls func(pPlop, sid) for every string constant (SVAL) in the code
+	template<typename FUNC> static void for_each_str(const PlopData* pPlop, FUNC& func);
+};
+
+template<typename FUNC> void PlopExec::for_each_str(const PlopData* pPlop, FUNC& func) {
+	if (!pPlop) return;
+	for (uint32_t bkid = 0; bkid < pPlop->mBlkNum; ++bkid) {
+		const uint32_t* pCode = pPlop->get_block_code(bkid);
+		uint32_t len = pPlop->mBlks[bkid].mLen;
+		// operands never exceed 2 words, skip them to avoid reading ids and offsets as opcodes
+		for (uint32_t i = 0; i < len;) {
+			PlopData::Op op = PlopData::Op(pCode[i++]);
+			switch (op) {
+				case PlopData::Op::SVAL:
+					func(pPlop, pCode[i]);
+					++i;
+					break;
+				case PlopData::Op::BEGIN: {
+						uint32_t formOp = i + 1 < len ? pCode[i + 1] : 0;
+						i += 2;
+						switch (PlopData::Op(formOp)) {
+							case PlopData::Op::LSET:
+							case PlopData::Op::IF:
+								i += 2;
+								break;
+							default:
+								i += 1;
+								break;
+						}
+					}
+					break;
+				case PlopData::Op::SYM:
+				case PlopData::Op::FVAL:
+					++i;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+// Walks the drama node graph: the 'before' script runs when a node is entered,
+// 'after' when it's left; 'after' selects the next node by setting the 'next' variable.
+// While the host displays a node, the 'before' scripts of the nodes referenced from
+// its 'after' script are speculatively evaluated on forked contexts in a worker thread.
+class DramaRuntime {
+public:
+	static const uint32_t SPEC_MAX = 4;
+
+	struct Stats {
+		uint32_t transitions;
+		uint32_t specRuns;    // speculative 'before' evaluations completed
+		uint32_t specHits;    // committed instead of running 'before'
+		uint32_t specStale;   // matched the transition, but the state it read had changed
+		uint32_t specFailed;  // aborted on a function call or stopped by an error
+	};
+
+protected:
+	struct Speculation {
+		Pint::ExecContext ctx;
+		Pint::ExecContext base; // state at the fork, shares all pages with ctx until it writes
+		uint64_t readMask[PlopExec::READ_MASK_SIZE];
+		int32_t nodeIdx;
+		bool done;
+		bool ok;
+		bool defs;
+	};
+
+	const Drama* mpDrama;
+	Pint::FuncLibrary* mpFuncLib;
+	Pint::ExecContext mCtx;
+	int32_t mNodeIdx;
+	int mNextVarId;
+	uint32_t* mpVisits;
+	uint32_t* mpCandOrg;  // node -> offset into mpCands, mNodeNum + 1 entries
+	int32_t* mpCands;     // candidate next nodes referenced from 'after' scripts
+	Stats mStats;
+
+	Speculation mSpecs[SPEC_MAX];
+	uint32_t mSpecNum;
+	uint32_t mSpecNext;
+	std::thread mWorker;
+	std::mutex mSpecMtx;
+	std::condition_variable mSpecCv;
+	sxLock* mpMemLock;
+	bool mSpecEnabled;
+	bool mSpecBusy;
+	bool mSpecQuit;
+
+	void build_candidates();
+	bool run_script(const int32_t plopId);
+	void enter(const int32_t nodeIdx, const bool runBefore);
+
+	void spec_worker();
+	void spec_post();
+	void spec_cancel();
+	bool spec_commit(const int32_t nodeIdx);
+
+public:
+	DramaRuntime();
+	~DramaRuntime();
+
+	void init(const Drama* pDrama, Pint::FuncLibrary* pFuncLib = nullptr, void* pBinding = nullptr);
+	void reset();
+
+	void enable_speculation(const bool enable);
+
+	// host variables should be defined in the context before start();
+	// with a global store attached, the context publishes its global writes and picks up
+	// the newest values on every transition
+	Pint::ExecContext& get_context() { return mCtx; }
+
+	bool start(const char* pNodeName = "start");
+	bool advance();
+
+	int32_t get_node() const { return mNodeIdx; }
+	const char* get_node_name() const;
+	const char* get_plsay() const;
+	const char* get_say() const;
+
+	const Stats& get_stats() const { return mStats; }
+
+	// node visit counts in the format accepted by drac.py/drac_build -profile:
+	bool save_profile(const char* pOutPath) const;
+};
@@ -1,1118 +1,5122 @@
-#include "crosscore.hpp"
-#include "pint.hpp"
-
-#if 1
-#define FMT_ESC(_code_) "\x1B[" #_code_ "m"
-#else
-#define FMT_ESC(_code_) ""
-#endif
-
-#define FMT_BOLD FMT_ESC(1)
-#define FMT_UNDER FMT_ESC(4)
-#define FMT_BLACK FMT_ESC(30)
-#define FMT_BLACK_BG FMT_ESC(40)
-#define FMT_RED FMT_ESC(31)
-#define FMT_RED_BG FMT_ESC(41)
-#define FMT_GREEN FMT_ESC(32)
-#define FMT_GREEN_BG FMT_ESC(42)
-#define FMT_YELLOW FMT_ESC(33)
-#define FMT_YELLOW_BG FMT_ESC(43)
-#define FMT_BLUE FMT_ESC(34)
-#define FMT_BLUE_BG FMT_ESC(44)
-#define FMT_MAGENTA FMT_ESC(35)
-#define FMT_MAGENTA_BG FMT_ESC(45)
-#define FMT_CYAN FMT_ESC(36)
-#define FMT_CYAN_BG FMT_ESC(46)
-#define FMT_WHITE FMT_ESC(37)
-#define FMT_WHITE_BG FMT_ESC(47)
-#define FMT_GRAY FMT_ESC(90)
-#define FMT_GRAY_BG FMT_ESC(100)
-#define FMT_B_RED FMT_ESC(91)
-#define FMT_B_RED_BG FMT_ESC(101)
-#define FMT_B_GREEN FMT_ESC(92)
-#define FMT_B_GREEN_BG FMT_ESC(102)
-#define FMT_B_YELLOW FMT_ESC(93)
-#define FMT_B_YELLOW_BG FMT_ESC(103)
-#define FMT_B_BLUE FMT_ESC(94)
-#define FMT_B_BLUE_BG FMT_ESC(104)
-#define FMT_B_MAGENTA FMT_ESC(95)
-#define FMT_B_MAGENTA_BG FMT_ESC(105)
-#define FMT_B_CYAN FMT_ESC(96)
-#define FMT_B_CYAN_BG FMT_ESC(106)
-#define FMT_B_WHITE FMT_ESC(97)
-#define FMT_B_WHITE_BG FMT_ESC(107)
-#define FMT_OFF FMT_ESC(0)
-
-#if defined(PINT_DBG)
-#define PINT_DBG_MSG(...) nxCore::dbg_msg(__VA_ARGS__)
-#else
-#define PINT_DBG_MSG(...)
-#endif
-
-namespace Pint {
-
-typedef Value (*NumOpFunc)(const Value& valA, const Value& valB);
-
-struct NumOpInfo {
-	NumOpFunc func;
-	double unaryVal;
-
-	Value apply(const Value& valA, const Value& valB);
-};
-
-static struct MemLock {
-	sxLock* mpLock;
-
-	void acquire() {
-		if (mpLock) {
-			nxSys::lock_acquire(mpLock);
-		}
-	}
-
-	void release() {
-		if (mpLock) {
-			nxSys::lock_release(mpLock);
-		}
-	}
-
-	void set(sxLock* pLock) {
-		mpLock = pLock;
-	}
-
-	sxLock* get() {
-		return mpLock;
-	}
-} s_memLock = {0};
-
-void set_mem_lock(sxLock* pLock) {
-	s_memLock.set(pLock);
-}
-
-void interp(const char* pSrc, size_t srcSize, ExecContext* pCtx, FuncLibrary* pFuncLib) {
-	if (pSrc && pCtx) {
-		pCtx->clear_vars();
-		SrcCode src(pSrc, srcSize);
-		CodeBlock blk(*pCtx, pFuncLib);
-		blk.init();
-
-		while (!(src.eof() || pCtx->should_break())) {
-			SrcCode::Line line = src.get_line();
-			line.print();
-			if (line.valid()) {
-				blk.parse(line);
-				blk.print();
-				blk.eval();
-			}
-		}
-	}
-}
-
-void cache(const char* pSrc, size_t srcSize) {}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void SrcCode::Line::print() const {
-	PINT_DBG_MSG(FMT_BOLD "line %d: " FMT_OFF, no);
-	if (valid()) {
-		PINT_DBG_MSG(FMT_GREEN);
-		for (size_t i = 0; i < textSize; ++i) {
-			PINT_DBG_MSG("%c", pText[i]);
-		}
-		PINT_DBG_MSG(FMT_OFF "\n");
-	} else {
-		PINT_DBG_MSG(FMT_RED "invalid\n" FMT_OFF);
-	}
-}
-
-bool SrcCode::Line::valid() const {
-	return pText != nullptr && textSize > 0;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-SrcCode::SrcCode(const char* pSrc, size_t srcSize)
-	:
-	mpSrc(pSrc),
-	mSrcSize(srcSize),
-	mSrcLoc(0),
-	mLineLoc(0),
-	mLineNo(0)
-	{}
-
-bool SrcCode::eof() const {
-	return mSrcLoc >= mSrcSize;
-}
-
-void SrcCode::restart() {
-	mSrcLoc = 0;
-}
-
-SrcCode::Line SrcCode::get_line() {
-	SrcCode::Line line = {0};
-
-	mLineLoc = mSrcLoc;
-	if (mpSrc) {
-		if (!eof()) {
-			++mLineNo;
-		}
-		while (!eof()) {
-			if (mpSrc[mSrcLoc] == '\r') {
-				++mSrcLoc;
-				if (eof()) {
-					break;
-				}
-				if (mpSrc[mSrcLoc] != '\n') {
-					break;
-				}
-			}
-			if (mpSrc[mSrcLoc] == '\n') {
-				++mSrcLoc;
-				break;
-			}
-			++mSrcLoc;
-			++line.textSize;
-		}
-	}
-	if (line.textSize > 0) {
-		line.pText = &mpSrc[mLineLoc];
-	}
-	line.no = mLineNo;
-	return line;
-}
-
-void SrcCode::make_cache_key(char* pBuf, const size_t bufSize) {
-	if (pBuf && (bufSize > 0)) {
-		nxCore::mem_zero(pBuf, bufSize);
-
-		if (mpSrc && (mSrcSize > 0)) {
-			size_t idx = 0;
-			uintptr_t addr = reinterpret_cast<uintptr_t>(mpSrc);
-
-			while ((idx < sizeof(void*)*2) && (idx < (bufSize - 1))) {
-				static const char* hex = "0123456789abcdef";
-				pBuf[idx] = hex[(addr >> (idx << 2)) & 0xF];
-				++idx;
-			}
-		}
-	}
-}
-
-
-const char* SrcCode::get_source() {
-	return mpSrc;
-}
-
-size_t SrcCode::source_size() const {
-	return mSrcSize;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void Value::set_none() {
-	type = Type::NON;
-	val.num = 0;
-}
-bool Value::is_none() const {
-	return type == Type::NON;
-}
-
-void Value::set_num(double num) {
-	type = Type::NUM;
-	val.num = num;
-}
-bool Value::is_num() const {
-	return type == Type::NUM;
-}
-
-void Value::set_str(const char* pStr) {
-	type = Type::STR;
-	val.pStr = pStr;
-}
-bool Value::is_str() const {
-	return type == Type::STR;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-Value df_sin(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	res.set_num(mth_sin(pArgs[0].val.num));
-	return res;
-}
-static const FuncDef s_df_sin_desc = {
-	"sin", df_sin, 1, Value::Type::NUM, {Value::Type::NUM}
-};
-
-Value df_cos(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	res.set_num(mth_cos(pArgs[0].val.num));
-	return res;
-}
-static const FuncDef s_df_cos_desc = {
-	"cos", df_cos, 1, Value::Type::NUM, {Value::Type::NUM}
-};
-
-Value df_abs(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	res.set_num(mth_fabs(pArgs[0].val.num));
-	return res;
-}
-static const FuncDef s_df_abs_desc = {
-	"abs", df_abs, 1, Value::Type::NUM, {Value::Type::NUM}
-};
-
-Value df_not(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	res.set_num(double(!pArgs[0].val.num));
-	return res;
-}
-static const FuncDef s_df_not_desc = {
-	"not", df_not, 1, Value::Type::NUM, {Value::Type::NUM}
-};
-
-Value glb_rng_next(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	uint64_t rnd = nxCore::rng_next();
-	rnd &= 0xffffffff;
-	res.set_num(double(rnd));
-	return res;
-}
-static const FuncDef s_df_rng_next_desc = {
-	"glb_rng_next", glb_rng_next, 0, Value::Type::NUM, {Value::Type::NUM}
-};
-
-Value glb_rng_01(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
-	Value res;
-	float rnd = nxCore::rng_f01();
-	res.set_num(double(rnd));
-	return res;
-}
-static const FuncDef s_df_rng_01_desc = {
-	"glb_rng_01", glb_rng_01, 0, Value::Type::NUM, {Value::Type::NUM}
-};
-
-static const FuncDef s_defFuncDesc[] = {
-	s_df_sin_desc, s_df_cos_desc, s_df_abs_desc, s_df_not_desc, s_df_rng_next_desc, s_df_rng_01_desc
-};
-
-
-FuncLibrary::FuncLibrary() : mpFuncMap(nullptr) {}
-
-FuncLibrary::~FuncLibrary() {
-	reset();
-}
-
-void FuncLibrary::init() {
-	if (mpFuncMap == nullptr) {
-		mpFuncMap = FuncMap::create();
-		register_func(s_defFuncDesc, XD_ARY_LEN(s_defFuncDesc));
-	}
-}
-
-void FuncLibrary::reset() {
-	if (mpFuncMap) {
-		FuncMap::destroy(mpFuncMap);
-		mpFuncMap = nullptr;
-	}
-}
-
-bool FuncLibrary::register_func(const FuncDef* pFuncDef, const uint32_t nfunc) {
-	bool res = false;
-	if (pFuncDef) {
-		if (mpFuncMap == nullptr) {
-			mpFuncMap = FuncMap::create();
-		}
-		for (uint32_t i = 0; i < nfunc; ++i) {
-			res = register_func(pFuncDef[i]);
-			if (!res) {
-				PINT_DBG_MSG(FMT_BOLD FMT_RED "ERROR: " FMT_OFF " cannot register function %s", pFuncDef[i].pName);
-				break;
-			}
-		}
-	}
-	return res;
-}
-
-bool FuncLibrary::register_func(const FuncDef& def) {
-	const char* pKey = mpFuncMap->put(def.pName, def);
-	return pKey != nullptr;
-}
-
-bool FuncLibrary::find(const char* pName, FuncDef* pDef) {
-	return mpFuncMap->get(pName, pDef);
-}
-
-bool FuncLibrary::check_func_args(const FuncDef& def, const uint32_t nargs, const Value* pArgs) {
-	bool res = true;
-	if (nargs >= def.nargs) {
-		for (uint32_t i = 0; i < def.nargs; ++i) {
-			if (pArgs[i].type != def.argTypes[i]) {
-				res = false;
-				break;
-			}
-		}
-	}
-	return res;
-}
-
-FuncLibrary* FuncLibrary::create_default() {
-	FuncLibrary* pFuncMapper = nxCore::tMem<FuncLibrary>::alloc();
-	pFuncMapper->register_func(s_defFuncDesc, XD_ARY_LEN(s_defFuncDesc));
-	return pFuncMapper;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-ExecContext::ExecContext() :
-	mpStrs(nullptr),
-	mpVarMap(nullptr),
-	mpBinding(nullptr),
-	mVarCnt(0),
-	mErrCode(EvalError::NONE),
-	mBreak(false) {}
-
-ExecContext::~ExecContext() {
-	reset();
-}
-
-void ExecContext::init(void* pBinding) {
-	mpStrs = nullptr;
-	mpBinding = pBinding;
-	mVarCnt = 0;
-	mErrCode = EvalError::NONE;
-	mBreak = false;
-
-	s_memLock.acquire();
-	mpVarMap = VarMap::create();
-	mpVarMap->set_mem_lock(s_memLock.get());
-	s_memLock.release();
-}
-
-void ExecContext::reset() {
-	if (mpStrs) {
-		cxStrStore::destroy(mpStrs);
-		mpStrs = nullptr;
-	}
-	if (mpVarMap) {
-		s_memLock.acquire();
-		VarMap::destroy(mpVarMap);
-		mpVarMap = nullptr;
-		s_memLock.release();
-	}
-
-	mVarCnt = 0;
-	mErrCode = EvalError::NONE;
-	mBreak = false;
-}
-
-char* ExecContext::add_str(const char* pStr) {
-	char* pStored = nullptr;
-	if (pStr) {
-		if (mpStrs == nullptr) {
-			mpStrs = cxStrStore::create("PintStrStore", s_memLock.get());
-		}
-		if (mpStrs) {
-			pStored = mpStrs->add(pStr);
-		}
-	}
-	return pStored;
-}
-
-int ExecContext::add_var(const char* pName) {
-	int id = -1;
-
-	if (pName && mpVarMap) {
-		if (mVarCnt < CODE_VAR_MAX) {
-			const char* pVarName = add_str(pName);
-			if (pVarName) {
-				pVarName = mpVarMap->add(pVarName, mVarCnt);
-				if (pVarName) {
-					id = mVarCnt;
-					mpVarNames[id] = pVarName;
-					mVarVals[id].set_none();
-					++mVarCnt;
-				}
-			}
-		}
-	}
-
-	return id;
-}
-
-int ExecContext::find_var(const char* pName) const {
-	int id = -1;
-	if (pName && mpVarMap) {
-		int foundId = -1;
-		bool found = mpVarMap->get(pName, &foundId);
-		if (found) {
-			id = foundId;
-		}
-	}
-	return id;
-}
-
-Value* ExecContext::var_val(int id) {
-	Value* pVal = nullptr;
-	if ((id >= 0) && (id < (int)CODE_VAR_MAX)) {
-		pVal = &mVarVals[id];
-	}
-	return pVal;
-}
-
-Value* ExecContext::var_val(const char* pVarName) {
-	return var_val(find_var(pVarName));
-}
-
-double ExecContext::get_num_val(const char* pVarName, const double defVal) {
-	Pint::Value* pVal = var_val(pVarName);
-	return pVal ? pVal->val.num : defVal;
-}
-
-void ExecContext::clear_vars() {
-	mVarCnt = 0;
-
-	if (mpStrs) {
-		mpStrs->purge();
-	}
-	if (mpVarMap) {
-		mpVarMap->purge();
-	}
-}
-
-void ExecContext::print_vars() {
-	PINT_DBG_MSG(FMT_BOLD "%d" FMT_OFF " variables\n", mVarCnt);
-	for (uint32_t i = 0; i < mVarCnt; ++i) {
-		const char* pVarName = mpVarNames[i];
-		int varId = find_var(pVarName);
-		PINT_DBG_MSG(FMT_BOLD "[%d]" FMT_OFF FMT_B_BLUE " %s" FMT_OFF ": ", varId, pVarName);
-		Value* pVal = var_val(varId);
-		if (pVal) {
-			if (pVal->is_str()) {
-				PINT_DBG_MSG(FMT_B_YELLOW "\"%s\"" FMT_OFF, pVal->val.pStr);
-			} else if (pVal->is_num()) {
-				PINT_DBG_MSG("%f", pVal->val.num);
-			} else {
-				PINT_DBG_MSG("--");
-			}
-		} else {
-
-		}
-		PINT_DBG_MSG("\n");
-	}
-}
-
-void ExecContext::set_error(const EvalError errCode) {
-	mErrCode = errCode;
-	if (errCode != EvalError::NONE) {
-		set_break(true);
-	}
-}
-
-EvalError ExecContext::get_error() const { return mErrCode; }
-
-void ExecContext::print_error() const {
-	PINT_DBG_MSG(FMT_BOLD FMT_RED "ERROR: " FMT_OFF);
-	switch(mErrCode) {
-		case EvalError::BAD_VAR_CLAUSE:
-			PINT_DBG_MSG("Invalid variable definition clause.\n");
-			break;
-		case EvalError::VAR_SYM:
-			PINT_DBG_MSG("SYM type expected for a variable name.\n");
-			break;
-		case EvalError::VAR_CTX_ADD:
-			PINT_DBG_MSG("Error adding variable to the context.\n");
-			break;
-		case EvalError::BAD_OPERAND_COUNT:
-			PINT_DBG_MSG("A numeric operand expected.\n");
-			break;
-		case EvalError::BAD_OPERAND_TYPE_NUM:
-			PINT_DBG_MSG("A numeric value expected.\n");
-			break;
-		case EvalError::BAD_OPERAND_TYPE_SYM:
-			PINT_DBG_MSG("A symbol expected.\n");
-			break;
-		case EvalError::BAD_OPERAND_TYPE_STR:
-			PINT_DBG_MSG("A string value expected.\n");
-			break;
-		case EvalError::VAR_NOT_FOUND:
-			PINT_DBG_MSG("Variable not found.\n");
-			break;
-		case EvalError::BAD_IF_CLAUSE:
-			PINT_DBG_MSG("Missing condition expression in 'if'.\n");
-			break;
-		case EvalError::BAD_FUNC_ARGS:
-			PINT_DBG_MSG("Bad argument number or arguments types for a function call.\n");
-			break;
-		case EvalError::NONE:
-		default:
-			break;
-	}
-}
-
-void ExecContext::set_break(const bool brk) {
-	mBreak = brk;
-}
-
-bool ExecContext::should_break() const {
-	return mBreak;
-}
-
-void ExecContext::set_local_binding(void* pBinding) {
-	mpBinding = pBinding;
-}
-
-void* ExecContext::get_local_binding() {
-	return mpBinding;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-Value NumOpInfo::apply(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_none();
-
-	if (valA.is_num() && valB.is_num()) {
-		if (func) {
-			val = func(valA, valB);
-		}
-	}
-
-	return val;
-}
-
-static Value numop_add(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(valA.val.num + valB.val.num);
-	return val;
-}
-
-static Value numop_sub(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(valA.val.num - valB.val.num);
-	return val;
-}
-
-static Value numop_mul(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(valA.val.num * valB.val.num);
-	return val;
-}
-
-static Value numop_div(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(valA.val.num / valB.val.num);
-	return val;
-}
-
-static Value numop_logand(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(uint64_t(valA.val.num) & uint64_t(valB.val.num));
-	return val;
-}
-
-static Value numop_logxor(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(uint64_t(valA.val.num) ^ uint64_t(valB.val.num));
-	return val;
-}
-
-static Value numop_logior(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(uint64_t(valA.val.num) | uint64_t(valB.val.num));
-	return val;
-}
-
-static Value numop_eq(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num == valB.val.num));
-	return val;
-}
-
-static Value numop_ne(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num != valB.val.num));
-	return val;
-}
-
-static Value numop_gt(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num > valB.val.num));
-	return val;
-}
-
-static Value numop_ge(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num >= valB.val.num));
-	return val;
-}
-
-static Value numop_lt(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num < valB.val.num));
-	return val;
-}
-
-static Value numop_le(const Value& valA, const Value& valB) {
-	Value val;
-	val.set_num(double(valA.val.num <= valB.val.num));
-	return val;
-}
-
-static struct {
-	const char* pName;
-	NumOpInfo opInfo;
-} s_numOp_tbl[] = {
-	{ "+", { numop_add, 0.0 } },
-	{ "-", { numop_sub, 0.0 } },
-	{ "*", { numop_mul, 1.0 } },
-	{ "/", { numop_div, 1.0 } },
-	{ "logand", { numop_logand, 1.0 } },
-	{ "logxor", { numop_logxor, 0.0 } },
-	{ "logior", { numop_logior, 0.0 } },
-	{ "=", { numop_eq, 0.0 } },
-	{ "/=", { numop_ne, 0.0 } },
-	{ ">", { numop_gt, 0.0 } },
-	{ ">=", { numop_ge, 0.0 } },
-	{ "<", { numop_lt, 0.0 } },
-	{ "<=", { numop_le, 0.0 } },
-};
-
-static bool check_numop(const char* pSym, NumOpInfo* pInfo) {
-	size_t numops = XD_ARY_LEN(s_numOp_tbl);
-	bool res = false;
-	for (size_t i = 0; i < numops; ++i) {
-		if (nxCore::str_eq(s_numOp_tbl[i].pName, pSym)) {
-			*pInfo = s_numOp_tbl[i].opInfo;
-			res = true;
-			break;
-		}
-	}
-	return res;
-}
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void CodeBlock::init() {
-	mListCnt = 0;
-	mListStack.reset();
-}
-
-void CodeBlock::reset() {
-	PINT_DBG_MSG("Releasing %d lists\n", mListCnt);
-	for (uint32_t i = 0; i < ListStack::CODE_LST_MAX; ++i) {
-		mLists[i].reset();
-	}
-	mListCnt = 0;
-	mListStack.reset();
-}
-
-CodeBlock::CodeBlock(ExecContext& ctx, FuncLibrary* pFuncLib) :
-	mCtx(ctx),
-	mpFuncLib(pFuncLib),
-	mListCnt(0)
-{
-	mListStack.reset();
-}
-
-CodeBlock::~CodeBlock() {}
-
-CodeList* CodeBlock::new_list() {
-	CodeList* pLst = mListCnt >= ListStack::CODE_LST_MAX ? nullptr : &mLists[mListCnt++];
-	return pLst;
-}
-
-bool CodeBlock::operator()(const cxLexer::Token& tok) {
-	CodeItem item;
-	item.set_none();
-
-	CodeList* pTopLst = mListStack.top();
-
-	if (tok.is_punctuation()) {
-		if (tok.id == cxLexer::TokId::TOK_SEMICOLON) return false;
-		if (tok.id == cxLexer::TokId::TOK_LPAREN) {
-			CodeList* pNewLst = new_list();
-			if (pNewLst == nullptr) return false;
-			mListStack.push(pNewLst);
-			item.set_list(pNewLst);
-		} else if (tok.id == cxLexer::TokId::TOK_RPAREN) {
-			mListStack.pop();
-		} else {
-			item.set_sym(tok.val.c);
-		}
-	} else if (tok.is_symbol()) {
-		item.set_sym(reinterpret_cast<char*>(tok.val.p));
-	} else if (tok.id == cxLexer::TokId::TOK_FLOAT) {
-		item.set_num(tok.val.f);
-	} else if (tok.id == cxLexer::TokId::TOK_INT) {
-		item.set_num(tok.val.i);
-	} else if (tok.is_string()) {
-		const char* pStr = mCtx.add_str(reinterpret_cast<const char*>(tok.val.p));
-		item.set_str(pStr);
-	}
-
-	if (!item.is_none()) {
-		if (pTopLst) {
-			pTopLst->append(item);
-		}
-	}
-	return true;
-}
-
-void CodeBlock::parse(const SrcCode::Line& line) {
-	reset();
-
-	if (line.valid()) {
-		cxLexer lexer;
-		lexer.set_text(line.pText, line.textSize);
-		lexer.scan(*this, s_memLock.get());
-	}
-}
-
-Value CodeBlock::eval_sub(CodeList* pLst, const uint32_t org, const uint32_t slice) {
-	NumOpInfo numOpInfo;
-	Value val;
-
-	val.set_none();
-
-	if (!pLst || mCtx.get_error() != EvalError::NONE) return val;
-
-	uint32_t cnt = pLst->count();
-	if (slice > 0) {
-		cnt = org + slice;
-	}
-	if (cnt == 0) return val;
-	CodeItem* pLstItems = pLst->get_items();
-	FuncDef funcDef;
-	for (uint32_t i = org; i < cnt; ++i) {
-		CodeItem* pItem = &pLstItems[i];
-		if (pItem->is_list()) {
-			val = eval_sub(pItem->val.pLst);
-		} else if (pItem->is_sym()) {
-			if (nxCore::str_eq(pItem->val.sym, "if")) {
-				if (i + 1 < cnt) {
-					Value condVal = eval_sub(pLst, 1, 1);
-
-					if (!!condVal.val.num) {
-						if (i + 2 < cnt) {
-							val = eval_sub(pLst, 2, 1);
-						} else {
-							mCtx.set_error(EvalError::BAD_IF_CLAUSE);
-						}
-					} else {
-						if (i + 3 < cnt) {
-							val = eval_sub(pLst, 3, 1);
-						}
-					}
-					i = cnt;
-				} else {
-					mCtx.set_error(EvalError::BAD_IF_CLAUSE);
-				}
-			} else if (nxCore::str_eq(pItem->val.sym, "break")) {
-				mCtx.set_break();
-				i = cnt;
-			} else if (nxCore::str_eq(pItem->val.sym, "defvar")) {
-				if (i + 1 < cnt) {
-					CodeItem* pVarNameItem = pItem + 1;
-					if (pVarNameItem->is_sym()) {
-						const char* pVarName = pVarNameItem->val.sym;
-						int varId = mCtx.add_var(pVarName);
-						if (varId >= 0) {
-							Value* pVarVal = mCtx.var_val(varId);
-							if (i + 2 < cnt) {
-								val = eval_sub(pLst, 2, 1);
-								i += 2;
-								if (pVarVal) {
-									*pVarVal = val;
-								}
-							} else {
-								++i;
-								pVarVal->set_none();
-							}
-						} else {
-							mCtx.set_error(EvalError::VAR_CTX_ADD);
-						}
-					} else {
-						mCtx.set_error(EvalError::VAR_SYM);
-					}
-				} else {
-					mCtx.set_error(EvalError::BAD_VAR_CLAUSE);
-				}
-			} else if (nxCore::str_eq(pItem->val.sym, "set")) {
-				if (i + 1 < cnt) {
-					CodeItem* pVarNameItem = pItem + 1;
-					const char* pVarName = pVarNameItem->val.sym;
-					Value* pVal = mCtx.var_val(pVarName);
-					if (pVal) {
-						if (i + 2 < cnt) {
-							val = eval_sub(pLst, 2, 1);
-							*pVal = val;
-							i += 2;
-						}
-					} else {
-						mCtx.set_error(EvalError::VAR_NOT_FOUND);
-					}
-				}
-			} else if (nxCore::str_eq(pItem->val.sym, "eq")) {
-				if (i + 2 < cnt) {
-					Value valA, valB;
-					valA = eval_sub(pLst, 1, 1);
-					valB = eval_sub(pLst, 2, 1);
-					i += 2;
-					if (valA.is_str() && valB.is_str()) {
-						val.set_num(double(nxCore::str_eq(valA.val.pStr, valB.val.pStr)));
-						i = cnt;
-					} else {
-						mCtx.set_error(EvalError::BAD_OPERAND_TYPE_STR);
-					}
-				} else {
-					mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
-				}
-			} else if (nxCore::str_eq(pItem->val.sym, "ne")) {
-				if (i + 2 < cnt) {
-					Value valA, valB;
-					valA = eval_sub(pLst, 1, 1);
-					valB = eval_sub(pLst, 2, 1);
-					i += 2;
-					if (valA.is_str() && valB.is_str()) {
-						val.set_num(double(!nxCore::str_eq(valA.val.pStr, valB.val.pStr)));
-						i = cnt;
-					} else {
-						mCtx.set_error(EvalError::BAD_OPERAND_TYPE_STR);
-					}
-				} else {
-					mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
-				}
-
-			} else if (check_numop(pItem->val.sym, &numOpInfo)) {
-				Value valA;
-				Value valB;
-				if (i + 2 > cnt) {
-					mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
-				} else if (i + 2 == cnt) {
-					valA.set_num(numOpInfo.unaryVal);
-					valB = eval_sub(pLst, 1, 1);
-					val = numOpInfo.apply(valA, valB);
-
-					++i;
-				} else {
-					val = eval_sub(pLst, 1, 1);
-
-					for (uint32_t j = 2; j < cnt; ++j) {
-						valA = val;
-						valB = eval_sub(pLst, j, 1);
-						val = numOpInfo.apply(valA, valB);
-					}
-					i = cnt;
-				}
-			} else if (mpFuncLib && mpFuncLib->find(pItem->val.sym, &funcDef)) {
-				uint32_t n = cnt - i - 1;
-				Value args[FuncDef::MAX_ARGS];
-				uint32_t nargs = nxCalc::min(n, FuncDef::MAX_ARGS);
-
-				for(uint32_t j = 0; j < nargs; ++j) {
-					args[j] = eval_sub(pLst, i + j + 1, 1);
-					PINT_DBG_MSG("Arg %d : %f\n", j, args[j].val.num);
-				}
-
-				i += n;
-
-				if (mpFuncLib->check_func_args(funcDef, nargs, args)) {
-					val = (*funcDef.func)(mCtx, nargs, args);
-				} else {
-					mCtx.set_error(EvalError::BAD_FUNC_ARGS);
-				}
-			} else { // variable name
-				Value* pVal = mCtx.var_val(pItem->val.sym);
-				if (pVal) {
-					val = *pVal;
-				} else {
-					mCtx.set_error(EvalError::VAR_NOT_FOUND);
-				}
-			}
-		} else if (pItem->is_num()) {
-			val.set_num(pItem->val.num);
-		} else if (pItem->is_str()) {
-			val.set_str(pItem->val.pStr);
-		}
-
-		if (mCtx.get_error() != EvalError::NONE) {
-			i = cnt;
-		}
-	}
-	return val;
-}
-
-void CodeBlock::eval() {
-	mCtx.set_error(EvalError::NONE);
-	eval_sub(&mLists[0]);
-}
-
-void CodeBlock::print_sub(const CodeList* pLst, int lvl) const {
-	CodeItem* pItems = pLst->get_items();
-	uint32_t sz = pLst->count();
-	for (uint32_t i = 0; i < sz; ++i) {
-		const CodeItem& item = pItems[i];
-		if (item.is_list()) {
-			PINT_DBG_MSG("%*c" FMT_B_BLUE "- LST" FMT_OFF " %p\n", lvl, ' ', item.val.pLst);
-			print_sub(item.val.pLst, lvl+1);
-		} else if (item.is_num()) {
-			PINT_DBG_MSG("%*c" FMT_B_GREEN "NUM" FMT_OFF " %f\n", lvl, ' ', item.val.num);
-		} else if (item.is_sym()) {
-			PINT_DBG_MSG("%*c" FMT_B_GREEN "SYM" FMT_OFF " %s\n", lvl, ' ', item.val.sym);
-		} else if (item.is_str()) {
-			PINT_DBG_MSG("%*c" FMT_B_GREEN "STR" FMT_B_YELLOW " \"%s\"" FMT_OFF "\n", lvl, ' ', item.val.pStr);
-		}
-	}
-}
-
-void CodeBlock::print() const {
-	if (mListCnt == 0) return;
-	PINT_DBG_MSG("# lists: %d\n", mListCnt);
-	print_sub(mLists, 1);
-}
-
-void CodeBlock::from_tokens(cxLexer::Token* pTop, const size_t ntok) {
-	reset();
-	if (pTop) {
-		for (size_t i = 0; i < ntok; ++i) {
-			bool tokRes = (*this)(pTop[i]);
-			if (!tokRes) break;
-		}
-	}
-}
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void CodeItem::set_none() {
-	type = Type::NON;
-	val.num = 0;
-}
-bool CodeItem::is_none() const {
-	return type == Type::NON;
-}
-
-void CodeItem::set_sym(const char* pStr) {
-	type = Type::SYM;
-	size_t sz = nxCalc::clamp(nxCore::str_len(pStr), size_t(0), Value::SYM_MAX_LEN);
-	nxCore::mem_copy(val.sym, pStr, sz);
-	val.sym[sz] = '\x0';
-}
-bool CodeItem::is_sym() const {
-	return type == Type::SYM;
-}
-
-void CodeItem::set_num(double num) {
-	type = Type::NUM;
-	val.num = num;
-}
-bool CodeItem::is_num() const {
-	return type == Type::NUM;
-}
-
-void CodeItem::set_str(const char* pStr) {
-	type = Type::STR;
-	val.pStr = pStr;
-}
-bool CodeItem::is_str() const {
-	return type == Type::STR;
-}
-
-void CodeItem::set_list(CodeList* pLst) {
-	type = Type::LST;
-	val.pLst = pLst;
-}
-bool CodeItem::is_list() const {
-	return type == Type::LST;
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void CodeList::init() {
-	if (mpItems) {
-		size_t sz = mCapacity * sizeof(Value);
-		nxCore::mem_zero(mpItems, sz);
-	} else {
-		mCapacity = 0;
-	}
-	mCount = 0;
-}
-
-void CodeList::reset() {
-	if (mpItems) {
-		if (mpItems != mItems) {
-			s_memLock.acquire();
-			nxCore::mem_free(mpItems);
-			s_memLock.release();
-		}
-		mpItems = nullptr;
-	}
-	mCount = 0;
-	mCapacity = 0;
-}
-
-bool CodeList::valid() const {
-	return (mpItems != nullptr);
-}
-
-void CodeList::append(const CodeItem& itm) {
-	if (mpItems == nullptr) {
-#if 0
-		size_t sz = mChunkSize * sizeof(CodeItem);
-		s_memLock.acquire();
-		mpItems = reinterpret_cast<CodeItem*>(nxCore::mem_alloc(sz));
-		s_memLock.release();
-		mCapacity = mChunkSize;
-#else
-		mpItems = mItems;
-		mCapacity = PINT_CL_CHUNK_SZ;
-#endif
-	}
-	if (mCount >= mCapacity) {
-		size_t newCap = mCapacity + mChunkSize;
-		size_t newSz = newCap * sizeof(CodeItem);
-		s_memLock.acquire();
-		CodeItem* pNewItems = reinterpret_cast<CodeItem*>(nxCore::mem_alloc(newSz));
-		s_memLock.release();
-		if (pNewItems) {
-			nxCore::mem_copy(pNewItems, mpItems, mCapacity * sizeof(CodeItem));
-			if (mpItems != mItems) {
-				s_memLock.acquire();
-				nxCore::mem_free(mpItems);
-				s_memLock.release();
-			}
-			mpItems = pNewItems;
-			mCapacity += mChunkSize;
-		}
-	}
-	mpItems[mCount++] = itm;
-}
-
-CodeItem* CodeList::get_items() const {
-	return mpItems;
-}
-
-uint32_t CodeList::count() const {
-	return mCount;
-}
-
-uint32_t CodeList::capacity() const {
-	return mCapacity;
-}
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-CodeList* ListStack::top() {
-	return ptr - 1 < 0 ? nullptr : lists[ptr - 1];
-}
-
-void ListStack::push(CodeList* pLst) {
-	if (ptr < CODE_LST_MAX) {
-		lists[ptr++] = pLst;
-	}
-}
-
-CodeList* ListStack::pop() {
-	CodeList* pList = top();
-	if (pList) {
-		ptr--;
-	}
-	return pList;
-}
-
-} // Pint
-
+#include "crosscore.hpp"
+#include "pint.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if 1
+#define FMT_ESC(_code_) "\x1B[" #_code_ "m"
+#else
+#define FMT_ESC(_code_) ""
+#endif
+
+#define FMT_BOLD FMT_ESC(1)
+#define FMT_UNDER FMT_ESC(4)
+#define FMT_BLACK FMT_ESC(30)
+#define FMT_BLACK_BG FMT_ESC(40)
+#define FMT_RED FMT_ESC(31)
+#define FMT_RED_BG FMT_ESC(41)
+#define FMT_GREEN FMT_ESC(32)
+#define FMT_GREEN_BG FMT_ESC(42)
+#define FMT_YELLOW FMT_ESC(33)
+#define FMT_YELLOW_BG FMT_ESC(43)
+#define FMT_BLUE FMT_ESC(34)
+#define FMT_BLUE_BG FMT_ESC(44)
+#define FMT_MAGENTA FMT_ESC(35)
+#define FMT_MAGENTA_BG FMT_ESC(45)
+#define FMT_CYAN FMT_ESC(36)
+#define FMT_CYAN_BG FMT_ESC(46)
+#define FMT_WHITE FMT_ESC(37)
+#define FMT_WHITE_BG FMT_ESC(47)
+#define FMT_GRAY FMT_ESC(90)
+#define FMT_GRAY_BG FMT_ESC(100)
+#define FMT_B_RED FMT_ESC(91)
+#define FMT_B_RED_BG FMT_ESC(101)
+#define FMT_B_GREEN FMT_ESC(92)
+#define FMT_B_GREEN_BG FMT_ESC(102)
+#define FMT_B_YELLOW FMT_ESC(93)
+#define FMT_B_YELLOW_BG FMT_ESC(103)
+#define FMT_B_BLUE FMT_ESC(94)
+#define FMT_B_BLUE_BG FMT_ESC(104)
+#define FMT_B_MAGENTA FMT_ESC(95)
+#define FMT_B_MAGENTA_BG FMT_ESC(105)
+#define FMT_B_CYAN FMT_ESC(96)
+#define FMT_B_CYAN_BG FMT_ESC(106)
+#define FMT_B_WHITE FMT_ESC(97)
+#define FMT_B_WHITE_BG FMT_ESC(107)
+#define FMT_OFF FMT_ESC(0)
+
+#if defined(PINT_DBG)
+#define PINT_DBG_MSG(...) nxCore::dbg_msg(__VA_ARGS__)
+#else
+#define PINT_DBG_MSG(...)
+#endif
+
+namespace Pint {
+
+typedef Value (*NumOpFunc)(const Value& valA, const Value& valB);
+typedef Value (CodeBlock::*NumKernel)(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info);
+
+struct NumOpInfo {
+	NumOpFunc func;     // one pair: unary forms and the operands the kernel doesn't handle itself
+	NumKernel kernel;   // the whole form
+	int64_t unaryVal;
+	int32_t listOp; // ListOp applied element-wise to list operands, -1: lists give none
+
+	Value apply(ExecContext& ctx, const Value& valA, const Value& valB) const;
+};
+
+static struct MemLock {
+	sxLock* mpLock;
+
+	void acquire() {
+		if (mpLock) {
+			nxSys::lock_acquire(mpLock);
+		}
+	}
+
+	void release() {
+		if (mpLock) {
+			nxSys::lock_release(mpLock);
+		}
+	}
+
+	void set(sxLock* pLock) {
+		mpLock = pLock;
+	}
+
+	sxLock* get() {
+		return mpLock;
+	}
+} s_memLock = {0};
+
+void set_mem_lock(sxLock* pLock) {
+	s_memLock.set(pLock);
+}
+
+sxLock* get_mem_lock() {
+	return s_memLock.get();
+}
+
+struct SessionDef {
+	uint64_t reads[CodeBlock::READ_MASK_SIZE];
+	uint32_t loc;
+	uint32_t lineNo;
+	int varId;
+	int dom;
+};
+
+struct SessionDefs {
+	SessionDef* pDefs;
+	uint32_t num;
+	uint32_t cap;
+};
+
+static void defs_add(SessionDefs* pDefs, ExecContext* pCtx, const CodeBlock& blk, const SrcCode::Line& line, const uint32_t loc, const uint64_t* pReads) {
+	const char* pName = blk.get_def_name();
+	if (!pName || pCtx->get_error() != EvalError::NONE || pCtx->suspended()) return;
+	if (pDefs->num >= pDefs->cap) {
+		uint32_t cap = nxCalc::max(pDefs->cap * 2, 64U);
+		s_memLock.acquire();
+		SessionDef* pNew = reinterpret_cast<SessionDef*>(nxCore::mem_alloc(sizeof(SessionDef) * cap, "Pint:SessionDefs"));
+		if (pNew && pDefs->pDefs) {
+			nxCore::mem_copy(pNew, pDefs->pDefs, sizeof(SessionDef) * pDefs->num);
+			nxCore::mem_free(pDefs->pDefs);
+		}
+		s_memLock.release();
+		if (!pNew) return;
+		pDefs->pDefs = pNew;
+		pDefs->cap = cap;
+	}
+	SessionDef* pDef = &pDefs->pDefs[pDefs->num++];
+	nxCore::mem_copy(pDef->reads, pReads, sizeof(pDef->reads));
+	pDef->loc = loc;
+	pDef->lineNo = uint32_t(line.no);
+	pDef->varId = pCtx->find_var(pName);
+	pDef->dom = pCtx->get_domain();
+}
+
+static void exec_lines(SrcCode& src, CodeBlock& blk, ExecContext* pCtx, bool resume, SessionDefs* pDefs = nullptr) {
+	uint64_t reads[CodeBlock::READ_MASK_SIZE];
+	while (!(src.eof() || pCtx->should_break())) {
+		SrcCode::Line line = src.get_line();
+		line.print();
+		if (line.valid()) {
+			// the previous line is done with, its literals aren't needed anymore
+			pCtx->collect_strs(false);
+			blk.parse(line);
+			blk.print();
+			if (pDefs) {
+				nxCore::mem_zero(reads, sizeof(reads));
+				blk.set_read_mask(reads);
+			}
+			blk.eval(resume);
+			if (pDefs) {
+				blk.set_read_mask(nullptr);
+				defs_add(pDefs, pCtx, blk, line, uint32_t(line.pText - src.get_source()), reads);
+			}
+			if (pCtx->suspended()) {
+				Frame* pFrame = pCtx->get_frame();
+				pFrame->pSrc = src.get_source();
+				pFrame->srcSize = uint32_t(src.source_size());
+				pFrame->lineLoc = uint32_t(line.pText - pFrame->pSrc);
+				pFrame->lineNo = uint32_t(line.no);
+			}
+		}
+		resume = false;
+	}
+}
+
+// wait ticks are handled by the caller
+static void resume_lines(ExecContext* pCtx, CodeBlock& blk, SessionDefs* pDefs = nullptr) {
+	Frame* pFrame = pCtx->get_frame();
+	pCtx->set_break(false);
+	SrcCode src(pFrame->pSrc, pFrame->srcSize);
+	src.seek(pFrame->lineLoc, pFrame->lineNo);
+	exec_lines(src, blk, pCtx, true, pDefs);
+}
+
+void interp(const char* pSrc, size_t srcSize, ExecContext* pCtx, FuncLibrary* pFuncLib) {
+	if (pSrc && pCtx) {
+		pCtx->clear_vars();
+		SrcCode src(pSrc, srcSize);
+		CodeBlock blk(*pCtx, pFuncLib);
+		blk.init();
+		exec_lines(src, blk, pCtx, false);
+	}
+}
+
+bool resume(ExecContext* pCtx, FuncLibrary* pFuncLib) {
+	if (!pCtx || !pCtx->suspended()) return false;
+	Frame* pFrame = pCtx->get_frame();
+	if (pFrame->wait > 0) {
+		--pFrame->wait;
+		return true;
+	}
+	CodeBlock blk(*pCtx, pFuncLib);
+	blk.init();
+	resume_lines(pCtx, blk);
+	return pCtx->suspended();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Session::Session() :
+	mpCtx(nullptr),
+	mpFuncLib(nullptr),
+	mpBlk(nullptr),
+	mpSrc(nullptr),
+	mSrcSize(0),
+	mSrcCap(0),
+	mLineNo(0),
+	mpDefs(nullptr),
+	mOwnCtx(false)
+	{
+		nxCore::mem_zero(mDirty, sizeof(mDirty));
+	}
+
+Session::~Session() {
+	reset();
+}
+
+void Session::init(FuncLibrary* pFuncLib, ExecContext* pCtx) {
+	reset();
+	mpFuncLib = pFuncLib;
+	mOwnCtx = pCtx == nullptr;
+	if (mOwnCtx) {
+		s_memLock.acquire();
+		void* pMem = nxCore::mem_alloc(sizeof(ExecContext), "Pint:SessionCtx");
+		s_memLock.release();
+		if (!pMem) return;
+		pCtx = ::new(pMem) ExecContext();
+		pCtx->init();
+	}
+	mpCtx = pCtx;
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(sizeof(CodeBlock), "Pint:SessionBlk");
+	s_memLock.release();
+	if (pMem) {
+		mpBlk = ::new(pMem) CodeBlock(*mpCtx, mpFuncLib);
+		mpBlk->init();
+	}
+}
+
+void Session::reset() {
+	set_reactive(false);
+	s_memLock.acquire();
+	if (mpBlk) {
+		mpBlk->~CodeBlock();
+		nxCore::mem_free(mpBlk);
+		mpBlk = nullptr;
+	}
+	if (mpCtx && mOwnCtx) {
+		mpCtx->~ExecContext();
+		nxCore::mem_free(mpCtx);
+	}
+	mpCtx = nullptr;
+	if (mpSrc) {
+		nxCore::mem_free(mpSrc);
+		mpSrc = nullptr;
+	}
+	s_memLock.release();
+	mSrcSize = 0;
+	mSrcCap = 0;
+	mLineNo = 0;
+	mOwnCtx = false;
+	mpFuncLib = nullptr;
+}
+
+bool Session::reserve(const size_t size) {
+	if (size <= mSrcCap) return true;
+	size_t cap = nxCalc::max(mSrcCap * 2, size_t(1024));
+	while (cap < size) {
+		cap *= 2;
+	}
+	s_memLock.acquire();
+	char* pSrc = reinterpret_cast<char*>(nxCore::mem_alloc(cap, "Pint:SessionSrc"));
+	if (pSrc && mpSrc) {
+		nxCore::mem_copy(pSrc, mpSrc, mSrcSize);
+		nxCore::mem_free(mpSrc);
+	}
+	s_memLock.release();
+	if (!pSrc) return false;
+	mpSrc = pSrc;
+	mSrcCap = cap;
+	if (mpCtx && mpCtx->suspended()) {
+		// the frame keeps an offset, only the base moves
+		mpCtx->get_frame()->pSrc = mpSrc;
+	}
+	return true;
+}
+
+bool Session::append(const char* pSrc, size_t srcSize) {
+	if (!mpCtx || !mpBlk || !pSrc) return false;
+	size_t org = mSrcSize;
+	if (!reserve(mSrcSize + srcSize + 1)) return false;
+	nxCore::mem_copy(mpSrc + mSrcSize, pSrc, srcSize);
+	mSrcSize += srcSize;
+	if (mSrcSize > org && mpSrc[mSrcSize - 1] != '\n') {
+		// the next chunk starts on its own line
+		mpSrc[mSrcSize++] = '\n';
+	}
+	size_t lineNo = mLineNo + 1;
+	for (size_t i = org; i < mSrcSize; ++i) {
+		if (mpSrc[i] == '\n') {
+			++mLineNo;
+		}
+	}
+	if (mpCtx->suspended()) {
+		// runs after the suspended script, see resume()
+		return true;
+	}
+	mpCtx->set_error(EvalError::NONE);
+	mpCtx->set_break(false);
+	SrcCode src(mpSrc, mSrcSize);
+	src.seek(org, lineNo);
+	exec_lines(src, *mpBlk, mpCtx, false, mpDefs);
+	return mpCtx->get_error() == EvalError::NONE;
+}
+
+bool Session::append(const char* pSrc) {
+	return pSrc ? append(pSrc, nxCore::str_len(pSrc)) : false;
+}
+
+bool Session::resume() {
+	if (!mpCtx || !mpBlk || !mpCtx->suspended()) return false;
+	Frame* pFrame = mpCtx->get_frame();
+	if (pFrame->wait > 0) {
+		--pFrame->wait;
+		return true;
+	}
+	pFrame->pSrc = mpSrc;
+	pFrame->srcSize = uint32_t(mSrcSize);
+	resume_lines(mpCtx, *mpBlk, mpDefs);
+	return mpCtx->suspended();
+}
+
+void Session::clear() {
+	if (mpCtx) {
+		mpCtx->clear_vars();
+	}
+	mSrcSize = 0;
+	mLineNo = 0;
+	if (mpDefs) {
+		mpDefs->num = 0;
+	}
+	nxCore::mem_zero(mDirty, sizeof(mDirty));
+}
+
+void Session::set_reactive(const bool enable) {
+	if (enable == is_reactive()) return;
+	s_memLock.acquire();
+	if (enable) {
+		mpDefs = reinterpret_cast<SessionDefs*>(nxCore::mem_alloc(sizeof(SessionDefs), "Pint:SessionDefs"));
+		if (mpDefs) {
+			nxCore::mem_zero(mpDefs, sizeof(SessionDefs));
+		}
+	} else {
+		if (mpDefs->pDefs) {
+			nxCore::mem_free(mpDefs->pDefs);
+		}
+		nxCore::mem_free(mpDefs);
+		mpDefs = nullptr;
+	}
+	s_memLock.release();
+	nxCore::mem_zero(mDirty, sizeof(mDirty));
+}
+
+void Session::touch(int id) {
+	if (id >= 0 && id < int(CodeBlock::READ_MASK_SIZE * 64)) {
+		XD_BIT_ARY_ST(uint64_t, mDirty, id);
+	}
+}
+
+bool Session::touch(const char* pName) {
+	int id = mpCtx ? mpCtx->find_var(pName) : -1;
+	touch(id);
+	return id >= 0;
+}
+
+uint32_t Session::update() {
+	if (!mpCtx || !mpBlk || !mpDefs || mpCtx->suspended()) return 0;
+	uint32_t n = 0;
+	mpCtx->set_error(EvalError::NONE);
+	mpCtx->set_break(false);
+	SrcCode src(mpSrc, mSrcSize);
+	// source order is a topological order: a definition only reads what was defined above it
+	for (uint32_t i = 0; i < mpDefs->num; ++i) {
+		SessionDef* pDef = &mpDefs->pDefs[i];
+		bool dirty = false;
+		for (uint32_t j = 0; j < CodeBlock::READ_MASK_SIZE; ++j) {
+			if (pDef->reads[j] & mDirty[j]) {
+				dirty = true;
+				break;
+			}
+		}
+		if (!dirty) continue;
+
+		src.seek(pDef->loc, pDef->lineNo);
+		SrcCode::Line line = src.get_line();
+		bool scoped = pDef->dom != ExecContext::ROOT_DOMAIN && pDef->dom != mpCtx->get_domain();
+		if (scoped) {
+			scoped = mpCtx->push_domain(mpCtx->get_domain_name(pDef->dom));
+		}
+		// the branches taken may differ this time
+		nxCore::mem_zero(pDef->reads, sizeof(pDef->reads));
+		mpCtx->collect_strs(false);
+		mpBlk->parse(line);
+		mpBlk->set_read_mask(pDef->reads);
+		mpBlk->eval();
+		mpBlk->set_read_mask(nullptr);
+		if (scoped) {
+			mpCtx->pop_domain();
+		}
+		++n;
+		if (mpCtx->get_error() != EvalError::NONE) break;
+		touch(pDef->varId);
+	}
+	nxCore::mem_zero(mDirty, sizeof(mDirty));
+	return n;
+}
+
+void cache(const char* pSrc, size_t srcSize) {}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct SchedQueue {
+	std::atomic<uint64_t> range; // next job | end << 32, the owner takes from the front, thieves from the end
+	uint8_t pad[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+struct SchedState {
+	FuncLibrary* pFuncLib;
+	uint32_t nworkers;
+	std::thread* pThreads; // nworkers - 1
+	SchedQueue* pQueues;
+	Job* pJobs;
+	std::atomic<uint32_t> remaining;
+	std::atomic<uint32_t> errors;
+	std::mutex mtx;
+	std::condition_variable startCv;
+	std::condition_variable doneCv;
+	uint32_t batch;
+	bool quit;
+	sxLock* pMemLock;
+};
+
+static bool sched_take(SchedQueue& que, const bool steal, uint32_t* pJobIdx) {
+	uint64_t range = que.range.load();
+	while (true) {
+		uint32_t org = uint32_t(range);
+		uint32_t end = uint32_t(range >> 32);
+		if (org >= end) return false;
+		uint64_t next = steal ? (uint64_t(end - 1) << 32) | org : (uint64_t(end) << 32) | (org + 1);
+		if (que.range.compare_exchange_weak(range, next)) {
+			*pJobIdx = steal ? end - 1 : org;
+			return true;
+		}
+	}
+}
+
+Scheduler::Scheduler() : mpState(nullptr) {}
+
+Scheduler::~Scheduler() {
+	reset();
+}
+
+void Scheduler::init(FuncLibrary* pFuncLib, const uint32_t nworkers) {
+	reset();
+	uint32_t nthreads = nworkers > 0 ? nworkers : nxCalc::max(std::thread::hardware_concurrency(), 1U);
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(sizeof(SchedState), "Pint:SchedState");
+	void* pQueMem = nxCore::mem_alloc(sizeof(SchedQueue) * nthreads, "Pint:SchedQueues");
+	if (!pMem || !pQueMem) {
+		if (pMem) {
+			nxCore::mem_free(pMem);
+		}
+		if (pQueMem) {
+			nxCore::mem_free(pQueMem);
+		}
+		pMem = nullptr;
+	}
+	s_memLock.release();
+	if (!pMem) return;
+	mpState = ::new(pMem) SchedState();
+	mpState->pFuncLib = pFuncLib;
+	mpState->nworkers = nthreads;
+	mpState->pQueues = reinterpret_cast<SchedQueue*>(pQueMem);
+	for (uint32_t i = 0; i < mpState->nworkers; ++i) {
+		::new(&mpState->pQueues[i]) SchedQueue();
+		mpState->pQueues[i].range = 0;
+	}
+	mpState->pJobs = nullptr;
+	mpState->remaining = 0;
+	mpState->errors = 0;
+	mpState->batch = 0;
+	mpState->quit = false;
+	mpState->pMemLock = nullptr;
+	if (mpState->nworkers > 1 && get_mem_lock() == nullptr) {
+		mpState->pMemLock = nxSys::lock_create();
+		set_mem_lock(mpState->pMemLock);
+	}
+	mpState->pThreads = new std::thread[mpState->nworkers - 1];
+	for (uint32_t i = 1; i < mpState->nworkers; ++i) {
+		mpState->pThreads[i - 1] = std::thread(worker_main, mpState, i);
+	}
+}
+
+void Scheduler::reset() {
+	if (!mpState) return;
+	{
+		std::unique_lock<std::mutex> lk(mpState->mtx);
+		mpState->quit = true;
+	}
+	mpState->startCv.notify_all();
+	for (uint32_t i = 1; i < mpState->nworkers; ++i) {
+		mpState->pThreads[i - 1].join();
+	}
+	delete[] mpState->pThreads;
+	if (mpState->pMemLock) {
+		set_mem_lock(nullptr);
+		nxSys::lock_destroy(mpState->pMemLock);
+	}
+	for (uint32_t i = 0; i < mpState->nworkers; ++i) {
+		mpState->pQueues[i].~SchedQueue();
+	}
+	SchedQueue* pQueues = mpState->pQueues;
+	mpState->~SchedState();
+	s_memLock.acquire();
+	nxCore::mem_free(pQueues);
+	nxCore::mem_free(mpState);
+	s_memLock.release();
+	mpState = nullptr;
+}
+
+uint32_t Scheduler::get_worker_count() const {
+	return mpState ? mpState->nworkers : 0;
+}
+
+void Scheduler::drain(SchedState* pState, const uint32_t idx) {
+	uint32_t nworkers = pState->nworkers;
+	while (true) {
+		uint32_t jobIdx = 0;
+		bool found = sched_take(pState->pQueues[idx], false, &jobIdx);
+		for (uint32_t i = 1; !found && i < nworkers; ++i) {
+			found = sched_take(pState->pQueues[(idx + i) % nworkers], true, &jobIdx);
+		}
+		if (!found) break;
+
+		Job& job = pState->pJobs[jobIdx];
+		job.pCtx->set_local_binding(job.pBinding);
+		interp(job.pSrc, job.srcSize, job.pCtx, pState->pFuncLib);
+		job.err = job.pCtx->get_error();
+		if (job.err != EvalError::NONE) {
+			++pState->errors;
+		}
+		if (--pState->remaining == 0) {
+			std::unique_lock<std::mutex> lk(pState->mtx);
+			pState->doneCv.notify_all();
+		}
+	}
+}
+
+void Scheduler::worker_main(SchedState* pState, const uint32_t idx) {
+	uint32_t batch = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lk(pState->mtx);
+			pState->startCv.wait(lk, [pState, batch] { return pState->quit || pState->batch != batch; });
+			if (pState->quit) break;
+			batch = pState->batch;
+		}
+		drain(pState, idx);
+	}
+}
+
+uint32_t Scheduler::run(Job* pJobs, const uint32_t njobs) {
+	if (!mpState || !pJobs || njobs == 0) return 0;
+	uint32_t nworkers = mpState->nworkers;
+	uint32_t chunk = (njobs + nworkers - 1) / nworkers;
+	mpState->pJobs = pJobs;
+	mpState->errors = 0;
+	mpState->remaining = njobs;
+	for (uint32_t i = 0; i < nworkers; ++i) {
+		uint32_t org = nxCalc::min(i * chunk, njobs);
+		uint32_t end = nxCalc::min(org + chunk, njobs);
+		mpState->pQueues[i].range = (uint64_t(end) << 32) | org;
+	}
+	{
+		std::unique_lock<std::mutex> lk(mpState->mtx);
+		++mpState->batch;
+	}
+	mpState->startCv.notify_all();
+	drain(mpState, 0);
+	std::unique_lock<std::mutex> lk(mpState->mtx);
+	mpState->doneCv.wait(lk, [this] { return mpState->remaining == 0; });
+	return mpState->errors;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SrcCode::Line::print() const {
+	PINT_DBG_MSG(FMT_BOLD "line %d: " FMT_OFF, no);
+	if (valid()) {
+		PINT_DBG_MSG(FMT_GREEN);
+		for (size_t i = 0; i < textSize; ++i) {
+			PINT_DBG_MSG("%c", pText[i]);
+		}
+		PINT_DBG_MSG(FMT_OFF "\n");
+	} else {
+		PINT_DBG_MSG(FMT_RED "invalid\n" FMT_OFF);
+	}
+}
+
+bool SrcCode::Line::valid() const {
+	return pText != nullptr && textSize > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+SrcCode::SrcCode(const char* pSrc, size_t srcSize)
+	:
+	mpSrc(pSrc),
+	mSrcSize(srcSize),
+	mSrcLoc(0),
+	mLineLoc(0),
+	mLineNo(0)
+	{}
+
+bool SrcCode::eof() const {
+	return mSrcLoc >= mSrcSize;
+}
+
+void SrcCode::restart() {
+	mSrcLoc = 0;
+}
+
+SrcCode::Line SrcCode::get_line() {
+	SrcCode::Line line = {0};
+
+	mLineLoc = mSrcLoc;
+	if (mpSrc) {
+		if (!eof()) {
+			++mLineNo;
+		}
+		while (!eof()) {
+			if (mpSrc[mSrcLoc] == '\r') {
+				++mSrcLoc;
+				if (eof()) {
+					break;
+				}
+				if (mpSrc[mSrcLoc] != '\n') {
+					break;
+				}
+			}
+			if (mpSrc[mSrcLoc] == '\n') {
+				++mSrcLoc;
+				break;
+			}
+			++mSrcLoc;
+			++line.textSize;
+		}
+	}
+	if (line.textSize > 0) {
+		line.pText = &mpSrc[mLineLoc];
+	}
+	line.no = mLineNo;
+	return line;
+}
+
+void SrcCode::seek(const size_t loc, const size_t lineNo) {
+	mSrcLoc = nxCalc::min(loc, mSrcSize);
+	mLineNo = lineNo > 0 ? lineNo - 1 : 0;
+}
+
+void SrcCode::make_cache_key(char* pBuf, const size_t bufSize) {
+	if (pBuf && (bufSize > 0)) {
+		nxCore::mem_zero(pBuf, bufSize);
+
+		if (mpSrc && (mSrcSize > 0)) {
+			size_t idx = 0;
+			uintptr_t addr = reinterpret_cast<uintptr_t>(mpSrc);
+
+			while ((idx < sizeof(void*)*2) && (idx < (bufSize - 1))) {
+				static const char* hex = "0123456789abcdef";
+				pBuf[idx] = hex[(addr >> (idx << 2)) & 0xF];
+				++idx;
+			}
+		}
+	}
+}
+
+
+const char* SrcCode::get_source() {
+	return mpSrc;
+}
+
+size_t SrcCode::source_size() const {
+	return mSrcSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Value df_sin(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(mth_sin(pArgs[0].get_num()));
+	return res;
+}
+static const FuncDef s_df_sin_desc = {
+	"sin", df_sin, 1, Value::Type::NUM, {Value::Type::NUM}, false, true
+};
+
+Value df_cos(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(mth_cos(pArgs[0].get_num()));
+	return res;
+}
+static const FuncDef s_df_cos_desc = {
+	"cos", df_cos, 1, Value::Type::NUM, {Value::Type::NUM}, false, true
+};
+
+Value df_abs(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	if (pArgs[0].is_int()) {
+		int64_t num = pArgs[0].get_int();
+		res.set_int(num < 0 ? -num : num);
+	} else {
+		res.set_num(mth_fabs(pArgs[0].get_num()));
+	}
+	return res;
+}
+static const FuncDef s_df_abs_desc = {
+	"abs", df_abs, 1, Value::Type::NUM, {Value::Type::NUM}, false, true
+};
+
+Value df_not(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_int(pArgs[0].get_num() == 0.0 ? 1 : 0);
+	return res;
+}
+static const FuncDef s_df_not_desc = {
+	"not", df_not, 1, Value::Type::NUM, {Value::Type::NUM}, false, true
+};
+
+Value glb_rng_next(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	uint64_t rnd = ctx.rng_next();
+	rnd &= 0xffffffff;
+	res.set_int(int64_t(rnd));
+	return res;
+}
+static const FuncDef s_df_rng_next_desc = {
+	"glb_rng_next", glb_rng_next, 0, Value::Type::NUM, {Value::Type::NUM}
+};
+
+Value glb_rng_01(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(ctx.rng_01());
+	return res;
+}
+static const FuncDef s_df_rng_01_desc = {
+	"glb_rng_01", glb_rng_01, 0, Value::Type::NUM, {Value::Type::NUM}
+};
+
+Value df_rng_seed(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	ctx.seed_rng(uint64_t(int64_t(pArgs[0].get_num())));
+	res.set_none();
+	return res;
+}
+static const FuncDef s_df_rng_seed_desc = {
+	"rng_seed", df_rng_seed, 1, Value::Type::NON, {Value::Type::NUM}
+};
+
+Value df_set_domain(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(double(ctx.set_domain(pArgs[0].get_str())));
+	return res;
+}
+static const FuncDef s_df_set_domain_desc = {
+	"set_domain", df_set_domain, 1, Value::Type::NUM, {Value::Type::STR}
+};
+
+Value df_push_domain(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(double(ctx.push_domain(pArgs[0].get_str())));
+	return res;
+}
+static const FuncDef s_df_push_domain_desc = {
+	"push_domain", df_push_domain, 1, Value::Type::NUM, {Value::Type::STR}
+};
+
+Value df_pop_domain(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	res.set_num(double(ctx.pop_domain()));
+	return res;
+}
+static const FuncDef s_df_pop_domain_desc = {
+	"pop_domain", df_pop_domain, 0, Value::Type::NUM, {}
+};
+
+// (check_flag domain name): 1 if the variable exists in that domain and is set, regardless of the current scope
+Value df_check_flag(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	Value res;
+	const Value* pVal = ctx.get_val(ctx.find_var(ctx.find_domain(pArgs[0].get_str()), pArgs[1].get_str()));
+	bool flg = pVal && (pVal->is_str() || (pVal->is_num() && pVal->get_num() != 0.0));
+	res.set_num(double(flg));
+	return res;
+}
+static const FuncDef s_df_check_flag_desc = {
+	"check_flag", df_check_flag, 2, Value::Type::NUM, {Value::Type::STR, Value::Type::STR}
+};
+
+static const FuncDef s_defFuncDesc[] = {
+	s_df_sin_desc, s_df_cos_desc, s_df_abs_desc, s_df_not_desc, s_df_rng_next_desc, s_df_rng_01_desc, s_df_rng_seed_desc,
+	s_df_set_domain_desc, s_df_push_domain_desc, s_df_pop_domain_desc, s_df_check_flag_desc
+};
+
+// A function defined by defun: the body is copied out of the CodeBlock that parsed the definition
+// into one block with the function, string literals included, parameter symbols become ARG items.
+struct ScriptFunc {
+	FuncDef def;
+	ScriptFunc* pNext;  // replaced definitions, freed with the library
+	CodeList* pLists;   // [0]: the body forms
+	uint32_t listNum;
+	char name[CodeItem::SYM_MAX_LEN + 1];
+};
+
+struct ScriptTable {
+	std::mutex mtx;  // held while defining and looking up names
+	cxStrMap<int>* pMap;
+	std::atomic<ScriptFunc*> pFuncs[FuncLibrary::SCRIPT_MAX];
+	std::atomic<uint32_t> num;
+	ScriptFunc* pRetired;
+};
+
+// arguments of a script function call, read and assigned through ARG items
+struct CallFrame {
+	Value args[FuncDef::MAX_ARGS];
+	const ScriptFunc* pTail; // called once the body returns, its arguments are already in args
+	CallFrame* pPrev;
+	uint32_t depth;
+};
+
+static ScriptTable* script_table_create() {
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(sizeof(ScriptTable), "Pint:ScriptTable");
+	s_memLock.release();
+	if (!pMem) return nullptr;
+	ScriptTable* pTbl = ::new(pMem) ScriptTable();
+	s_memLock.acquire();
+	pTbl->pMap = cxStrMap<int>::create();
+	if (pTbl->pMap) {
+		pTbl->pMap->set_mem_lock(s_memLock.get());
+	}
+	s_memLock.release();
+	for (uint32_t i = 0; i < FuncLibrary::SCRIPT_MAX; ++i) {
+		pTbl->pFuncs[i].store(nullptr, std::memory_order_relaxed);
+	}
+	pTbl->num.store(0, std::memory_order_relaxed);
+	pTbl->pRetired = nullptr;
+	return pTbl;
+}
+
+static int script_param(const CodeList* pParams, const char* pName) {
+	const CodeItem* pItems = pParams->get_items();
+	for (uint32_t i = 0; i < pParams->count(); ++i) {
+		if (nxCore::str_eq(pItems[i].val.sym, pName)) return int(i);
+	}
+	return -1;
+}
+
+// lists under the items, string literal bytes are added to *pStrSize
+static uint32_t script_count(const CodeItem* pItems, const uint32_t n, size_t* pStrSize) {
+	uint32_t nlists = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		if (pItems[i].is_list()) {
+			const CodeList* pLst = pItems[i].val.pLst;
+			nlists += 1 + script_count(pLst->get_items(), pLst->count(), pStrSize);
+		} else if (pItems[i].is_str() && pItems[i].val.pStr) {
+			*pStrSize += nxCore::str_len(pItems[i].val.pStr) + 1;
+		}
+	}
+	return nlists;
+}
+
+static void script_copy(ScriptFunc* pFunc, CodeList* pDst, const CodeItem* pItems, const uint32_t n, const CodeList* pParams, uint32_t* pListIdx, char** ppStrs) {
+	for (uint32_t i = 0; i < n; ++i) {
+		const CodeItem& src = pItems[i];
+		CodeItem item = src;
+		if (src.is_list()) {
+			CodeList* pLst = &pFunc->pLists[(*pListIdx)++];
+			script_copy(pFunc, pLst, src.val.pLst->get_items(), src.val.pLst->count(), pParams, pListIdx, ppStrs);
+			item.set_list(pLst);
+		} else if (src.is_sym()) {
+			int slot = script_param(pParams, src.val.sym);
+			if (slot >= 0) {
+				item.set_arg(uint32_t(slot));
+			} else {
+				item.set_sym(src.val.sym);
+			}
+		} else if (src.is_str() && src.val.pStr) {
+			size_t size = nxCore::str_len(src.val.pStr) + 1;
+			nxCore::mem_copy(*ppStrs, src.val.pStr, size);
+			item.set_str(*ppStrs);
+			*ppStrs += size;
+		}
+		pDst->append(item);
+	}
+}
+
+// the branches of an if in tail position are in tail position
+static void script_mark_tail(CodeList* pLst) {
+	pLst->set_tail(true);
+	const CodeItem* pItems = pLst->get_items();
+	if (pLst->count() > 2 && pItems[0].is_sym() && pItems[0].form == CodeItem::Form::IF) {
+		for (uint32_t i = 2; i < nxCalc::min(pLst->count(), 4U); ++i) {
+			if (pItems[i].is_list()) {
+				script_mark_tail(pItems[i].val.pLst);
+			}
+		}
+	}
+}
+
+// pItems: (defun name (params) forms...)
+static ScriptFunc* script_create(const CodeItem* pItems, const uint32_t cnt) {
+	const CodeList* pParams = pItems[2].val.pLst;
+	size_t strSize = 0;
+	uint32_t listNum = 1 + script_count(pItems + 3, cnt - 3, &strSize);
+	size_t size = sizeof(ScriptFunc) + sizeof(CodeList) * listNum + strSize;
+	s_memLock.acquire();
+	ScriptFunc* pFunc = reinterpret_cast<ScriptFunc*>(nxCore::mem_alloc(size, "Pint:Script"));
+	s_memLock.release();
+	if (!pFunc) return nullptr;
+	nxCore::mem_zero(pFunc, sizeof(ScriptFunc));
+	pFunc->pLists = reinterpret_cast<CodeList*>(pFunc + 1);
+	pFunc->listNum = listNum;
+	for (uint32_t i = 0; i < listNum; ++i) {
+		::new(&pFunc->pLists[i]) CodeList();
+	}
+	char* pStrs = reinterpret_cast<char*>(pFunc->pLists + listNum);
+	uint32_t listIdx = 1;
+	script_copy(pFunc, &pFunc->pLists[0], pItems + 3, cnt - 3, pParams, &listIdx, &pStrs);
+	const CodeItem& last = pFunc->pLists[0].get_items()[cnt - 4];
+	if (last.is_list()) {
+		script_mark_tail(last.val.pLst);
+	}
+	nxCore::mem_copy(pFunc->name, pItems[1].val.sym, nxCore::str_len(pItems[1].val.sym) + 1);
+	pFunc->def.pName = pFunc->name;
+	pFunc->def.nargs = pParams->count();
+	pFunc->def.resultType = Value::Type::NON;
+	pFunc->def.pScript = pFunc;
+	return pFunc;
+}
+
+static void script_destroy(ScriptFunc* pFunc) {
+	for (uint32_t i = 0; i < pFunc->listNum; ++i) {
+		pFunc->pLists[i].reset();
+	}
+	s_memLock.acquire();
+	nxCore::mem_free(pFunc);
+	s_memLock.release();
+}
+
+static bool script_items_eq(const CodeItem* pDef, const CodeItem* pSrc, const uint32_t n, const CodeList* pParams) {
+	for (uint32_t i = 0; i < n; ++i) {
+		const CodeItem& a = pDef[i];
+		const CodeItem& b = pSrc[i];
+		bool eq = false;
+		if (a.is_arg()) {
+			eq = b.is_sym() && script_param(pParams, b.val.sym) == int(a.val.inum);
+		} else if (a.type == b.type) {
+			switch (a.type) {
+				case CodeItem::Type::LST:
+					eq = a.val.pLst->count() == b.val.pLst->count() && script_items_eq(a.val.pLst->get_items(), b.val.pLst->get_items(), a.val.pLst->count(), pParams);
+					break;
+				case CodeItem::Type::SYM:
+					eq = nxCore::str_eq(a.val.sym, b.val.sym) && script_param(pParams, b.val.sym) < 0;
+					break;
+				case CodeItem::Type::STR:
+					eq = a.val.pStr && b.val.pStr ? nxCore::str_eq(a.val.pStr, b.val.pStr) : a.val.pStr == b.val.pStr;
+					break;
+				case CodeItem::Type::NUM:
+					eq = a.val.num == b.val.num;
+					break;
+				case CodeItem::Type::INT:
+					eq = a.val.inum == b.val.inum;
+					break;
+				default:
+					eq = true;
+					break;
+			}
+		}
+		if (!eq) return false;
+	}
+	return true;
+}
+
+// the definition is the same as the parsed defun, up to the names of the parameters
+static bool script_eq(const ScriptFunc* pFunc, const CodeItem* pItems, const uint32_t cnt) {
+	const CodeList* pParams = pItems[2].val.pLst;
+	if (pFunc->def.nargs != pParams->count() || pFunc->pLists[0].count() != cnt - 3) return false;
+	return script_items_eq(pFunc->pLists[0].get_items(), pItems + 3, cnt - 3, pParams);
+}
+
+FuncLibrary::FuncLibrary()
+	:
+	mpFuncMap(nullptr),
+	mpFuncs(nullptr),
+	mFuncNum(0),
+	mFuncCap(0),
+	mpSlots(nullptr),
+	mpSeeds(nullptr),
+	mSlotMask(0),
+	mBucketMask(0),
+	mpMemo(nullptr),
+	mpScripts(nullptr)
+{}
+
+FuncLibrary::~FuncLibrary() {
+	reset();
+}
+
+void FuncLibrary::init() {
+	if (mpFuncMap == nullptr) {
+		mpFuncMap = FuncMap::create();
+		register_func(s_defFuncDesc, XD_ARY_LEN(s_defFuncDesc));
+	}
+	if (mpScripts == nullptr) {
+		// defun may run on any thread, the table has to be there before the library is shared
+		mpScripts = script_table_create();
+	}
+}
+
+void FuncLibrary::reset() {
+	set_memo(0);
+	if (mpFuncMap) {
+		FuncMap::destroy(mpFuncMap);
+		mpFuncMap = nullptr;
+	}
+	s_memLock.acquire();
+	if (mpFuncs) {
+		nxCore::mem_free(mpFuncs);
+	}
+	if (mpSlots) {
+		nxCore::mem_free(mpSlots);
+	}
+	if (mpSeeds) {
+		nxCore::mem_free(mpSeeds);
+	}
+	s_memLock.release();
+	mpFuncs = nullptr;
+	mpSlots = nullptr;
+	mpSeeds = nullptr;
+	mFuncNum = 0;
+	mFuncCap = 0;
+	mSlotMask = 0;
+	mBucketMask = 0;
+	if (mpScripts) {
+		for (uint32_t i = 0; i < SCRIPT_MAX; ++i) {
+			ScriptFunc* pFunc = mpScripts->pFuncs[i].load(std::memory_order_relaxed);
+			if (pFunc) {
+				script_destroy(pFunc);
+			}
+		}
+		while (ScriptFunc* pFunc = mpScripts->pRetired) {
+			mpScripts->pRetired = pFunc->pNext;
+			script_destroy(pFunc);
+		}
+		s_memLock.acquire();
+		cxStrMap<int>::destroy(mpScripts->pMap);
+		s_memLock.release();
+		mpScripts->~ScriptTable();
+		s_memLock.acquire();
+		nxCore::mem_free(mpScripts);
+		s_memLock.release();
+		mpScripts = nullptr;
+	}
+}
+
+bool FuncLibrary::register_func(const FuncDef* pFuncDef, const uint32_t nfunc) {
+	bool res = false;
+	if (pFuncDef) {
+		if (mpFuncMap == nullptr) {
+			mpFuncMap = FuncMap::create();
+		}
+		for (uint32_t i = 0; i < nfunc; ++i) {
+			res = register_func(pFuncDef[i]);
+			if (!res) {
+				PINT_DBG_MSG(FMT_BOLD FMT_RED "ERROR: " FMT_OFF " cannot register function %s", pFuncDef[i].pName);
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+// a name registered again replaces the previous definition in place
+bool FuncLibrary::register_func(const FuncDef& def) {
+	if (is_frozen() || !def.pName) return false;
+	if (mpFuncMap == nullptr) {
+		mpFuncMap = FuncMap::create();
+	}
+	int idx = -1;
+	if (!mpFuncMap->get(def.pName, &idx)) {
+		if (mFuncNum >= mFuncCap) {
+			uint32_t cap = nxCalc::max(mFuncCap * 2, 32U);
+			s_memLock.acquire();
+			FuncDef* pFuncs = reinterpret_cast<FuncDef*>(nxCore::mem_alloc(sizeof(FuncDef) * cap, "Pint:Funcs"));
+			if (pFuncs && mpFuncs) {
+				nxCore::mem_copy(pFuncs, mpFuncs, sizeof(FuncDef) * mFuncNum);
+				nxCore::mem_free(mpFuncs);
+			}
+			s_memLock.release();
+			if (!pFuncs) return false;
+			mpFuncs = pFuncs;
+			mFuncCap = cap;
+		}
+		idx = int(mFuncNum);
+		const char* pKey = mpFuncMap->put(def.pName, idx);
+		if (!pKey) return false;
+		++mFuncNum;
+	}
+	mpFuncs[idx] = def;
+	return true;
+}
+
+bool FuncLibrary::find(const char* pName, FuncDef* pDef) {
+	const FuncDef* pFunc = find_func(pName);
+	if (pFunc && pDef) {
+		*pDef = *pFunc;
+	}
+	return pFunc != nullptr;
+}
+
+static inline uint32_t func_slot_hash(const uint32_t h, const uint32_t seed) {
+	uint32_t x = h ^ (seed * 0x9E3779B9U);
+	x ^= x >> 16;
+	x *= 0x85EBCA6BU;
+	x ^= x >> 13;
+	x *= 0xC2B2AE35U;
+	x ^= x >> 16;
+	return x;
+}
+
+// hash and displace: names are grouped into buckets by their hash, each bucket gets a seed
+// that sends all of its names to free slots; the largest buckets are placed first
+bool FuncLibrary::build_slots(const uint32_t nslots, const uint32_t nbuckets) {
+	static const uint32_t SEED_TRIES = 1U << 14;
+	mSlotMask = nslots - 1;
+	mBucketMask = nbuckets - 1;
+	uint32_t* pHashes = mpSeeds + nbuckets;
+	uint32_t* pSizes = pHashes + mFuncNum;
+	nxCore::mem_zero(pSizes, sizeof(uint32_t) * nbuckets);
+	for (uint32_t i = 0; i < nslots; ++i) {
+		mpSlots[i] = -1;
+	}
+	uint32_t maxSize = 0;
+	for (uint32_t i = 0; i < mFuncNum; ++i) {
+		pHashes[i] = nxCore::str_hash32(mpFuncs[i].pName);
+		uint32_t size = ++pSizes[pHashes[i] & mBucketMask];
+		maxSize = nxCalc::max(maxSize, size);
+	}
+	for (uint32_t size = maxSize; size > 0; --size) {
+		for (uint32_t b = 0; b < nbuckets; ++b) {
+			if (pSizes[b] != size) continue;
+			bool placed = false;
+			for (uint32_t seed = 0; seed < SEED_TRIES && !placed; ++seed) {
+				placed = true;
+				for (uint32_t i = 0; i < mFuncNum && placed; ++i) {
+					if ((pHashes[i] & mBucketMask) != b) continue;
+					uint32_t slot = func_slot_hash(pHashes[i], seed) & mSlotMask;
+					if (mpSlots[slot] < 0) {
+						mpSlots[slot] = int32_t(i);
+					} else {
+						placed = false;
+					}
+				}
+				if (!placed) {
+					// undo this bucket's partial placement
+					for (uint32_t i = 0; i < nslots; ++i) {
+						if (mpSlots[i] >= 0 && (pHashes[mpSlots[i]] & mBucketMask) == b) {
+							mpSlots[i] = -1;
+						}
+					}
+				} else {
+					mpSeeds[b] = seed;
+				}
+			}
+			if (!placed) return false;
+		}
+	}
+	return true;
+}
+
+bool FuncLibrary::freeze() {
+	if (is_frozen()) return true;
+	uint32_t nbuckets = 1;
+	while (nbuckets < mFuncNum) {
+		nbuckets <<= 1;
+	}
+	for (uint32_t nslots = nbuckets * 2; nslots <= nbuckets * 16; nslots <<= 1) {
+		s_memLock.acquire();
+		mpSlots = reinterpret_cast<int32_t*>(nxCore::mem_alloc(sizeof(int32_t) * nslots, "Pint:FuncSlots"));
+		// seeds, followed by the name hashes and bucket sizes used while building
+		mpSeeds = reinterpret_cast<uint32_t*>(nxCore::mem_alloc(sizeof(uint32_t) * (nbuckets * 2 + mFuncNum), "Pint:FuncSeeds"));
+		s_memLock.release();
+		if (mpSlots && mpSeeds && build_slots(nslots, nbuckets)) {
+			return true;
+		}
+		s_memLock.acquire();
+		if (mpSlots) {
+			nxCore::mem_free(mpSlots);
+		}
+		if (mpSeeds) {
+			nxCore::mem_free(mpSeeds);
+		}
+		s_memLock.release();
+		mpSlots = nullptr;
+		mpSeeds = nullptr;
+	}
+	PINT_DBG_MSG(FMT_BOLD FMT_RED "ERROR: " FMT_OFF " cannot freeze the function library\n");
+	return false;
+}
+
+bool FuncLibrary::is_frozen() const {
+	return mpSlots != nullptr;
+}
+
+int FuncLibrary::find_index(const char* pName) const {
+	int idx = -1;
+	if (!pName) return idx;
+	if (is_frozen()) {
+		uint32_t h = nxCore::str_hash32(pName);
+		int32_t slot = mpSlots[func_slot_hash(h, mpSeeds[h & mBucketMask]) & mSlotMask];
+		if (slot >= 0 && nxCore::str_eq(mpFuncs[slot].pName, pName)) {
+			idx = slot;
+		}
+	} else if (mpFuncMap) {
+		mpFuncMap->get(pName, &idx);
+	}
+	return idx;
+}
+
+const FuncDef* FuncLibrary::find_func(const char* pName) const {
+	return get_func(find_index(pName));
+}
+
+const FuncDef* FuncLibrary::get_func(const int idx) const {
+	if (idx >= SCRIPT_BASE) {
+		uint32_t slot = uint32_t(idx - SCRIPT_BASE);
+		const ScriptFunc* pFunc = mpScripts && slot < SCRIPT_MAX ? mpScripts->pFuncs[slot].load(std::memory_order_acquire) : nullptr;
+		return pFunc ? &pFunc->def : nullptr;
+	}
+	return (idx >= 0 && uint32_t(idx) < mFuncNum) ? &mpFuncs[idx] : nullptr;
+}
+
+int FuncLibrary::define_script(ScriptFunc* pFunc) {
+	if (!pFunc || !mpScripts || !mpScripts->pMap || find_index(pFunc->def.pName) >= 0) return -1;
+	std::unique_lock<std::mutex> lk(mpScripts->mtx);
+	int slot = -1;
+	if (mpScripts->pMap->get(pFunc->def.pName, &slot)) {
+		// calls in progress keep running the old body
+		ScriptFunc* pOld = mpScripts->pFuncs[slot].exchange(pFunc, std::memory_order_acq_rel);
+		pOld->pNext = mpScripts->pRetired;
+		mpScripts->pRetired = pOld;
+	} else {
+		uint32_t num = mpScripts->num.load(std::memory_order_relaxed);
+		if (num >= SCRIPT_MAX || !mpScripts->pMap->put(pFunc->def.pName, int(num))) return -1;
+		slot = int(num);
+		mpScripts->pFuncs[slot].store(pFunc, std::memory_order_release);
+		mpScripts->num.store(num + 1, std::memory_order_release);
+	}
+	return SCRIPT_BASE + slot;
+}
+
+int FuncLibrary::find_script(const char* pName) const {
+	if (!pName || get_script_count() == 0) return -1;
+	std::unique_lock<std::mutex> lk(mpScripts->mtx);
+	int slot = -1;
+	return mpScripts->pMap->get(pName, &slot) ? SCRIPT_BASE + slot : -1;
+}
+
+uint32_t FuncLibrary::get_script_count() const {
+	return mpScripts ? mpScripts->num.load(std::memory_order_acquire) : 0;
+}
+
+uint32_t FuncLibrary::get_func_count() const {
+	return mFuncNum;
+}
+
+bool FuncLibrary::check_func_args(const FuncDef& def, const uint32_t nargs, const Value* pArgs) {
+	bool res = true;
+	if (!def.typed && nargs >= def.nargs) {
+		for (uint32_t i = 0; i < def.nargs; ++i) {
+			Value::Type type = pArgs[i].get_type();
+			if (type == Value::Type::INT) {
+				type = Value::Type::NUM; // NUM arguments take either kind of number
+			}
+			if (type != def.argTypes[i]) {
+				res = false;
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+struct FuncMemoEntry {
+	std::atomic<uint32_t> lock; // readers and writers skip a busy entry instead of waiting
+	int32_t func;               // -1: empty
+	uint32_t nargs;
+	Value res;
+	uint64_t args[FuncDef::MAX_ARGS];
+};
+
+struct FuncMemo {
+	FuncMemoEntry* pEntries;
+	uint32_t mask;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> evictions;
+};
+
+bool FuncLibrary::set_memo(const uint32_t capacity) {
+	if (mpMemo) {
+		s_memLock.acquire();
+		nxCore::mem_free(mpMemo);
+		s_memLock.release();
+		mpMemo = nullptr;
+	}
+	if (capacity == 0) return true;
+	uint32_t num = 1;
+	while (num < capacity && num < (1U << 24)) {
+		num <<= 1;
+	}
+	size_t memoSize = XD_ALIGN(sizeof(FuncMemo), 64);
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(memoSize + sizeof(FuncMemoEntry) * num, "Pint:FuncMemo");
+	s_memLock.release();
+	if (!pMem) return false;
+	mpMemo = reinterpret_cast<FuncMemo*>(pMem);
+	mpMemo->pEntries = reinterpret_cast<FuncMemoEntry*>(reinterpret_cast<uint8_t*>(pMem) + memoSize);
+	mpMemo->mask = num - 1;
+	clear_memo();
+	return true;
+}
+
+void FuncLibrary::clear_memo() {
+	if (!mpMemo) return;
+	for (uint32_t i = 0; i <= mpMemo->mask; ++i) {
+		FuncMemoEntry* pEnt = &mpMemo->pEntries[i];
+		pEnt->lock = 0;
+		pEnt->func = -1;
+		pEnt->nargs = 0;
+	}
+	mpMemo->hits = 0;
+	mpMemo->misses = 0;
+	mpMemo->evictions = 0;
+}
+
+FuncLibrary::MemoStats FuncLibrary::get_memo_stats() const {
+	MemoStats stats;
+	stats.hits = mpMemo ? mpMemo->hits.load(std::memory_order_relaxed) : 0;
+	stats.misses = mpMemo ? mpMemo->misses.load(std::memory_order_relaxed) : 0;
+	stats.evictions = mpMemo ? mpMemo->evictions.load(std::memory_order_relaxed) : 0;
+	return stats;
+}
+
+Value FuncLibrary::invoke(const FuncDef& def, ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	FuncMemo* pMemo = def.pure ? mpMemo : nullptr;
+	int32_t func = pMemo ? int32_t(&def - mpFuncs) : -1;
+	uint32_t n = nxCalc::min(nargs, FuncDef::MAX_ARGS);
+	if (func < 0 || uint32_t(func) >= mFuncNum) {
+		pMemo = nullptr;
+	}
+	uint64_t key[FuncDef::MAX_ARGS];
+	uint64_t h = uint64_t(func) * 0x9E3779B97F4A7C15ULL ^ n;
+	for (uint32_t i = 0; pMemo && i < n; ++i) {
+		if (!pArgs[i].is_num()) {
+			pMemo = nullptr;
+			break;
+		}
+		key[i] = pArgs[i].bits;
+		h = (h ^ key[i]) * 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 32;
+	}
+	if (!pMemo) {
+		return (*def.func)(ctx, nargs, pArgs);
+	}
+
+	FuncMemoEntry* pEnt = &pMemo->pEntries[h & pMemo->mask];
+	Value res;
+	uint32_t unlocked = 0;
+	if (pEnt->lock.compare_exchange_strong(unlocked, 1, std::memory_order_acquire)) {
+		bool hit = pEnt->func == func && pEnt->nargs == n && nxCore::mem_eq(pEnt->args, key, sizeof(uint64_t) * n);
+		if (hit) {
+			res = pEnt->res;
+		}
+		pEnt->lock.store(0, std::memory_order_release);
+		if (hit) {
+			pMemo->hits.fetch_add(1, std::memory_order_relaxed);
+			return res;
+		}
+	}
+	pMemo->misses.fetch_add(1, std::memory_order_relaxed);
+	res = (*def.func)(ctx, nargs, pArgs);
+	// strings and lists live in the calling context
+	if (ctx.get_error() == EvalError::NONE && !res.is_str() && !res.is_list()) {
+		unlocked = 0;
+		if (pEnt->lock.compare_exchange_strong(unlocked, 1, std::memory_order_acquire)) {
+			if (pEnt->func >= 0) {
+				pMemo->evictions.fetch_add(1, std::memory_order_relaxed);
+			}
+			pEnt->func = func;
+			pEnt->nargs = n;
+			pEnt->res = res;
+			nxCore::mem_copy(pEnt->args, key, sizeof(uint64_t) * n);
+			pEnt->lock.store(0, std::memory_order_release);
+		}
+	}
+	return res;
+}
+
+FuncLibrary* FuncLibrary::create_default() {
+	void* pMem = nxCore::tMem<FuncLibrary>::alloc();
+	FuncLibrary* pFuncMapper = pMem ? ::new(pMem) FuncLibrary() : nullptr;
+	if (!pFuncMapper) return nullptr;
+	pFuncMapper->init();
+	return pFuncMapper;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct VarPage {
+	std::atomic<int32_t> nref;
+	Value vals[ExecContext::VAR_PAGE_SIZE];
+};
+
+struct VarDomain {
+	cxStrMap<int>* pMap;
+	const char* pName;
+	uint32_t count;
+	uint8_t slots[ExecContext::CODE_VAR_MAX]; // slot -> variable id
+};
+
+struct VarTable {
+	std::atomic<int32_t> nref;
+	cxStrMap<int>* pDomMap;
+	cxStrStore* pNames;
+	const char* names[ExecContext::CODE_VAR_MAX];
+	uint8_t doms[ExecContext::CODE_VAR_MAX];
+	VarDomain domains[ExecContext::DOMAIN_MAX];
+	uint32_t count;
+	uint32_t domNum;
+};
+
+struct StrChain {
+	std::atomic<int32_t> nref;
+	StrHeap* pStrs;
+	ListBlock* pLists;
+	StrChain* pNext;
+};
+
+// Interned strings: one entry per distinct string, found by hash through an open-addressed
+// table. Entries are allocated one by one, so the ones no value refers to can be freed.
+struct StrEntry {
+	const StrHeap* pHeap; // strings interned in one heap are equal only if they're one entry
+	uint32_t hash;
+	uint32_t mark;        // collection that found it reachable
+	char chars[1];
+};
+
+struct StrHeap {
+	StrEntry** ppSlots; // nullptr: empty
+	uint32_t slotNum;   // power of 2
+	uint32_t count;
+	uint32_t kept;      // entries left by the last collection
+	uint32_t mark;
+};
+
+// Bump arena for list values, blocks are only freed all at once.
+struct ListBlock {
+	ListBlock* pNext;
+	size_t size; // bytes after the header
+	size_t used;
+};
+
+static const size_t LIST_BLOCK_SIZE = 16 * 1024;
+
+template<typename T> static T* shared_alloc(const char* pTag) {
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(sizeof(T), pTag);
+	s_memLock.release();
+	T* pObj = pMem ? ::new(pMem) T() : nullptr;
+	if (pObj) {
+		pObj->nref = 1;
+	}
+	return pObj;
+}
+
+template<typename T> static void shared_free(T* pObj) {
+	pObj->~T();
+	s_memLock.acquire();
+	nxCore::mem_free(pObj);
+	s_memLock.release();
+}
+
+template<typename T> static T* shared_acquire(T* pObj) {
+	if (pObj) {
+		++pObj->nref;
+	}
+	return pObj;
+}
+
+static void page_release(VarPage* pPage) {
+	if (pPage && --pPage->nref == 0) {
+		shared_free(pPage);
+	}
+}
+
+static const char* table_store(VarTable* pTbl, const char* pName) {
+	if (pTbl->pNames == nullptr) {
+		pTbl->pNames = cxStrStore::create("PintVarNames", s_memLock.get());
+	}
+	return pTbl->pNames ? pTbl->pNames->add(pName) : nullptr;
+}
+
+static int table_add_domain(VarTable* pTbl, const char* pName) {
+	if (pTbl->domNum >= ExecContext::DOMAIN_MAX) return -1;
+	int dom = int(pTbl->domNum);
+	VarDomain& domain = pTbl->domains[dom];
+	domain.pName = dom == ExecContext::ROOT_DOMAIN ? "" : table_store(pTbl, pName);
+	if (!domain.pName) return -1;
+	if (dom != ExecContext::ROOT_DOMAIN && !pTbl->pDomMap->add(domain.pName, dom)) return -1;
+	s_memLock.acquire();
+	domain.pMap = cxStrMap<int>::create();
+	domain.pMap->set_mem_lock(s_memLock.get());
+	s_memLock.release();
+	domain.count = 0;
+	++pTbl->domNum;
+	return dom;
+}
+
+static VarTable* table_create() {
+	VarTable* pTbl = shared_alloc<VarTable>("Pint:VarTable");
+	if (pTbl) {
+		s_memLock.acquire();
+		pTbl->pDomMap = cxStrMap<int>::create();
+		pTbl->pDomMap->set_mem_lock(s_memLock.get());
+		s_memLock.release();
+		pTbl->pNames = nullptr;
+		pTbl->count = 0;
+		pTbl->domNum = 0;
+		table_add_domain(pTbl, "");
+	}
+	return pTbl;
+}
+
+static const char* table_add(VarTable* pTbl, const int dom, const char* pName) {
+	if (pTbl->count >= ExecContext::CODE_VAR_MAX) return nullptr;
+	VarDomain& domain = pTbl->domains[dom];
+	const char* pStored = table_store(pTbl, pName);
+	if (pStored) {
+		pStored = domain.pMap->add(pStored, int(pTbl->count));
+	}
+	if (pStored) {
+		domain.slots[domain.count++] = uint8_t(pTbl->count);
+		pTbl->doms[pTbl->count] = uint8_t(dom);
+		pTbl->names[pTbl->count++] = pStored;
+	}
+	return pStored;
+}
+
+static void table_release(VarTable* pTbl) {
+	if (pTbl && --pTbl->nref == 0) {
+		if (pTbl->pNames) {
+			cxStrStore::destroy(pTbl->pNames);
+		}
+		s_memLock.acquire();
+		for (uint32_t i = 0; i < pTbl->domNum; ++i) {
+			cxStrMap<int>::destroy(pTbl->domains[i].pMap);
+		}
+		cxStrMap<int>::destroy(pTbl->pDomMap);
+		s_memLock.release();
+		shared_free(pTbl);
+	}
+}
+
+static ListHead* arena_list(ListBlock** ppArena, const uint32_t count) {
+	size_t size = sizeof(ListHead) + sizeof(Value) * count;
+	ListBlock* pBlk = *ppArena;
+	if (!pBlk || pBlk->used + size > pBlk->size) {
+		size_t blkSize = nxCalc::max(size, LIST_BLOCK_SIZE);
+		s_memLock.acquire();
+		void* pMem = nxCore::mem_alloc(sizeof(ListBlock) + blkSize, "Pint:ListBlock");
+		s_memLock.release();
+		if (!pMem) return nullptr;
+		pBlk = reinterpret_cast<ListBlock*>(pMem);
+		pBlk->size = blkSize;
+		pBlk->used = 0;
+		if (*ppArena && size > LIST_BLOCK_SIZE) {
+			// a big list gets a block of its own, the current block stays open
+			pBlk->pNext = (*ppArena)->pNext;
+			(*ppArena)->pNext = pBlk;
+		} else {
+			pBlk->pNext = *ppArena;
+			*ppArena = pBlk;
+		}
+	}
+	ListHead* pLst = reinterpret_cast<ListHead*>(XD_INCR_PTR(pBlk + 1, pBlk->used));
+	pBlk->used += size;
+	pLst->count = count;
+	pLst->numeric = 0;
+	Value* pItems = pLst->items();
+	for (uint32_t i = 0; i < count; ++i) {
+		pItems[i].set_none();
+	}
+	return pLst;
+}
+
+static void arena_free(ListBlock* pBlk) {
+	while (pBlk) {
+		ListBlock* pNext = pBlk->pNext;
+		s_memLock.acquire();
+		nxCore::mem_free(pBlk);
+		s_memLock.release();
+		pBlk = pNext;
+	}
+}
+
+static StrEntry* str_entry(const char* pChars) {
+	return reinterpret_cast<StrEntry*>(const_cast<char*>(pChars) - offsetof(StrEntry, chars));
+}
+
+static Value str_value(const char* pChars) {
+	Value val;
+	val.bits = Value::TAG_ISTR | uint64_t(uintptr_t(pChars));
+	return val;
+}
+
+static StrHeap* heap_create() {
+	s_memLock.acquire();
+	StrHeap* pHeap = reinterpret_cast<StrHeap*>(nxCore::mem_alloc(sizeof(StrHeap), "Pint:StrHeap"));
+	s_memLock.release();
+	if (pHeap) {
+		nxCore::mem_zero(pHeap, sizeof(StrHeap));
+	}
+	return pHeap;
+}
+
+static void heap_purge(StrHeap* pHeap) {
+	if (!pHeap || pHeap->count == 0) return;
+	s_memLock.acquire();
+	for (uint32_t i = 0; i < pHeap->slotNum; ++i) {
+		if (pHeap->ppSlots[i]) {
+			nxCore::mem_free(pHeap->ppSlots[i]);
+			pHeap->ppSlots[i] = nullptr;
+		}
+	}
+	s_memLock.release();
+	pHeap->count = 0;
+	pHeap->kept = 0;
+}
+
+static void heap_destroy(StrHeap* pHeap) {
+	if (!pHeap) return;
+	heap_purge(pHeap);
+	s_memLock.acquire();
+	if (pHeap->ppSlots) {
+		nxCore::mem_free(pHeap->ppSlots);
+	}
+	nxCore::mem_free(pHeap);
+	s_memLock.release();
+}
+
+static const char* heap_find(const StrHeap* pHeap, const char* pStr, const uint32_t hash) {
+	if (!pHeap || pHeap->count == 0) return nullptr;
+	uint32_t mask = pHeap->slotNum - 1;
+	for (uint32_t slot = hash & mask; pHeap->ppSlots[slot]; slot = (slot + 1) & mask) {
+		const StrEntry* pEnt = pHeap->ppSlots[slot];
+		if (pEnt->hash == hash && nxCore::str_eq(pEnt->chars, pStr)) return pEnt->chars;
+	}
+	return nullptr;
+}
+
+static void heap_insert(StrEntry** ppSlots, const uint32_t slotNum, StrEntry* pEnt) {
+	uint32_t mask = slotNum - 1;
+	uint32_t slot = pEnt->hash & mask;
+	while (ppSlots[slot]) {
+		slot = (slot + 1) & mask;
+	}
+	ppSlots[slot] = pEnt;
+}
+
+// the table keeps the entries with keepMark (all of them if keepMark is 0), the others are freed
+static bool heap_rebuild(StrHeap* pHeap, const uint32_t slotNum, const uint32_t keepMark) {
+	size_t size = sizeof(StrEntry*) * slotNum;
+	s_memLock.acquire();
+	StrEntry** ppSlots = reinterpret_cast<StrEntry**>(nxCore::mem_alloc(size, "Pint:StrHeapSlots"));
+	s_memLock.release();
+	if (!ppSlots) return false;
+	nxCore::mem_zero(ppSlots, size);
+	uint32_t count = 0;
+	s_memLock.acquire();
+	for (uint32_t i = 0; i < pHeap->slotNum; ++i) {
+		StrEntry* pEnt = pHeap->ppSlots[i];
+		if (!pEnt) continue;
+		if (keepMark == 0 || pEnt->mark == keepMark) {
+			heap_insert(ppSlots, slotNum, pEnt);
+			++count;
+		} else {
+			nxCore::mem_free(pEnt);
+		}
+	}
+	if (pHeap->ppSlots) {
+		nxCore::mem_free(pHeap->ppSlots);
+	}
+	s_memLock.release();
+	pHeap->ppSlots = ppSlots;
+	pHeap->slotNum = slotNum;
+	pHeap->count = count;
+	return true;
+}
+
+static const char* heap_add(StrHeap* pHeap, const char* pStr, const uint32_t hash) {
+	const char* pFound = heap_find(pHeap, pStr, hash);
+	if (pFound) return pFound;
+	if ((pHeap->count + 1) * 4 > pHeap->slotNum * 3) {
+		if (!heap_rebuild(pHeap, nxCalc::max(pHeap->slotNum * 2, 64U), 0)) return nullptr;
+	}
+	size_t len = nxCore::str_len(pStr);
+	s_memLock.acquire();
+	StrEntry* pEnt = reinterpret_cast<StrEntry*>(nxCore::mem_alloc(offsetof(StrEntry, chars) + len + 1, "Pint:Str"));
+	s_memLock.release();
+	if (!pEnt) return nullptr;
+	pEnt->pHeap = pHeap;
+	pEnt->hash = hash;
+	pEnt->mark = pHeap->mark;
+	nxCore::mem_copy(pEnt->chars, pStr, len + 1);
+	heap_insert(pHeap->ppSlots, pHeap->slotNum, pEnt);
+	++pHeap->count;
+	return pEnt->chars;
+}
+
+// looks in the frozen stores of pChain before adding to pHeap
+static Value heap_intern(StrHeap* pHeap, const StrChain* pChain, const char* pStr) {
+	Value val;
+	val.set_none();
+	if (!pHeap || !pStr) return val;
+	uint32_t hash = nxCore::str_hash32(pStr);
+	const char* pStored = nullptr;
+	for (; pChain && !pStored; pChain = pChain->pNext) {
+		pStored = heap_find(pChain->pStrs, pStr, hash);
+	}
+	if (!pStored) {
+		pStored = heap_add(pHeap, pStr, hash);
+	}
+	if (pStored) {
+		val = str_value(pStored);
+	}
+	return val;
+}
+
+// Lists reachable through several paths are visited once.
+struct ListMarks {
+	const ListHead** ppSlots;
+	uint32_t slotNum;
+	uint32_t count;
+
+	bool add(const ListHead* pLst) {
+		if ((count + 1) * 2 > slotNum) {
+			uint32_t num = nxCalc::max(slotNum * 2, 64U);
+			size_t size = sizeof(ListHead*) * num;
+			s_memLock.acquire();
+			const ListHead** ppNew = reinterpret_cast<const ListHead**>(nxCore::mem_alloc(size, "Pint:ListMarks"));
+			s_memLock.release();
+			if (!ppNew) return false;
+			nxCore::mem_zero(ppNew, size);
+			for (uint32_t i = 0; i < slotNum; ++i) {
+				if (ppSlots[i]) {
+					insert(ppNew, num, ppSlots[i]);
+				}
+			}
+			release();
+			ppSlots = ppNew;
+			slotNum = num;
+		}
+		if (!insert(ppSlots, slotNum, pLst)) return false;
+		++count;
+		return true;
+	}
+
+	static bool insert(const ListHead** ppSlots, const uint32_t slotNum, const ListHead* pLst) {
+		uint32_t mask = slotNum - 1;
+		uint32_t slot = uint32_t((uintptr_t(pLst) >> 4) * 0x9E3779B1U) & mask;
+		while (ppSlots[slot]) {
+			if (ppSlots[slot] == pLst) return false;
+			slot = (slot + 1) & mask;
+		}
+		ppSlots[slot] = pLst;
+		return true;
+	}
+
+	void release() {
+		if (ppSlots) {
+			s_memLock.acquire();
+			nxCore::mem_free(ppSlots);
+			s_memLock.release();
+		}
+	}
+};
+
+// only the entries of pHeap are marked, the frozen stores are shared with other threads
+static void heap_mark(StrHeap* pHeap, const Value& val, ListMarks* pMarks) {
+	if (val.is_interned()) {
+		StrEntry* pEnt = str_entry(val.get_str());
+		if (pEnt->pHeap == pHeap) {
+			pEnt->mark = pHeap->mark;
+		}
+	} else if (val.is_list() && val.get_list() && !val.get_list()->numeric && pMarks->add(val.get_list())) {
+		const ListHead* pLst = val.get_list();
+		for (uint32_t i = 0; i < pLst->count; ++i) {
+			heap_mark(pHeap, pLst->items()[i], pMarks);
+		}
+	}
+}
+
+// val with its strings and list items copied into the given stores
+static Value store_value(const Value& val, StrHeap* pStrs, const StrChain* pChain, ListBlock** ppLists) {
+	Value res = val;
+	if (val.is_str()) {
+		res = heap_intern(pStrs, pChain, val.get_str());
+	} else if (val.is_list()) {
+		const ListHead* pSrc = val.get_list();
+		ListHead* pLst = arena_list(ppLists, pSrc->count);
+		if (pLst) {
+			if (pSrc->numeric) {
+				nxCore::mem_copy(pLst->items(), pSrc->items(), sizeof(Value) * pSrc->count);
+			} else {
+				for (uint32_t i = 0; i < pSrc->count; ++i) {
+					pLst->items()[i] = store_value(pSrc->items()[i], pStrs, pChain, ppLists);
+				}
+			}
+			pLst->seal();
+			res.set_list(pLst);
+		} else {
+			res.set_none();
+		}
+	}
+	return res;
+}
+
+static void chain_release(StrChain* pChain) {
+	while (pChain && --pChain->nref == 0) {
+		StrChain* pNext = pChain->pNext;
+		heap_destroy(pChain->pStrs);
+		arena_free(pChain->pLists);
+		shared_free(pChain);
+		pChain = pNext;
+	}
+}
+
+struct GlobalVersion {
+	static const size_t HASH_SIZE = GlobalStore::VAR_MAX * 2;
+
+	std::atomic<int32_t> nref;
+	GlobalVersion* pNextRetired;
+	uint64_t serial;
+	uint32_t count;
+	const char* names[GlobalStore::VAR_MAX];
+	Value vals[GlobalStore::VAR_MAX];
+	int16_t slots[HASH_SIZE]; // open addressing by name hash, -1: empty
+};
+
+struct GlobalState {
+	std::atomic<GlobalVersion*> pCur;
+	std::atomic<int32_t> pinning; // readers between loading pCur and taking a reference
+	GlobalVersion* pRetired;
+	sxLock* pLock;
+	StrHeap* pStrs;
+	ListBlock* pLists;
+	const char* pDomName;
+};
+
+struct GlobalStage {
+	Value vals[GlobalStore::VAR_MAX];
+	uint64_t mask[GlobalStore::VAR_MAX / 64];
+};
+
+static GlobalVersion* global_version_copy(const GlobalVersion* pSrc) {
+	GlobalVersion* pVer = shared_alloc<GlobalVersion>("Pint:GlobalVersion");
+	if (pVer) {
+		pVer->pNextRetired = nullptr;
+		if (pSrc) {
+			pVer->serial = pSrc->serial + 1;
+			pVer->count = pSrc->count;
+			nxCore::mem_copy(pVer->names, pSrc->names, sizeof(pVer->names));
+			nxCore::mem_copy(pVer->vals, pSrc->vals, sizeof(pVer->vals));
+			nxCore::mem_copy(pVer->slots, pSrc->slots, sizeof(pVer->slots));
+		} else {
+			pVer->serial = 0;
+			pVer->count = 0;
+			for (size_t i = 0; i < GlobalVersion::HASH_SIZE; ++i) {
+				pVer->slots[i] = -1;
+			}
+		}
+	}
+	return pVer;
+}
+
+GlobalStore::GlobalStore() : mpState(nullptr) {}
+
+GlobalStore::~GlobalStore() {
+	reset();
+}
+
+void GlobalStore::init(const char* pDomName) {
+	reset();
+	s_memLock.acquire();
+	void* pMem = nxCore::mem_alloc(sizeof(GlobalState), "Pint:GlobalState");
+	s_memLock.release();
+	if (!pMem) return;
+	mpState = ::new(pMem) GlobalState();
+	mpState->pinning = 0;
+	mpState->pRetired = nullptr;
+	mpState->pLock = nxSys::lock_create();
+	mpState->pStrs = heap_create();
+	mpState->pLists = nullptr;
+	mpState->pDomName = heap_intern(mpState->pStrs, nullptr, pDomName ? pDomName : "Global").get_str();
+	mpState->pCur = global_version_copy(nullptr);
+}
+
+void GlobalStore::reset() {
+	if (!mpState) return;
+	GlobalVersion* pVer = mpState->pRetired;
+	while (pVer) {
+		GlobalVersion* pNext = pVer->pNextRetired;
+		shared_free(pVer);
+		pVer = pNext;
+	}
+	if (mpState->pCur.load()) {
+		shared_free(mpState->pCur.load());
+	}
+	heap_destroy(mpState->pStrs);
+	arena_free(mpState->pLists);
+	nxSys::lock_destroy(mpState->pLock);
+	mpState->~GlobalState();
+	s_memLock.acquire();
+	nxCore::mem_free(mpState);
+	s_memLock.release();
+	mpState = nullptr;
+}
+
+const char* GlobalStore::get_domain_name() const {
+	return mpState ? mpState->pDomName : nullptr;
+}
+
+// Called with the writer lock held. A retired version can be freed once it's unpinned
+// and no reader is about to pin: new readers only ever see the versions published later.
+GlobalVersion* GlobalStore::publish(GlobalVersion* pVer) {
+	GlobalVersion* pOld = mpState->pCur.exchange(pVer);
+	pOld->pNextRetired = mpState->pRetired;
+	mpState->pRetired = pOld;
+	--pOld->nref;
+	if (mpState->pinning == 0) {
+		GlobalVersion** ppLink = &mpState->pRetired;
+		while (*ppLink) {
+			GlobalVersion* pRet = *ppLink;
+			if (pRet->nref == 0) {
+				*ppLink = pRet->pNextRetired;
+				shared_free(pRet);
+			} else {
+				ppLink = &pRet->pNextRetired;
+			}
+		}
+	}
+	return pVer;
+}
+
+int GlobalStore::add_var(const char* pName, const Value* pVal) {
+	if (!mpState || !pName) return -1;
+	nxSys::lock_acquire(mpState->pLock);
+	GlobalVersion* pCur = mpState->pCur.load();
+	int idx = find_var(pCur, pName);
+	if (idx < 0 && pCur->count < VAR_MAX) {
+		GlobalVersion* pVer = global_version_copy(pCur);
+		const char* pStored = pVer ? heap_intern(mpState->pStrs, nullptr, pName).get_str() : nullptr;
+		if (pStored) {
+			idx = int(pVer->count++);
+			pVer->names[idx] = pStored;
+			pVer->vals[idx].set_none();
+			uint32_t slot = nxCore::str_hash32(pStored) % GlobalVersion::HASH_SIZE;
+			while (pVer->slots[slot] >= 0) {
+				slot = (slot + 1) % GlobalVersion::HASH_SIZE;
+			}
+			pVer->slots[slot] = int16_t(idx);
+			publish(pVer);
+		} else if (pVer) {
+			shared_free(pVer);
+		}
+	}
+	nxSys::lock_release(mpState->pLock);
+	if (idx >= 0 && pVal) {
+		commit(&idx, pVal, 1);
+	}
+	return idx;
+}
+
+int GlobalStore::find_var(const char* pName) const {
+	GlobalVersion* pVer = pin();
+	int idx = find_var(pVer, pName);
+	unpin(pVer);
+	return idx;
+}
+
+uint32_t GlobalStore::get_var_count() const {
+	GlobalVersion* pVer = pin();
+	uint32_t cnt = pVer ? pVer->count : 0;
+	unpin(pVer);
+	return cnt;
+}
+
+bool GlobalStore::get(int idx, Value* pVal) const {
+	GlobalVersion* pVer = pin();
+	const Value* pSrc = get_val(pVer, idx);
+	if (pSrc && pVal) {
+		*pVal = *pSrc;
+	}
+	unpin(pVer);
+	return pSrc != nullptr;
+}
+
+bool GlobalStore::commit(const int* pIdx, const Value* pVals, const uint32_t n) {
+	if (!mpState || !pIdx || !pVals) return false;
+	nxSys::lock_acquire(mpState->pLock);
+	GlobalVersion* pVer = global_version_copy(mpState->pCur.load());
+	if (pVer) {
+		for (uint32_t i = 0; i < n; ++i) {
+			if (pIdx[i] >= 0 && pIdx[i] < int(pVer->count)) {
+				pVer->vals[pIdx[i]] = store_value(pVals[i], mpState->pStrs, nullptr, &mpState->pLists);
+			}
+		}
+		publish(pVer);
+	}
+	nxSys::lock_release(mpState->pLock);
+	return pVer != nullptr;
+}
+
+GlobalVersion* GlobalStore::pin() const {
+	if (!mpState) return nullptr;
+	++mpState->pinning;
+	GlobalVersion* pVer = mpState->pCur.load();
+	++pVer->nref;
+	--mpState->pinning;
+	return pVer;
+}
+
+void GlobalStore::retain(GlobalVersion* pVer) {
+	if (pVer) {
+		++pVer->nref;
+	}
+}
+
+void GlobalStore::unpin(GlobalVersion* pVer) {
+	if (pVer) {
+		--pVer->nref;
+	}
+}
+
+uint64_t GlobalStore::get_serial(const GlobalVersion* pVer) {
+	return pVer ? pVer->serial : 0;
+}
+
+int GlobalStore::find_var(const GlobalVersion* pVer, const char* pName) {
+	if (!pVer || !pName) return -1;
+	uint32_t slot = nxCore::str_hash32(pName) % GlobalVersion::HASH_SIZE;
+	while (pVer->slots[slot] >= 0) {
+		int idx = pVer->slots[slot];
+		if (nxCore::str_eq(pVer->names[idx], pName)) return idx;
+		slot = (slot + 1) % GlobalVersion::HASH_SIZE;
+	}
+	return -1;
+}
+
+const Value* GlobalStore::get_val(const GlobalVersion* pVer, int idx) {
+	return pVer && idx >= 0 && idx < int(pVer->count) ? &pVer->vals[idx] : nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Four xoroshiro128+ generators stepped side by side: the lanes don't depend on each
+// other, so refill() is element-wise shifts, xors and adds the compiler vectorizes.
+struct RngStream {
+	static const uint32_t LANES = 4;
+	static const uint32_t BUF_SIZE = 64;
+
+	uint64_t s0[LANES];
+	uint64_t s1[LANES];
+	uint64_t buf[BUF_SIZE];
+	uint32_t pos;
+
+	void seed(uint64_t seed);
+	void refill();
+	uint64_t next();
+};
+
+static inline uint64_t rng_splitmix(uint64_t& x) {
+	uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+void RngStream::seed(uint64_t seed) {
+	for (uint32_t i = 0; i < LANES; ++i) {
+		s0[i] = rng_splitmix(seed);
+		s1[i] = rng_splitmix(seed);
+	}
+	pos = BUF_SIZE;
+}
+
+void RngStream::refill() {
+	uint64_t x0[LANES];
+	uint64_t x1[LANES];
+	for (uint32_t i = 0; i < LANES; ++i) {
+		x0[i] = s0[i];
+		x1[i] = s1[i];
+	}
+	for (uint32_t j = 0; j < BUF_SIZE; j += LANES) {
+		for (uint32_t i = 0; i < LANES; ++i) {
+			uint64_t a = x0[i];
+			uint64_t b = x1[i] ^ a;
+			buf[j + i] = a + x1[i];
+			x0[i] = ((a << 24) | (a >> 40)) ^ b ^ (b << 16);
+			x1[i] = (b << 37) | (b >> 27);
+		}
+	}
+	for (uint32_t i = 0; i < LANES; ++i) {
+		s0[i] = x0[i];
+		s1[i] = x1[i];
+	}
+	pos = 0;
+}
+
+uint64_t RngStream::next() {
+	if (pos >= BUF_SIZE) {
+		refill();
+	}
+	return buf[pos++];
+}
+
+static RngStream* rng_alloc() {
+	s_memLock.acquire();
+	RngStream* pRng = reinterpret_cast<RngStream*>(nxCore::mem_alloc(sizeof(RngStream), "Pint:RngStream"));
+	s_memLock.release();
+	return pRng;
+}
+
+static void rng_free(RngStream* pRng) {
+	if (pRng) {
+		s_memLock.acquire();
+		nxCore::mem_free(pRng);
+		s_memLock.release();
+	}
+}
+
+ExecContext::ExecContext() :
+	mpStrs(nullptr),
+	mpLists(nullptr),
+	mpStrChain(nullptr),
+	mpVars(nullptr),
+	mpBinding(nullptr),
+	mScopeGen(0),
+	mpGlobals(nullptr),
+	mpGlbVer(nullptr),
+	mpGlbStage(nullptr),
+	mGlbDom(-1),
+	mpPool(nullptr),
+	mPoolSlot(0),
+	mFuel(0),
+	mDeadline(0.0),
+	mFuelLimit(false),
+	mpRng(nullptr),
+	mErrCode(EvalError::NONE),
+	mBreak(false) {
+	nxCore::mem_zero(mpPages, sizeof(mpPages));
+	nxCore::mem_zero(&mFrame, sizeof(mFrame));
+	reset_domains();
+}
+
+ExecContext::~ExecContext() {
+	reset();
+}
+
+void ExecContext::init(void* pBinding) {
+	mpStrs = nullptr;
+	mpLists = nullptr;
+	mpStrChain = nullptr;
+	mpBinding = pBinding;
+	mErrCode = EvalError::NONE;
+	mBreak = false;
+	nxCore::mem_zero(mpPages, sizeof(mpPages));
+	mpVars = table_create();
+	reset_domains();
+	mpGlobals = nullptr;
+	mpGlbVer = nullptr;
+	mpGlbStage = nullptr;
+	mGlbDom = -1;
+	nxCore::mem_zero(&mFrame, sizeof(mFrame));
+	set_budget(0);
+	mpRng = nullptr;
+	mpPool = nullptr;
+	mPoolSlot = 0;
+}
+
+void ExecContext::release_vars() {
+	for (size_t i = 0; i < VAR_PAGE_NUM; ++i) {
+		page_release(mpPages[i]);
+		mpPages[i] = nullptr;
+	}
+	table_release(mpVars);
+	mpVars = nullptr;
+}
+
+void ExecContext::reset_domains() {
+	mDomStack[0] = uint8_t(ROOT_DOMAIN);
+	mDomDepth = 1;
+	++mScopeGen;
+}
+
+void ExecContext::bind_globals() {
+	mGlbDom = mpGlobals ? add_domain(mpGlobals->get_domain_name()) : -1;
+	++mScopeGen;
+}
+
+void ExecContext::release_globals() {
+	GlobalStore::unpin(mpGlbVer);
+	mpGlbVer = nullptr;
+	if (mpGlbStage) {
+		s_memLock.acquire();
+		nxCore::mem_free(mpGlbStage);
+		s_memLock.release();
+		mpGlbStage = nullptr;
+	}
+}
+
+void ExecContext::reset() {
+	if (mpPool) {
+		mpPool->remove(this);
+	}
+	heap_destroy(mpStrs);
+	mpStrs = nullptr;
+	arena_free(mpLists);
+	mpLists = nullptr;
+	chain_release(mpStrChain);
+	mpStrChain = nullptr;
+	release_vars();
+	reset_domains();
+	release_globals();
+	mpGlobals = nullptr;
+	mGlbDom = -1;
+	nxCore::mem_zero(&mFrame, sizeof(mFrame));
+	set_budget(0);
+	rng_free(mpRng);
+	mpRng = nullptr;
+
+	mErrCode = EvalError::NONE;
+	mBreak = false;
+}
+
+bool ExecContext::own_vars() {
+	if (mpVars && mpVars->nref > 1) {
+		VarTable* pTbl = table_create();
+		if (!pTbl) return false;
+		for (uint32_t i = 1; i < mpVars->domNum; ++i) {
+			table_add_domain(pTbl, mpVars->domains[i].pName);
+		}
+		for (uint32_t i = 0; i < mpVars->count; ++i) {
+			table_add(pTbl, mpVars->doms[i], mpVars->names[i]);
+		}
+		table_release(mpVars);
+		mpVars = pTbl;
+	}
+	return mpVars != nullptr;
+}
+
+const char* ExecContext::add_str(const char* pStr) {
+	return intern(pStr).get_str();
+}
+
+Value ExecContext::intern(const char* pStr) {
+	if (pStr && mpStrs == nullptr) {
+		mpStrs = heap_create();
+	}
+	return heap_intern(mpStrs, mpStrChain, pStr);
+}
+
+void ExecContext::collect_strs(const bool always) {
+	if (!mpStrs || mpStrs->count == 0) return;
+	if (!always && mpStrs->count < nxCalc::max(mpStrs->kept * 2, 256U)) return;
+	if (++mpStrs->mark == 0) {
+		// 0 is reserved for heap_rebuild
+		mpStrs->mark = 1;
+	}
+	ListMarks marks = {};
+	uint32_t varCnt = get_var_count();
+	for (uint32_t i = 0; i < varCnt; ++i) {
+		heap_mark(mpStrs, *get_val(int(i)), &marks);
+	}
+	if (mpGlbStage) {
+		for (uint32_t i = 0; i < GlobalStore::VAR_MAX; ++i) {
+			if (XD_BIT_ARY_CK(uint64_t, mpGlbStage->mask, i)) {
+				heap_mark(mpStrs, mpGlbStage->vals[i], &marks);
+			}
+		}
+	}
+	marks.release();
+	heap_rebuild(mpStrs, mpStrs->slotNum, mpStrs->mark);
+	mpStrs->kept = mpStrs->count;
+}
+
+ListHead* ExecContext::new_list(const uint32_t count) {
+	return arena_list(&mpLists, count);
+}
+
+const ListHead* ExecContext::add_list(const Value* pItems, const uint32_t count) {
+	ListHead* pLst = new_list(count);
+	if (pLst) {
+		if (pItems) {
+			nxCore::mem_copy(pLst->items(), pItems, sizeof(Value) * count);
+		}
+		pLst->seal();
+	}
+	return pLst;
+}
+
+Value ExecContext::copy_value(const Value& val) {
+	if ((val.is_str() || val.is_list()) && mpStrs == nullptr) {
+		mpStrs = heap_create();
+	}
+	return store_value(val, mpStrs, mpStrChain, &mpLists);
+}
+
+int ExecContext::add_domain(const char* pName) {
+	int dom = find_domain(pName);
+	if (dom < 0 && pName && own_vars()) {
+		dom = table_add_domain(mpVars, pName);
+	}
+	return dom;
+}
+
+int ExecContext::find_domain(const char* pName) const {
+	int dom = -1;
+	if (pName && mpVars) {
+		if (pName[0] == 0) {
+			dom = ROOT_DOMAIN;
+		} else {
+			int foundDom = -1;
+			if (mpVars->pDomMap->get(pName, &foundDom)) {
+				dom = foundDom;
+			}
+		}
+	}
+	return dom;
+}
+
+const char* ExecContext::get_domain_name(int dom) const {
+	return (dom >= 0) && (dom < (int)get_domain_count()) ? mpVars->domains[dom].pName : nullptr;
+}
+
+uint32_t ExecContext::get_domain_count() const {
+	return mpVars ? mpVars->domNum : 0;
+}
+
+uint32_t ExecContext::get_domain_var_count(int dom) const {
+	return (dom >= 0) && (dom < (int)get_domain_count()) ? mpVars->domains[dom].count : 0;
+}
+
+int ExecContext::get_domain_var(int dom, uint32_t slot) const {
+	return slot < get_domain_var_count(dom) ? int(mpVars->domains[dom].slots[slot]) : -1;
+}
+
+int ExecContext::get_var_domain(int id) const {
+	if (id >= GLOBAL_ID_BASE) return get_var_name(id) ? mGlbDom : -1;
+	return (id >= 0) && (id < (int)get_var_count()) ? int(mpVars->doms[id]) : -1;
+}
+
+bool ExecContext::set_domain(const char* pName) {
+	int dom = add_domain(pName);
+	if (dom < 0) return false;
+	reset_domains();
+	if (dom != ROOT_DOMAIN) {
+		mDomStack[mDomDepth++] = uint8_t(dom);
+	}
+	return true;
+}
+
+bool ExecContext::push_domain(const char* pName) {
+	if (mDomDepth >= DOMAIN_STACK_MAX) return false;
+	int dom = add_domain(pName);
+	if (dom < 0) return false;
+	mDomStack[mDomDepth++] = uint8_t(dom);
+	++mScopeGen;
+	return true;
+}
+
+bool ExecContext::pop_domain() {
+	if (mDomDepth <= 1) return false;
+	--mDomDepth;
+	++mScopeGen;
+	return true;
+}
+
+int ExecContext::get_domain() const {
+	return int(mDomStack[mDomDepth - 1]);
+}
+
+uint32_t ExecContext::get_scope_depth() const {
+	return mDomDepth;
+}
+
+int ExecContext::get_scope_domain(uint32_t lvl) const {
+	return lvl < mDomDepth ? int(mDomStack[lvl]) : -1;
+}
+
+uint32_t ExecContext::get_scope_gen() const {
+	return mScopeGen;
+}
+
+int ExecContext::add_var(const char* pName) {
+	return add_var(get_domain(), pName);
+}
+
+int ExecContext::add_var(int dom, const char* pName) {
+	int id = find_var(dom, pName);
+	if (mpGlobals && dom == mGlbDom) return id;
+
+	if (id < 0 && pName && dom < (int)get_domain_count() && own_vars()) {
+		if (mpVars->count < CODE_VAR_MAX) {
+			int newId = int(mpVars->count);
+			if (table_add(mpVars, dom, pName)) {
+				Value* pVal = var_val(newId);
+				if (pVal) {
+					id = newId;
+					pVal->set_none();
+				}
+				++mScopeGen;
+			}
+		}
+	}
+
+	return id;
+}
+
+int ExecContext::find_var(const char* pName) const {
+	int id = -1;
+	for (uint32_t i = mDomDepth; i > 0 && id < 0; --i) {
+		id = find_var(int(mDomStack[i - 1]), pName);
+	}
+	return id;
+}
+
+int ExecContext::find_var(int dom, const char* pName) const {
+	int id = -1;
+	if (mpGlobals && dom == mGlbDom) {
+		int idx = GlobalStore::find_var(mpGlbVer, pName);
+		return idx >= 0 ? GLOBAL_ID_BASE + idx : -1;
+	}
+	if (pName && (dom >= 0) && (dom < (int)get_domain_count())) {
+		int foundId = -1;
+		bool found = mpVars->domains[dom].pMap->get(pName, &foundId);
+		if (found) {
+			id = foundId;
+		}
+	}
+	return id;
+}
+
+Value* ExecContext::var_val(int id) {
+	Value* pVal = nullptr;
+	if (id >= GLOBAL_ID_BASE) {
+		// assignments to globals are staged until commit_globals
+		int idx = id - GLOBAL_ID_BASE;
+		const Value* pCur = GlobalStore::get_val(mpGlbVer, idx);
+		if (!pCur) return nullptr;
+		if (!mpGlbStage) {
+			s_memLock.acquire();
+			mpGlbStage = reinterpret_cast<GlobalStage*>(nxCore::mem_alloc(sizeof(GlobalStage), "Pint:GlobalStage"));
+			s_memLock.release();
+			if (!mpGlbStage) return nullptr;
+			nxCore::mem_zero(mpGlbStage->mask, sizeof(mpGlbStage->mask));
+		}
+		if (!XD_BIT_ARY_CK(uint64_t, mpGlbStage->mask, idx)) {
+			mpGlbStage->vals[idx] = *pCur;
+			XD_BIT_ARY_ST(uint64_t, mpGlbStage->mask, idx);
+		}
+		return &mpGlbStage->vals[idx];
+	}
+	if (mpPool) {
+		Value* pCell = mpPool->get_cell(id, mPoolSlot);
+		if (pCell) return pCell;
+	}
+	if ((id >= 0) && (id < (int)CODE_VAR_MAX)) {
+		VarPage*& pPage = mpPages[id / VAR_PAGE_SIZE];
+		if (pPage == nullptr || pPage->nref > 1) {
+			VarPage* pNewPage = shared_alloc<VarPage>("Pint:VarPage");
+			if (!pNewPage) return nullptr;
+			if (pPage) {
+				nxCore::mem_copy(pNewPage->vals, pPage->vals, sizeof(pNewPage->vals));
+				page_release(pPage);
+			} else {
+				for (size_t i = 0; i < VAR_PAGE_SIZE; ++i) {
+					pNewPage->vals[i].set_none();
+				}
+			}
+			pPage = pNewPage;
+		}
+		pVal = &pPage->vals[id % VAR_PAGE_SIZE];
+	}
+	return pVal;
+}
+
+Value* ExecContext::var_val(const char* pVarName) {
+	return var_val(find_var(pVarName));
+}
+
+const Value* ExecContext::get_val(int id) const {
+	const Value* pVal = nullptr;
+	if (id >= GLOBAL_ID_BASE) {
+		int idx = id - GLOBAL_ID_BASE;
+		if (mpGlbStage && idx < int(GlobalStore::VAR_MAX) && XD_BIT_ARY_CK(uint64_t, mpGlbStage->mask, idx)) {
+			return &mpGlbStage->vals[idx];
+		}
+		return GlobalStore::get_val(mpGlbVer, idx);
+	}
+	if (mpPool) {
+		Value* pCell = mpPool->get_cell(id, mPoolSlot);
+		if (pCell) return pCell;
+	}
+	if ((id >= 0) && (id < (int)CODE_VAR_MAX)) {
+		const VarPage* pPage = mpPages[id / VAR_PAGE_SIZE];
+		if (pPage) {
+			pVal = &pPage->vals[id % VAR_PAGE_SIZE];
+		}
+	}
+	return pVal;
+}
+
+const Value* ExecContext::get_val(const char* pVarName) const {
+	return get_val(find_var(pVarName));
+}
+
+uint32_t ExecContext::get_var_count() const {
+	return mpVars ? mpVars->count : 0;
+}
+
+const char* ExecContext::get_var_name(int id) const {
+	if (id >= GLOBAL_ID_BASE) {
+		const Value* pVal = GlobalStore::get_val(mpGlbVer, id - GLOBAL_ID_BASE);
+		return pVal ? mpGlbVer->names[id - GLOBAL_ID_BASE] : nullptr;
+	}
+	return (id >= 0) && (id < (int)get_var_count()) ? mpVars->names[id] : nullptr;
+}
+
+void ExecContext::fork(ExecContext* pDst) {
+	if (!pDst || pDst == this) return;
+	if (mpStrs || mpLists) {
+		// the current stores become immutable and shared, new strings and lists go to fresh ones
+		StrChain* pChain = shared_alloc<StrChain>("Pint:StrChain");
+		if (pChain) {
+			pChain->pStrs = mpStrs;
+			pChain->pLists = mpLists;
+			pChain->pNext = mpStrChain;
+			mpStrChain = pChain;
+			mpStrs = nullptr;
+			mpLists = nullptr;
+		}
+	}
+	pDst->reset();
+	pDst->mpStrChain = shared_acquire(mpStrChain);
+	pDst->mpVars = shared_acquire(mpVars);
+	for (size_t i = 0; i < VAR_PAGE_NUM; ++i) {
+		pDst->mpPages[i] = shared_acquire(mpPages[i]);
+	}
+	nxCore::mem_copy(pDst->mDomStack, mDomStack, sizeof(mDomStack));
+	pDst->mDomDepth = mDomDepth;
+	// names resolved in the destination before the fork are resolved again
+	pDst->mScopeGen = nxCalc::max(pDst->mScopeGen, mScopeGen) + 1;
+	if (mpPool) {
+		// the fork isn't pooled, its pages get the column values
+		for (uint32_t i = 0; i < mpPool->get_column_count(); ++i) {
+			Value* pVal = pDst->var_val(int(i));
+			if (pVal) {
+				*pVal = *get_val(int(i));
+			}
+		}
+	}
+	pDst->mFrame = mFrame;
+	if (mpRng) {
+		pDst->mpRng = rng_alloc();
+		if (pDst->mpRng) {
+			*pDst->mpRng = *mpRng;
+		}
+	}
+	pDst->mpGlobals = mpGlobals;
+	pDst->mGlbDom = mGlbDom;
+	GlobalStore::retain(mpGlbVer);
+	pDst->mpGlbVer = mpGlbVer;
+	if (mpGlbStage) {
+		s_memLock.acquire();
+		pDst->mpGlbStage = reinterpret_cast<GlobalStage*>(nxCore::mem_alloc(sizeof(GlobalStage), "Pint:GlobalStage"));
+		s_memLock.release();
+		if (pDst->mpGlbStage) {
+			nxCore::mem_copy(pDst->mpGlbStage, mpGlbStage, sizeof(GlobalStage));
+		}
+	}
+	pDst->mpBinding = mpBinding;
+}
+
+// Snapshot layout, little-endian, no alignment:
+//   SnapHead
+//   records: u8 type, u8 flags, u16 var id,
+//            [u8 domain name length, domain name, 0,
+//             u8 name length, name, 0]          if SNAP_NAMED
+//            [f64]                              for NUM
+//            [i64]                              for INT
+//            [u16 length, chars, 0]             for STR
+//            [u32 count, count * (u8 type, value as above)]  for LST
+// A full snapshot stores every variable with its name. A delta stores the variables whose
+// values differ from the base, names only for those added after the base; list variables
+// are always stored. Lists nested deeper than SNAP_LIST_DEPTH are stored as none.
+static const uint32_t SNAP_KIND = XD_FOURCC('P', 'S', 'N', 'P');
+static const uint8_t SNAP_NAMED = 1;
+static const uint32_t SNAP_DELTA = 1;
+static const uint32_t SNAP_LIST_DEPTH = 32;
+
+struct SnapHead {
+	uint32_t kind;
+	uint32_t size;
+	uint32_t varNum;
+	uint32_t flags;
+	uint32_t baseHash;
+};
+
+static uint32_t snap_hash(const void* pData, const size_t size) {
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pData);
+	uint32_t h = 0x811C9DC5;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= pBytes[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static const SnapHead* snap_head(const void* pSnap, const size_t snapSize) {
+	const SnapHead* pHead = reinterpret_cast<const SnapHead*>(pSnap);
+	if (!pHead || snapSize < sizeof(SnapHead)) return nullptr;
+	if (pHead->kind != SNAP_KIND || pHead->size > snapSize || pHead->varNum > ExecContext::CODE_VAR_MAX) return nullptr;
+	return pHead;
+}
+
+struct SnapReader {
+	const uint8_t* pCur;
+	const uint8_t* pEnd;
+
+	bool read(void* pDst, const size_t size) {
+		if (size_t(pEnd - pCur) < size) return false;
+		nxCore::mem_copy(pDst, pCur, size);
+		pCur += size;
+		return true;
+	}
+
+	const char* read_str(const size_t len) {
+		if (size_t(pEnd - pCur) < len + 1 || pCur[len] != 0) return nullptr;
+		const char* pStr = reinterpret_cast<const char*>(pCur);
+		pCur += len + 1;
+		return pStr;
+	}
+
+	// With pCtx lists are made in it, their strings copied there; otherwise
+	// they are skipped and read as an LST value without a list.
+	bool value(const uint8_t type, Value* pVal, ExecContext* pCtx, const uint32_t depth) {
+		switch (Value::Type(type)) {
+			case Value::Type::NUM: {
+					double num = 0.0;
+					if (!read(&num, sizeof(num))) return false;
+					pVal->set_num(num);
+				}
+				break;
+			case Value::Type::INT: {
+					int64_t num = 0;
+					if (!read(&num, sizeof(num))) return false;
+					pVal->set_int(num);
+				}
+				break;
+			case Value::Type::STR: {
+					uint16_t len = 0;
+					const char* pStr = nullptr;
+					if (!read(&len, 2) || (pStr = read_str(len)) == nullptr) return false;
+					pVal->set_str(pStr);
+				}
+				break;
+			case Value::Type::LST: {
+					uint32_t count = 0;
+					if (depth >= SNAP_LIST_DEPTH || !read(&count, 4) || count > size_t(pEnd - pCur)) return false;
+					ListHead* pLst = pCtx ? pCtx->new_list(count) : nullptr;
+					if (pCtx && !pLst) return false;
+					for (uint32_t i = 0; i < count; ++i) {
+						uint8_t itemType = 0;
+						Value item;
+						if (!read(&itemType, 1) || !value(itemType, &item, pCtx, depth + 1)) return false;
+						if (pLst) {
+							pLst->items()[i] = item.is_str() ? pCtx->copy_value(item) : item;
+						}
+					}
+					if (pLst) {
+						pLst->seal();
+					}
+					pVal->set_list(pLst);
+				}
+				break;
+			case Value::Type::NON:
+				pVal->set_none();
+				break;
+			default:
+				return false;
+		}
+		return true;
+	}
+
+	// one record, strings point into the snapshot
+	bool next(uint32_t* pId, const char** ppDomName, const char** ppName, Value* pVal, ExecContext* pCtx = nullptr) {
+		uint8_t type = 0;
+		uint8_t flags = 0;
+		uint16_t id = 0;
+		if (!read(&type, 1) || !read(&flags, 1) || !read(&id, 2)) return false;
+		*pId = id;
+		*ppDomName = nullptr;
+		*ppName = nullptr;
+		if (flags & SNAP_NAMED) {
+			uint8_t len = 0;
+			if (!read(&len, 1) || (*ppDomName = read_str(len)) == nullptr) return false;
+			if (!read(&len, 1) || (*ppName = read_str(len)) == nullptr) return false;
+		}
+		return value(type, pVal, pCtx, 0);
+	}
+};
+
+struct SnapWriter {
+	uint8_t* pBuf;
+	size_t bufSize;
+	size_t pos;
+
+	void write(const void* pSrc, const size_t size) {
+		if (pos + size <= bufSize) {
+			nxCore::mem_copy(pBuf + pos, pSrc, size);
+		}
+		pos += size;
+	}
+
+	void write_str(const char* pStr, const size_t lenSize, const size_t maxLen) {
+		size_t len = nxCalc::min(nxCore::str_len(pStr), maxLen);
+		uint16_t len16 = uint16_t(len);
+		write(&len16, lenSize);
+		write(pStr, len);
+		uint8_t term = 0;
+		write(&term, 1);
+	}
+
+	static uint8_t type(const Value& val, const uint32_t depth) {
+		return uint8_t(val.is_list() && depth >= SNAP_LIST_DEPTH ? Value::Type::NON : val.get_type());
+	}
+
+	void value(const Value& val, const uint32_t depth) {
+		if (val.is_int()) {
+			int64_t num = val.get_int();
+			write(&num, sizeof(int64_t));
+		} else if (val.is_num()) {
+			double num = val.get_num();
+			write(&num, sizeof(double));
+		} else if (val.is_str()) {
+			write_str(val.get_str(), 2, 0xFFFF);
+		} else if (val.is_list() && depth < SNAP_LIST_DEPTH) {
+			const ListHead* pLst = val.get_list();
+			write(&pLst->count, 4);
+			for (uint32_t i = 0; i < pLst->count; ++i) {
+				uint8_t itemType = type(pLst->items()[i], depth + 1);
+				write(&itemType, 1);
+				value(pLst->items()[i], depth + 1);
+			}
+		}
+	}
+};
+
+// lists read from the base aren't kept, a list variable never matches the base
+static bool snap_value_eq(const Value& valA, const Value& valB) {
+	if (valA.get_type() != valB.get_type()) return false;
+	if (valA.is_num()) return valA.bits == valB.bits;
+	if (valA.is_str()) return str_eq(valA, valB);
+	return !valA.is_list();
+}
+
+size_t ExecContext::snapshot(void* pBuf, const size_t bufSize, const void* pBase, const size_t baseSize) const {
+	Value baseVals[CODE_VAR_MAX];
+	uint32_t baseNum = 0;
+	SnapHead head;
+	head.kind = SNAP_KIND;
+	head.size = 0;
+	head.varNum = get_var_count();
+	head.flags = 0;
+	head.baseHash = 0;
+
+	if (pBase) {
+		const SnapHead* pBaseHead = snap_head(pBase, baseSize);
+		if (!pBaseHead || (pBaseHead->flags & SNAP_DELTA)) return 0;
+		SnapReader rd = { reinterpret_cast<const uint8_t*>(pBaseHead + 1), reinterpret_cast<const uint8_t*>(pBase) + pBaseHead->size };
+		baseNum = pBaseHead->varNum;
+		for (uint32_t i = 0; i < baseNum; ++i) {
+			uint32_t id = 0;
+			const char* pDomName = nullptr;
+			const char* pName = nullptr;
+			if (!rd.next(&id, &pDomName, &pName, &baseVals[i]) || id != i) return 0;
+		}
+		head.flags = SNAP_DELTA;
+		head.baseHash = snap_hash(pBase, pBaseHead->size);
+	}
+
+	SnapWriter wr = { reinterpret_cast<uint8_t*>(pBuf), pBuf ? bufSize : 0, 0 };
+	wr.write(&head, sizeof(head));
+	for (uint32_t i = 0; i < head.varNum; ++i) {
+		const Value* pVal = get_val(int(i));
+		Value val;
+		if (pVal) {
+			val = *pVal;
+		} else {
+			val.set_none();
+		}
+		bool named = i >= baseNum;
+		if (!named && snap_value_eq(val, baseVals[i])) continue;
+		uint8_t type = SnapWriter::type(val, 0);
+		uint8_t flags = named ? SNAP_NAMED : 0;
+		uint16_t id = uint16_t(i);
+		wr.write(&type, 1);
+		wr.write(&flags, 1);
+		wr.write(&id, 2);
+		if (named) {
+			wr.write_str(get_domain_name(get_var_domain(int(i))), 1, Value::SYM_MAX_LEN);
+			wr.write_str(mpVars->names[i], 1, Value::SYM_MAX_LEN);
+		}
+		wr.value(val, 0);
+	}
+	if (wr.pos <= wr.bufSize) {
+		head.size = uint32_t(wr.pos);
+		nxCore::mem_copy(pBuf, &head, sizeof(head));
+	}
+	return wr.pos;
+}
+
+bool ExecContext::restore(const void* pSnap, const size_t snapSize, const void* pBase, const size_t baseSize) {
+	const SnapHead* pHead = snap_head(pSnap, snapSize);
+	if (!pHead) return false;
+	if (pHead->flags & SNAP_DELTA) {
+		const SnapHead* pBaseHead = snap_head(pBase, baseSize);
+		if (!pBaseHead || snap_hash(pBase, pBaseHead->size) != pHead->baseHash) return false;
+		if (!restore(pBase, pBaseHead->size)) return false;
+	} else {
+		clear_vars();
+	}
+
+	SnapReader rd = { reinterpret_cast<const uint8_t*>(pHead + 1), reinterpret_cast<const uint8_t*>(pSnap) + pHead->size };
+	while (rd.pCur < rd.pEnd) {
+		uint32_t id = 0;
+		const char* pDomName = nullptr;
+		const char* pName = nullptr;
+		Value val;
+		if (!rd.next(&id, &pDomName, &pName, &val, this)) return false;
+		if (pName) {
+			int dom = add_domain(pDomName);
+			if (dom < 0 || int(id) != add_var(dom, pName)) return false;
+		} else if (id >= get_var_count()) {
+			return false;
+		}
+		if (val.is_str()) {
+			val = intern(val.get_str());
+		}
+		*var_val(int(id)) = val;
+	}
+	return get_var_count() == pHead->varNum;
+}
+
+void ExecContext::set_globals(GlobalStore* pStore) {
+	release_globals();
+	mpGlobals = pStore;
+	bind_globals();
+	sync_globals();
+}
+
+GlobalStore* ExecContext::get_globals() const {
+	return mpGlobals;
+}
+
+void ExecContext::sync_globals() {
+	if (!mpGlobals) return;
+	GlobalVersion* pVer = mpGlobals->pin();
+	GlobalStore::unpin(mpGlbVer);
+	mpGlbVer = pVer;
+	++mScopeGen;
+}
+
+bool ExecContext::commit_globals() {
+	if (!mpGlobals) return false;
+	bool res = true;
+	if (mpGlbStage) {
+		int idx[GlobalStore::VAR_MAX];
+		Value vals[GlobalStore::VAR_MAX];
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < GlobalStore::VAR_MAX; ++i) {
+			if (XD_BIT_ARY_CK(uint64_t, mpGlbStage->mask, i)) {
+				idx[n] = int(i);
+				vals[n] = mpGlbStage->vals[i];
+				++n;
+			}
+		}
+		if (n > 0) {
+			res = mpGlobals->commit(idx, vals, n);
+		}
+		nxCore::mem_zero(mpGlbStage->mask, sizeof(mpGlbStage->mask));
+	}
+	sync_globals();
+	return res;
+}
+
+uint64_t ExecContext::get_globals_serial() const {
+	return GlobalStore::get_serial(mpGlbVer);
+}
+
+double ExecContext::get_num_val(const char* pVarName, const double defVal) {
+	const Pint::Value* pVal = get_val(pVarName);
+	return pVal ? pVal->get_num() : defVal;
+}
+
+void ExecContext::clear_vars() {
+	if (mpPool) {
+		mpPool->remove(this);
+	}
+	release_vars();
+	mpVars = table_create();
+	reset_domains();
+	bind_globals();
+	nxCore::mem_zero(&mFrame, sizeof(mFrame));
+	if (mpGlbStage) {
+		nxCore::mem_zero(mpGlbStage->mask, sizeof(mpGlbStage->mask));
+	}
+
+	heap_purge(mpStrs);
+	arena_free(mpLists);
+	mpLists = nullptr;
+	chain_release(mpStrChain);
+	mpStrChain = nullptr;
+}
+
+void ExecContext::print_vars() {
+	uint32_t varCnt = get_var_count();
+	uint32_t glbCnt = mpGlbVer ? mpGlbVer->count : 0;
+	PINT_DBG_MSG(FMT_BOLD "%d" FMT_OFF " variables\n", varCnt + glbCnt);
+	for (uint32_t i = 0; i < varCnt + glbCnt; ++i) {
+		int varId = i < varCnt ? int(i) : GLOBAL_ID_BASE + int(i - varCnt);
+#if defined(PINT_DBG)
+		const char* pVarName = get_var_name(varId);
+		const char* pDomName = get_domain_name(get_var_domain(varId));
+		PINT_DBG_MSG(FMT_BOLD "[%d]" FMT_OFF FMT_B_BLUE " %s%s%s" FMT_OFF ": ", varId, pDomName, *pDomName ? "." : "", pVarName);
+#endif
+		const Value* pVal = get_val(varId);
+		if (pVal) {
+			if (pVal->is_str()) {
+				PINT_DBG_MSG(FMT_B_YELLOW "\"%s\"" FMT_OFF, pVal->get_str());
+			} else if (pVal->is_int()) {
+				PINT_DBG_MSG("%lld", (long long)pVal->get_int());
+			} else if (pVal->is_num()) {
+				PINT_DBG_MSG("%f", pVal->get_num());
+			} else if (pVal->is_list()) {
+				PINT_DBG_MSG(FMT_B_GREEN "(%d items)" FMT_OFF, pVal->get_list()->count);
+			} else {
+				PINT_DBG_MSG("--");
+			}
+		} else {
+
+		}
+		PINT_DBG_MSG("\n");
+	}
+}
+
+void ExecContext::set_error(const EvalError errCode) {
+	mErrCode = errCode;
+	if (errCode != EvalError::NONE) {
+		set_break(true);
+	}
+}
+
+EvalError ExecContext::get_error() const { return mErrCode; }
+
+void ExecContext::print_error() const {
+	PINT_DBG_MSG(FMT_BOLD FMT_RED "ERROR: " FMT_OFF);
+	switch(mErrCode) {
+		case EvalError::BAD_VAR_CLAUSE:
+			PINT_DBG_MSG("Invalid variable definition clause.\n");
+			break;
+		case EvalError::VAR_SYM:
+			PINT_DBG_MSG("SYM type expected for a variable name.\n");
+			break;
+		case EvalError::VAR_CTX_ADD:
+			PINT_DBG_MSG("Error adding variable to the context.\n");
+			break;
+		case EvalError::BAD_OPERAND_COUNT:
+			PINT_DBG_MSG("A numeric operand expected.\n");
+			break;
+		case EvalError::BAD_OPERAND_TYPE_NUM:
+			PINT_DBG_MSG("A numeric value expected.\n");
+			break;
+		case EvalError::BAD_OPERAND_TYPE_SYM:
+			PINT_DBG_MSG("A symbol expected.\n");
+			break;
+		case EvalError::BAD_OPERAND_TYPE_STR:
+			PINT_DBG_MSG("A string value expected.\n");
+			break;
+		case EvalError::VAR_NOT_FOUND:
+			PINT_DBG_MSG("Variable not found.\n");
+			break;
+		case EvalError::BAD_IF_CLAUSE:
+			PINT_DBG_MSG("Missing condition expression in 'if'.\n");
+			break;
+		case EvalError::BAD_FUNC_ARGS:
+			PINT_DBG_MSG("Bad argument number or arguments types for a function call.\n");
+			break;
+		case EvalError::FUNC_NOT_FOUND:
+			PINT_DBG_MSG("Function not found.\n");
+			break;
+		case EvalError::BAD_YIELD:
+			PINT_DBG_MSG("'yield' or 'wait' can't suspend here.\n");
+			break;
+		case EvalError::BAD_LIST_LENGTH:
+			PINT_DBG_MSG("Lists of different lengths.\n");
+			break;
+		case EvalError::BAD_LIST_INDEX:
+			PINT_DBG_MSG("List index out of range.\n");
+			break;
+		case EvalError::BAD_OPERAND_TYPE_LST:
+			PINT_DBG_MSG("A list value expected.\n");
+			break;
+		case EvalError::BAD_DEFUN:
+			PINT_DBG_MSG("Bad function definition.\n");
+			break;
+		case EvalError::CALL_DEPTH:
+			PINT_DBG_MSG("Function calls nested too deep.\n");
+			break;
+		case EvalError::BAD_LOOP_CLAUSE:
+			PINT_DBG_MSG("Bad loop clause.\n");
+			break;
+		case EvalError::LOOP_BUDGET:
+			PINT_DBG_MSG("The budget ran out in a loop that can't be suspended.\n");
+			break;
+		case EvalError::NONE:
+		default:
+			break;
+	}
+}
+
+void ExecContext::set_break(const bool brk) {
+	mBreak = brk;
+}
+
+bool ExecContext::should_break() const {
+	return mBreak;
+}
+
+bool ExecContext::suspended() const {
+	return mFrame.depth > 0;
+}
+
+Frame* ExecContext::get_frame() {
+	return &mFrame;
+}
+
+void ExecContext::set_budget(const uint32_t fuel, const double micros) {
+	mFuel = fuel;
+	mDeadline = micros > 0.0 ? nxSys::time_micros() + micros : 0.0;
+	mFuelLimit = fuel > 0;
+}
+
+uint32_t ExecContext::get_fuel() const {
+	return mFuel;
+}
+
+void ExecContext::burn_fuel() {
+	if (mFuel > 0) {
+		--mFuel;
+	}
+}
+
+bool ExecContext::budget_spent() const {
+	if (mFuelLimit && mFuel == 0) return true;
+	return mDeadline > 0.0 && nxSys::time_micros() >= mDeadline;
+}
+
+bool ExecContext::out_of_budget() const {
+	return suspended() && mFrame.preempt != 0;
+}
+
+void ExecContext::seed_rng(const uint64_t seed) {
+	if (!mpRng) {
+		mpRng = rng_alloc();
+		if (!mpRng) return;
+	}
+	mpRng->seed(seed);
+}
+
+void ExecContext::split_rng(const uint64_t key) {
+	uint64_t x = key;
+	seed_rng(rng_next() ^ rng_splitmix(x));
+}
+
+uint64_t ExecContext::rng_next() {
+	if (!mpRng) {
+		seed_rng(RNG_DEFAULT_SEED);
+		if (!mpRng) {
+			uint64_t x = RNG_DEFAULT_SEED;
+			return rng_splitmix(x);
+		}
+	}
+	return mpRng->next();
+}
+
+double ExecContext::rng_01() {
+	return double(rng_next() >> 11) * (1.0 / double(1ULL << 53));
+}
+
+void ExecContext::set_local_binding(void* pBinding) {
+	mpBinding = pBinding;
+}
+
+void* ExecContext::get_local_binding() {
+	return mpBinding;
+}
+
+ContextPool* ExecContext::get_pool() const {
+	return mpPool;
+}
+
+uint32_t ExecContext::get_pool_slot() const {
+	return mPoolSlot;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t bit_count(uint64_t x) {
+#if defined(__GNUC__)
+	return uint32_t(__builtin_popcountll(x));
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return uint32_t((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// The column is padded to whole words. Values are single NaN-boxed words, so the condition
+// runs over them directly with a fixed trip count and no branches, which the compiler vectorizes.
+template<typename PRED> static uint32_t col_filter(uint64_t* pSel, const Value* pCol, const uint32_t nwords, PRED pred) {
+	uint32_t n = 0;
+	for (uint32_t w = 0; w < nwords; ++w) {
+		if (pSel[w] == 0) continue;
+		const Value* pVals = &pCol[w * 64];
+		uint64_t bits = 0;
+		for (uint64_t i = 0; i < 64; ++i) {
+			bits |= (pred(pVals[i]) ? uint64_t(1) : uint64_t(0)) << i;
+		}
+		pSel[w] &= bits;
+		n += bit_count(pSel[w]);
+	}
+	return n;
+}
+
+struct PoolCmpEQ { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() == x); } };
+struct PoolCmpNE { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() != x); } };
+struct PoolCmpLT { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() < x); } };
+struct PoolCmpLE { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() <= x); } };
+struct PoolCmpGT { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() > x); } };
+struct PoolCmpGE { double x; bool operator()(const Value& v) const { return v.is_num() & (v.get_num() >= x); } };
+struct PoolCmpSET {
+	bool operator()(const Value& v) const {
+		return v.is_str() | (v.is_num() & (v.get_num() != 0.0));
+	}
+};
+
+ContextPool::ContextPool() :
+	mpCols(nullptr),
+	mppCtxs(nullptr),
+	mpFree(nullptr),
+	mColNum(0),
+	mCapacity(0),
+	mSlotNum(0),
+	mFreeNum(0)
+	{}
+
+ContextPool::~ContextPool() {
+	reset();
+}
+
+bool ContextPool::init(ExecContext& tmpl, const uint32_t capacity) {
+	reset();
+	mTemplate.init();
+	tmpl.fork(&mTemplate);
+	mColNum = mTemplate.get_var_count();
+	mCapacity = ((capacity + SLOT_ALIGN - 1) / SLOT_ALIGN) * SLOT_ALIGN;
+	s_memLock.acquire();
+	mpCols = reinterpret_cast<Value*>(nxCore::mem_alloc(sizeof(Value) * nxCalc::max(size_t(mColNum) * mCapacity, size_t(1)), "Pint:PoolCols"));
+	mppCtxs = reinterpret_cast<ExecContext**>(nxCore::mem_alloc(sizeof(ExecContext*) * nxCalc::max(mCapacity, 1U), "Pint:PoolCtxs"));
+	mpFree = reinterpret_cast<uint32_t*>(nxCore::mem_alloc(sizeof(uint32_t) * nxCalc::max(mCapacity, 1U), "Pint:PoolFree"));
+	s_memLock.release();
+	if (!mpCols || !mppCtxs || !mpFree) {
+		reset();
+		return false;
+	}
+	for (size_t i = 0; i < size_t(mColNum) * mCapacity; ++i) {
+		mpCols[i].set_none();
+	}
+	nxCore::mem_zero(mppCtxs, sizeof(ExecContext*) * mCapacity);
+	return true;
+}
+
+void ContextPool::reset() {
+	for (uint32_t i = 0; i < mSlotNum; ++i) {
+		if (mppCtxs[i]) {
+			remove(mppCtxs[i]);
+		}
+	}
+	s_memLock.acquire();
+	if (mpCols) {
+		nxCore::mem_free(mpCols);
+		mpCols = nullptr;
+	}
+	if (mppCtxs) {
+		nxCore::mem_free(mppCtxs);
+		mppCtxs = nullptr;
+	}
+	if (mpFree) {
+		nxCore::mem_free(mpFree);
+		mpFree = nullptr;
+	}
+	s_memLock.release();
+	mTemplate.reset();
+	mColNum = 0;
+	mCapacity = 0;
+	mSlotNum = 0;
+	mFreeNum = 0;
+}
+
+bool ContextPool::add(ExecContext* pCtx) {
+	if (!pCtx || !mpCols) return false;
+	if (pCtx->mpPool) {
+		pCtx->mpPool->remove(pCtx);
+	}
+	uint32_t slot;
+	if (mFreeNum > 0) {
+		slot = mpFree[--mFreeNum];
+	} else if (mSlotNum < mCapacity) {
+		slot = mSlotNum++;
+	} else {
+		return false;
+	}
+	mTemplate.fork(pCtx);
+	for (uint32_t i = 0; i < mColNum; ++i) {
+		const Value* pVal = mTemplate.get_val(int(i));
+		Value* pDst = &mpCols[size_t(i) * mCapacity + slot];
+		if (pVal) {
+			*pDst = *pVal;
+		} else {
+			pDst->set_none();
+		}
+	}
+	pCtx->mpPool = this;
+	pCtx->mPoolSlot = slot;
+	mppCtxs[slot] = pCtx;
+	return true;
+}
+
+void ContextPool::remove(ExecContext* pCtx) {
+	if (!pCtx || pCtx->mpPool != this) return;
+	uint32_t slot = pCtx->mPoolSlot;
+	pCtx->mpPool = nullptr;
+	pCtx->mPoolSlot = 0;
+	for (uint32_t i = 0; i < mColNum; ++i) {
+		Value* pSrc = &mpCols[size_t(i) * mCapacity + slot];
+		Value* pVal = pCtx->var_val(int(i));
+		if (pVal) {
+			*pVal = *pSrc;
+		}
+		pSrc->set_none();
+	}
+	mppCtxs[slot] = nullptr;
+	mpFree[mFreeNum++] = slot;
+}
+
+uint32_t ContextPool::get_capacity() const {
+	return mCapacity;
+}
+
+uint32_t ContextPool::get_column_count() const {
+	return mColNum;
+}
+
+int ContextPool::find_column(const char* pName) const {
+	int id = mTemplate.find_var(pName);
+	return id >= 0 && id < int(mColNum) ? id : -1;
+}
+
+Value* ContextPool::get_cell(int id, uint32_t slot) const {
+	return mpCols && id >= 0 && id < int(mColNum) ? &mpCols[size_t(id) * mCapacity + slot] : nullptr;
+}
+
+Value* ContextPool::get_column(int id) const {
+	return mpCols && id >= 0 && id < int(mColNum) ? &mpCols[size_t(id) * mCapacity] : nullptr;
+}
+
+ExecContext* ContextPool::get_context(uint32_t slot) const {
+	return slot < mSlotNum ? mppCtxs[slot] : nullptr;
+}
+
+uint32_t ContextPool::get_mask_size() const {
+	return mCapacity / 64;
+}
+
+uint32_t ContextPool::select_all(uint64_t* pSel) const {
+	uint32_t n = 0;
+	for (uint32_t w = 0; w < get_mask_size(); ++w) {
+		uint64_t bits = 0;
+		for (uint32_t i = 0; i < 64; ++i) {
+			uint32_t slot = w * 64 + i;
+			if (slot < mSlotNum && mppCtxs[slot]) {
+				bits |= uint64_t(1) << i;
+			}
+		}
+		pSel[w] = bits;
+		n += bit_count(bits);
+	}
+	return n;
+}
+
+uint32_t ContextPool::filter(uint64_t* pSel, int id, const Cmp cmp, const double val) const {
+	const Value* pCol = get_column(id);
+	uint32_t nwords = get_mask_size();
+	if (!pCol || !pSel) {
+		if (pSel) {
+			nxCore::mem_zero(pSel, sizeof(uint64_t) * nwords);
+		}
+		return 0;
+	}
+	switch (cmp) {
+		case Cmp::EQ: { PoolCmpEQ pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::NE: { PoolCmpNE pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::LT: { PoolCmpLT pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::LE: { PoolCmpLE pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::GT: { PoolCmpGT pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::GE: { PoolCmpGE pred = { val }; return col_filter(pSel, pCol, nwords, pred); }
+		case Cmp::SET: { PoolCmpSET pred; return col_filter(pSel, pCol, nwords, pred); }
+	}
+	return 0;
+}
+
+uint32_t ContextPool::count(const uint64_t* pSel) const {
+	uint32_t n = 0;
+	for (uint32_t w = 0; w < get_mask_size(); ++w) {
+		n += bit_count(pSel[w]);
+	}
+	return n;
+}
+
+bool ContextPool::get_min(const uint64_t* pSel, int id, double* pRes) const {
+	const Value* pCol = get_column(id);
+	if (!pCol || !pSel) return false;
+	bool found = false;
+	double res = 0.0;
+	for (uint32_t w = 0; w < get_mask_size(); ++w) {
+		for (uint64_t bits = pSel[w]; bits; bits &= bits - 1) {
+			const Value& v = pCol[w * 64 + bit_count((bits & (0 - bits)) - 1)];
+			if (v.is_num() && (!found || v.get_num() < res)) {
+				res = v.get_num();
+				found = true;
+			}
+		}
+	}
+	if (found && pRes) {
+		*pRes = res;
+	}
+	return found;
+}
+
+bool ContextPool::get_max(const uint64_t* pSel, int id, double* pRes) const {
+	const Value* pCol = get_column(id);
+	if (!pCol || !pSel) return false;
+	bool found = false;
+	double res = 0.0;
+	for (uint32_t w = 0; w < get_mask_size(); ++w) {
+		for (uint64_t bits = pSel[w]; bits; bits &= bits - 1) {
+			const Value& v = pCol[w * 64 + bit_count((bits & (0 - bits)) - 1)];
+			if (v.is_num() && (!found || v.get_num() > res)) {
+				res = v.get_num();
+				found = true;
+			}
+		}
+	}
+	if (found && pRes) {
+		*pRes = res;
+	}
+	return found;
+}
+
+double ContextPool::get_sum(const uint64_t* pSel, int id) const {
+	const Value* pCol = get_column(id);
+	if (!pCol || !pSel) return 0.0;
+	double res = 0.0;
+	for (uint32_t w = 0; w < get_mask_size(); ++w) {
+		for (uint64_t bits = pSel[w]; bits; bits &= bits - 1) {
+			const Value& v = pCol[w * 64 + bit_count((bits & (0 - bits)) - 1)];
+			if (v.is_num()) {
+				res += v.get_num();
+			}
+		}
+	}
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Integers stay integers while the result fits in 48 bits, mixed operands give floats.
+// Comparisons and bit operations give integers.
+static Value numop_add(const Value& valA, const Value& valB) {
+	Value val;
+	if (valA.is_int() && valB.is_int()) {
+		val.set_int(valA.get_int() + valB.get_int());
+	} else {
+		val.set_num(valA.get_num() + valB.get_num());
+	}
+	return val;
+}
+
+static Value numop_sub(const Value& valA, const Value& valB) {
+	Value val;
+	if (valA.is_int() && valB.is_int()) {
+		val.set_int(valA.get_int() - valB.get_int());
+	} else {
+		val.set_num(valA.get_num() - valB.get_num());
+	}
+	return val;
+}
+
+static Value numop_mul(const Value& valA, const Value& valB) {
+	Value val;
+	double num = valA.get_num() * valB.get_num();
+	if (valA.is_int() && valB.is_int() && num >= double(Value::INT_MIN_VAL) && num <= double(Value::INT_MAX_VAL)) {
+		val.set_int(valA.get_int() * valB.get_int());
+	} else {
+		val.set_num(num);
+	}
+	return val;
+}
+
+// exact quotients of integers are integers
+static Value numop_div(const Value& valA, const Value& valB) {
+	Value val;
+	if (valA.is_int() && valB.is_int() && valB.get_int() != 0 && valA.get_int() % valB.get_int() == 0) {
+		val.set_int(valA.get_int() / valB.get_int());
+	} else {
+		val.set_num(valA.get_num() / valB.get_num());
+	}
+	return val;
+}
+
+static bool num_lt(const Value& valA, const Value& valB) {
+	if (valA.is_int() && valB.is_int()) return valA.get_int() < valB.get_int();
+	return valA.get_num() < valB.get_num();
+}
+
+static bool num_eq(const Value& valA, const Value& valB) {
+	if (valA.is_int() && valB.is_int()) return valA.bits == valB.bits;
+	return valA.get_num() == valB.get_num();
+}
+
+// the operand is returned as is, nxCalc::min/max order
+static Value numop_min(const Value& valA, const Value& valB) {
+	return num_lt(valA, valB) ? valA : valB;
+}
+
+static Value numop_max(const Value& valA, const Value& valB) {
+	return num_lt(valB, valA) ? valA : valB;
+}
+
+// floats are truncated, saturating out of the int64_t range
+static int64_t int_bits(const Value& val) {
+	if (val.is_int()) return val.get_int();
+	double num = val.get_num();
+	if (!(num == num)) return 0;
+	if (num >= 9.2233720368547758e18) return INT64_MAX;
+	if (num <= -9.2233720368547758e18) return INT64_MIN;
+	return int64_t(num);
+}
+
+static Value numop_logand(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(int_bits(valA) & int_bits(valB));
+	return val;
+}
+
+static Value numop_logxor(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(int_bits(valA) ^ int_bits(valB));
+	return val;
+}
+
+static Value numop_logior(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(int_bits(valA) | int_bits(valB));
+	return val;
+}
+
+static Value numop_eq(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(num_eq(valA, valB) ? 1 : 0);
+	return val;
+}
+
+static Value numop_ne(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(num_eq(valA, valB) ? 0 : 1);
+	return val;
+}
+
+static Value numop_gt(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(num_lt(valB, valA) ? 1 : 0);
+	return val;
+}
+
+static Value numop_ge(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(valA.is_int() && valB.is_int() ? valA.get_int() >= valB.get_int() : valA.get_num() >= valB.get_num());
+	return val;
+}
+
+static Value numop_lt(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(num_lt(valA, valB) ? 1 : 0);
+	return val;
+}
+
+static Value numop_le(const Value& valA, const Value& valB) {
+	Value val;
+	val.set_int(valA.is_int() && valB.is_int() ? valA.get_int() <= valB.get_int() : valA.get_num() <= valB.get_num());
+	return val;
+}
+
+// Float list items are raw doubles, the kernels load them straight from the Value arrays.
+// Integer items are turned into doubles as they're loaded, exactly: the 48-bit payload, offset
+// by 2^47, becomes the mantissa of 2^52 + 2^47, which is then subtracted. Lists mixing integers
+// and floats, or with other items, go through the scalar numeric ops.
+// The vector width is picked at compile time, without SSE2 only the scalar loops are built.
+#if defined(__AVX__)
+#define PINT_LIST_VEC 4
+#define PINT_LV(_op_) _mm256_##_op_##_pd
+typedef __m256d ListVec;
+static inline ListVec lv_unord(const ListVec v) { return _mm256_cmp_pd(v, v, _CMP_UNORD_Q); }
+static inline ListVec lv_eq(const ListVec a, const ListVec b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+static inline ListVec lv_ge(const ListVec a, const ListVec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+static inline ListVec lv_le(const ListVec a, const ListVec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+#elif defined(__SSE2__)
+#define PINT_LIST_VEC 2
+#define PINT_LV(_op_) _mm_##_op_##_pd
+typedef __m128d ListVec;
+static inline ListVec lv_unord(const ListVec v) { return _mm_cmpunord_pd(v, v); }
+static inline ListVec lv_eq(const ListVec a, const ListVec b) { return _mm_cmpeq_pd(a, b); }
+static inline ListVec lv_ge(const ListVec a, const ListVec b) { return _mm_cmpge_pd(a, b); }
+static inline ListVec lv_le(const ListVec a, const ListVec b) { return _mm_cmple_pd(a, b); }
+#endif
+
+#if defined(PINT_LIST_VEC)
+// NaN results get the canonical bits, as from Value::set_num
+static inline ListVec lv_fix_nan(const ListVec v) {
+	Value nan;
+	nan.bits = Value::NAN_BITS;
+	ListVec mask = lv_unord(v);
+	return PINT_LV(or)(PINT_LV(and)(mask, PINT_LV(set1)(nan.get_num())), PINT_LV(andnot)(mask, v));
+}
+
+static inline ListVec lv_load(const Value* pItems) {
+	return PINT_LV(loadu)(reinterpret_cast<const double*>(pItems));
+}
+
+static const uint64_t LV_INT_PAYLOAD = ~Value::TAG_MASK;
+static const uint64_t LV_INT_BIAS = 0x4330800000000000ULL; // 2^52 + 2^47
+
+static inline ListVec lv_bits(const uint64_t bits) {
+	union { uint64_t u; double d; } cvt;
+	cvt.u = bits;
+	return PINT_LV(set1)(cvt.d);
+}
+
+static inline ListVec lv_load_num(const Value* pItems, const bool ints) {
+	ListVec v = lv_load(pItems);
+	if (ints) {
+		ListVec bias = lv_bits(LV_INT_BIAS);
+		v = PINT_LV(sub)(PINT_LV(xor)(PINT_LV(and)(v, lv_bits(LV_INT_PAYLOAD)), bias), bias);
+	}
+	return v;
+}
+
+// results of two integer operands: integers where they're exact and in the Value range,
+// as the scalar ops give them, floats elsewhere
+static inline ListVec lv_int_vals(const ListVec v) {
+	ListVec bias = lv_bits(LV_INT_BIAS);
+	ListVec w = PINT_LV(add)(v, bias);
+	ListVec range = PINT_LV(and)(lv_ge(v, PINT_LV(set1)(double(Value::INT_MIN_VAL))), lv_le(v, PINT_LV(set1)(double(Value::INT_MAX_VAL))));
+	ListVec mask = PINT_LV(and)(range, lv_eq(PINT_LV(sub)(w, bias), v));
+	ListVec ints = PINT_LV(xor)(PINT_LV(and)(w, lv_bits(LV_INT_PAYLOAD)), lv_bits(Value::TAG_INT | (LV_INT_BIAS & LV_INT_PAYLOAD)));
+	return PINT_LV(or)(PINT_LV(and)(mask, ints), PINT_LV(andnot)(mask, lv_fix_nan(v)));
+}
+#define PINT_LIST_KERNEL(_op_) static ListVec vec(const ListVec a, const ListVec b) { return _op_; }
+#else
+#define PINT_LIST_KERNEL(_op_)
+#endif
+
+// The kernels also serve the n-ary forms, see CodeBlock::fold_arith: ival gives the integer
+// result, false (leaving *pRes as it is) if it isn't an integer in the Value range.
+static inline bool int_fits(const int64_t num) {
+	return num >= Value::INT_MIN_VAL && num <= Value::INT_MAX_VAL;
+}
+
+struct ListAdd {
+	static double num(const double a, const double b) { return a + b; }
+	static bool ival(const int64_t a, const int64_t b, int64_t* pRes) {
+		int64_t res = a + b;
+		if (!int_fits(res)) return false;
+		*pRes = res;
+		return true;
+	}
+	static Value val(const Value& a, const Value& b) { return numop_add(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(add)(a, b))
+};
+
+struct ListSub {
+	static double num(const double a, const double b) { return a - b; }
+	static bool ival(const int64_t a, const int64_t b, int64_t* pRes) {
+		int64_t res = a - b;
+		if (!int_fits(res)) return false;
+		*pRes = res;
+		return true;
+	}
+	static Value val(const Value& a, const Value& b) { return numop_sub(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(sub)(a, b))
+};
+
+struct ListMul {
+	static double num(const double a, const double b) { return a * b; }
+	static bool ival(const int64_t a, const int64_t b, int64_t* pRes) {
+		double num = double(a) * double(b);
+		if (num < double(Value::INT_MIN_VAL) || num > double(Value::INT_MAX_VAL)) return false;
+		*pRes = a * b;
+		return true;
+	}
+	static Value val(const Value& a, const Value& b) { return numop_mul(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(mul)(a, b))
+};
+
+struct ListDiv {
+	static double num(const double a, const double b) { return a / b; }
+	static bool ival(const int64_t a, const int64_t b, int64_t* pRes) {
+		if (b == 0 || a % b != 0) return false;
+		int64_t res = a / b;
+		if (!int_fits(res)) return false;
+		*pRes = res;
+		return true;
+	}
+	static Value val(const Value& a, const Value& b) { return numop_div(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(div)(a, b))
+};
+
+// minpd/maxpd pick the second operand on NaNs, same as nxCalc::min/max
+struct ListMin {
+	static double num(const double a, const double b) { return nxCalc::min(a, b); }
+	static Value val(const Value& a, const Value& b) { return numop_min(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(min)(a, b))
+};
+
+struct ListMax {
+	static double num(const double a, const double b) { return nxCalc::max(a, b); }
+	static Value val(const Value& a, const Value& b) { return numop_max(a, b); }
+	PINT_LIST_KERNEL(PINT_LV(max)(a, b))
+};
+
+// SCALAR_A/B: the operand is a single value broadcast over the other list;
+// intsA/B: the operand's items are integers
+template<typename K, bool SCALAR_A, bool SCALAR_B>
+static void list_kernel(Value* pDst, const Value* pA, const Value* pB, const uint32_t n, const bool numeric, const bool intsA, const bool intsB) {
+	uint32_t i = 0;
+#if defined(PINT_LIST_VEC)
+	if (numeric) {
+		ListVec va = SCALAR_A ? PINT_LV(set1)(pA->get_num()) : PINT_LV(setzero)();
+		ListVec vb = SCALAR_B ? PINT_LV(set1)(pB->get_num()) : PINT_LV(setzero)();
+		for (; i + PINT_LIST_VEC <= n; i += PINT_LIST_VEC) {
+			ListVec r = K::vec(SCALAR_A ? va : lv_load_num(pA + i, intsA), SCALAR_B ? vb : lv_load_num(pB + i, intsB));
+			PINT_LV(storeu)(reinterpret_cast<double*>(pDst + i), intsA && intsB ? lv_int_vals(r) : lv_fix_nan(r));
+		}
+	}
+#else
+	(void)intsA;
+	(void)intsB;
+#endif
+	for (; i < n; ++i) {
+		const Value& a = SCALAR_A ? *pA : pA[i];
+		const Value& b = SCALAR_B ? *pB : pB[i];
+		if (a.is_num() && b.is_num()) {
+			pDst[i] = K::val(a, b);
+		} else {
+			pDst[i].set_none();
+		}
+	}
+}
+
+template<typename K>
+static void list_apply(Value* pDst, const Value& valA, const Value& valB, const uint32_t n, const bool numeric, const bool intsA, const bool intsB) {
+	if (!valA.is_list()) {
+		list_kernel<K, true, false>(pDst, &valA, valB.get_list()->items(), n, numeric, intsA, intsB);
+	} else if (!valB.is_list()) {
+		list_kernel<K, false, true>(pDst, valA.get_list()->items(), &valB, n, numeric, intsA, intsB);
+	} else {
+		list_kernel<K, false, false>(pDst, valA.get_list()->items(), valB.get_list()->items(), n, numeric, intsA, intsB);
+	}
+}
+
+// left fold of n > 0 floats; the vector loop folds lanes separately, so sums may round
+// differently than a sequential fold
+template<typename K>
+static double list_fold(const Value* pItems, const uint32_t n) {
+	double acc = pItems[0].get_num();
+	uint32_t i = 1;
+#if defined(PINT_LIST_VEC)
+	if (n >= PINT_LIST_VEC * 2) {
+		ListVec vacc = lv_load(pItems);
+		for (i = PINT_LIST_VEC; i + PINT_LIST_VEC <= n; i += PINT_LIST_VEC) {
+			vacc = K::vec(vacc, lv_load(pItems + i));
+		}
+		double lanes[PINT_LIST_VEC];
+		PINT_LV(storeu)(lanes, vacc);
+		acc = lanes[0];
+		for (uint32_t j = 1; j < PINT_LIST_VEC; ++j) {
+			acc = K::num(acc, lanes[j]);
+		}
+	}
+#endif
+	for (; i < n; ++i) {
+		acc = K::num(acc, pItems[i].get_num());
+	}
+	return acc;
+}
+
+// left fold of n > 0 values, none if one isn't a number
+template<typename K>
+static Value list_fold_vals(const Value* pItems, const uint32_t n) {
+	Value acc = pItems[0];
+	for (uint32_t i = 1; i < n && acc.is_num(); ++i) {
+		acc = pItems[i].is_num() ? K::val(acc, pItems[i]) : pItems[i];
+	}
+	if (!acc.is_num()) {
+		acc.set_none();
+	}
+	return acc;
+}
+
+static bool list_same_length(ExecContext& ctx, const Value& valA, const Value& valB) {
+	if (valA.is_list() && valB.is_list() && valA.get_list()->count != valB.get_list()->count) {
+		ctx.set_error(EvalError::BAD_LIST_LENGTH);
+		return false;
+	}
+	return true;
+}
+
+Value list_arith(ExecContext& ctx, const ListOp op, const Value& valA, const Value& valB) {
+	Value val;
+	val.set_none();
+	if (!valA.is_list() && !valB.is_list()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+		return val;
+	}
+	if (!list_same_length(ctx, valA, valB)) return val;
+	const ListHead* pLstA = valA.is_list() ? valA.get_list() : nullptr;
+	const ListHead* pLstB = valB.is_list() ? valB.get_list() : nullptr;
+	uint32_t n = pLstA ? pLstA->count : pLstB->count;
+	// an integer broadcast over floats would give floats anyway, it's promoted up front
+	Value argA = valA;
+	Value argB = valB;
+	if (!pLstA && argA.is_int() && pLstB->numeric == ListHead::NUM_FLOATS) {
+		argA.set_num(argA.get_num());
+	}
+	if (!pLstB && argB.is_int() && pLstA->numeric == ListHead::NUM_FLOATS) {
+		argB.set_num(argB.get_num());
+	}
+	uint32_t numA = pLstA ? pLstA->numeric : argA.is_float() ? ListHead::NUM_FLOATS : argA.is_int() ? ListHead::NUM_INTS : 0;
+	uint32_t numB = pLstB ? pLstB->numeric : argB.is_float() ? ListHead::NUM_FLOATS : argB.is_int() ? ListHead::NUM_INTS : 0;
+	// integers with floats give floats, except for min and max, which give the item they pick
+	bool numeric = numA && numB && (numA == numB || (op != ListOp::MIN && op != ListOp::MAX));
+	bool intsA = numA == ListHead::NUM_INTS;
+	bool intsB = numB == ListHead::NUM_INTS;
+	ListHead* pRes = ctx.new_list(n);
+	if (!pRes) return val;
+	switch (op) {
+		case ListOp::ADD: list_apply<ListAdd>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+		case ListOp::SUB: list_apply<ListSub>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+		case ListOp::MUL: list_apply<ListMul>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+		case ListOp::DIV: list_apply<ListDiv>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+		case ListOp::MIN: list_apply<ListMin>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+		case ListOp::MAX: list_apply<ListMax>(pRes->items(), argA, argB, n, numeric, intsA, intsB); break;
+	}
+	if (numeric && !(intsA && intsB)) {
+		pRes->numeric = ListHead::NUM_FLOATS;
+	} else {
+		pRes->seal();
+	}
+	val.set_list(pRes);
+	return val;
+}
+
+Value list_reduce(ExecContext& ctx, const ListOp op, const Value& val) {
+	Value res;
+	res.set_none();
+	if (!val.is_list()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+		return res;
+	}
+	const ListHead* pLst = val.get_list();
+	if (pLst->count == 0) return res;
+	const Value* pItems = pLst->items();
+	if (pLst->numeric != ListHead::NUM_FLOATS) {
+		switch (op) {
+			case ListOp::ADD: return list_fold_vals<ListAdd>(pItems, pLst->count);
+			case ListOp::SUB: return list_fold_vals<ListSub>(pItems, pLst->count);
+			case ListOp::MUL: return list_fold_vals<ListMul>(pItems, pLst->count);
+			case ListOp::DIV: return list_fold_vals<ListDiv>(pItems, pLst->count);
+			case ListOp::MIN: return list_fold_vals<ListMin>(pItems, pLst->count);
+			case ListOp::MAX: return list_fold_vals<ListMax>(pItems, pLst->count);
+		}
+	}
+	double first = pItems[0].get_num();
+	switch (op) {
+		case ListOp::ADD: res.set_num(list_fold<ListAdd>(pItems, pLst->count)); break;
+		case ListOp::MUL: res.set_num(list_fold<ListMul>(pItems, pLst->count)); break;
+		case ListOp::MIN: res.set_num(list_fold<ListMin>(pItems, pLst->count)); break;
+		case ListOp::MAX: res.set_num(list_fold<ListMax>(pItems, pLst->count)); break;
+		case ListOp::SUB: res.set_num(pLst->count > 1 ? first - list_fold<ListAdd>(pItems + 1, pLst->count - 1) : first); break;
+		case ListOp::DIV: res.set_num(pLst->count > 1 ? first / list_fold<ListMul>(pItems + 1, pLst->count - 1) : first); break;
+	}
+	return res;
+}
+
+Value list_dot(ExecContext& ctx, const Value& valA, const Value& valB) {
+	Value res;
+	res.set_none();
+	if (!valA.is_list() || !valB.is_list()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+		return res;
+	}
+	if (!list_same_length(ctx, valA, valB)) return res;
+	const ListHead* pLstA = valA.get_list();
+	const ListHead* pLstB = valB.get_list();
+	const Value* pA = pLstA->items();
+	const Value* pB = pLstB->items();
+	uint32_t n = pLstA->count;
+	if (pLstA->numeric != ListHead::NUM_FLOATS || pLstB->numeric != ListHead::NUM_FLOATS) {
+		res.set_int(0);
+		for (uint32_t i = 0; i < n && res.is_num(); ++i) {
+			if (!pA[i].is_num() || !pB[i].is_num()) {
+				res.set_none();
+			} else {
+				res = numop_add(res, numop_mul(pA[i], pB[i]));
+			}
+		}
+		return res;
+	}
+	double sum = 0.0;
+	uint32_t i = 0;
+#if defined(PINT_LIST_VEC)
+	if (n >= PINT_LIST_VEC) {
+		ListVec vsum = PINT_LV(setzero)();
+		for (; i + PINT_LIST_VEC <= n; i += PINT_LIST_VEC) {
+			vsum = PINT_LV(add)(vsum, PINT_LV(mul)(lv_load(pA + i), lv_load(pB + i)));
+		}
+		double lanes[PINT_LIST_VEC];
+		PINT_LV(storeu)(lanes, vsum);
+		for (uint32_t j = 0; j < PINT_LIST_VEC; ++j) {
+			sum += lanes[j];
+		}
+	}
+#endif
+	for (; i < n; ++i) {
+		sum += pA[i].get_num() * pB[i].get_num();
+	}
+	res.set_num(sum);
+	return res;
+}
+
+// 0 <= idx < lim, or BAD_LIST_INDEX
+static bool list_index(ExecContext& ctx, const Value& idx, const uint32_t lim, uint32_t* pIdx) {
+	if (!idx.is_num()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_NUM);
+		return false;
+	}
+	if (idx.is_int()) {
+		if (idx.get_int() < 0 || idx.get_int() >= int64_t(lim)) {
+			ctx.set_error(EvalError::BAD_LIST_INDEX);
+			return false;
+		}
+		*pIdx = uint32_t(idx.get_int());
+		return true;
+	}
+	double num = idx.get_num();
+	if (!(num >= 0.0 && num < double(lim))) {
+		ctx.set_error(EvalError::BAD_LIST_INDEX);
+		return false;
+	}
+	*pIdx = uint32_t(num);
+	return true;
+}
+
+Value list_get(ExecContext& ctx, const Value& lst, const Value& idx) {
+	Value res;
+	res.set_none();
+	uint32_t i = 0;
+	if (!lst.is_list()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+	} else if (list_index(ctx, idx, lst.get_list()->count, &i)) {
+		res = lst.get_list()->items()[i];
+	}
+	return res;
+}
+
+Value list_set(ExecContext& ctx, const Value& lst, const Value& idx, const Value& item) {
+	Value res;
+	res.set_none();
+	uint32_t i = 0;
+	if (!lst.is_list()) {
+		ctx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+		return res;
+	}
+	const ListHead* pSrc = lst.get_list();
+	if (!list_index(ctx, idx, pSrc->count + 1, &i)) return res;
+	ListHead* pLst = ctx.new_list(nxCalc::max(pSrc->count, i + 1));
+	if (pLst) {
+		nxCore::mem_copy(pLst->items(), pSrc->items(), sizeof(Value) * pSrc->count);
+		pLst->items()[i] = item;
+		if (pSrc->numeric == ListHead::NUM_FLOATS && item.is_float()) {
+			pLst->numeric = ListHead::NUM_FLOATS;
+		} else if (pSrc->numeric == ListHead::NUM_INTS && item.is_int()) {
+			pLst->numeric = ListHead::NUM_INTS;
+		} else {
+			pLst->seal();
+		}
+		res.set_list(pLst);
+	}
+	return res;
+}
+
+bool str_eq(const Value& valA, const Value& valB) {
+	const char* pStrA = valA.get_str();
+	const char* pStrB = valB.get_str();
+	if (pStrA == pStrB) return true;
+	if (valA.is_interned() && valB.is_interned()) {
+		const StrEntry* pEntA = str_entry(pStrA);
+		const StrEntry* pEntB = str_entry(pStrB);
+		if (pEntA->pHeap == pEntB->pHeap || pEntA->hash != pEntB->hash) return false;
+	}
+	return nxCore::str_eq(pStrA, pStrB);
+}
+
+bool list_eq(const ListHead* pLstA, const ListHead* pLstB) {
+	if (pLstA == pLstB) return true;
+	if (!pLstA || !pLstB || pLstA->count != pLstB->count) return false;
+	for (uint32_t i = 0; i < pLstA->count; ++i) {
+		const Value& a = pLstA->items()[i];
+		const Value& b = pLstB->items()[i];
+		if (a.is_num() && b.is_num()) {
+			if (a.get_num() != b.get_num()) return false;
+			continue;
+		}
+		if (a.get_type() != b.get_type()) return false;
+		if (a.is_str() && !str_eq(a, b)) return false;
+		if (a.is_list() && !list_eq(a.get_list(), b.get_list())) return false;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Value NumOpInfo::apply(ExecContext& ctx, const Value& valA, const Value& valB) const {
+	Value val;
+	val.set_none();
+
+	if (valA.is_num() && valB.is_num()) {
+		if (func) {
+			val = func(valA, valB);
+		}
+	} else if (listOp >= 0 && (valA.is_list() || valB.is_list())) {
+		val = list_arith(ctx, ListOp(listOp), valA, valB);
+	}
+
+	return val;
+}
+
+struct BitAnd {
+	static int64_t bits(const int64_t a, const int64_t b) { return a & b; }
+};
+
+struct BitXor {
+	static int64_t bits(const int64_t a, const int64_t b) { return a ^ b; }
+};
+
+struct BitIor {
+	static int64_t bits(const int64_t a, const int64_t b) { return a | b; }
+};
+
+// ANY: true if some neighbouring pair passes, otherwise every pair has to
+struct CmpEq {
+	static const bool ANY = false;
+	static bool test(const Value& a, const Value& b) { return num_eq(a, b); }
+};
+
+struct CmpNe {
+	static const bool ANY = true;
+	static bool test(const Value& a, const Value& b) { return !num_eq(a, b); }
+};
+
+struct CmpGt {
+	static const bool ANY = false;
+	static bool test(const Value& a, const Value& b) { return num_lt(b, a); }
+};
+
+struct CmpGe {
+	static const bool ANY = false;
+	static bool test(const Value& a, const Value& b) { return a.is_int() && b.is_int() ? a.get_int() >= b.get_int() : a.get_num() >= b.get_num(); }
+};
+
+struct CmpLt {
+	static const bool ANY = false;
+	static bool test(const Value& a, const Value& b) { return num_lt(a, b); }
+};
+
+struct CmpLe {
+	static const bool ANY = false;
+	static bool test(const Value& a, const Value& b) { return a.is_int() && b.is_int() ? a.get_int() <= b.get_int() : a.get_num() <= b.get_num(); }
+};
+
+static bool is_loop(const CodeItem& item) {
+	return item.is_sym() && item.form == CodeItem::Form::LOOP;
+}
+
+Value CodeBlock::eval_operand(CodeList* pLst, const uint32_t idx) {
+	const CodeItem& item = pLst->get_items()[idx];
+	Value val;
+	if (item.is_int()) {
+		val.set_int(item.val.inum);
+	} else if (item.is_num()) {
+		val.set_num(item.val.num);
+	} else if (item.is_arg()) {
+		val = mpCall->args[item.val.inum];
+	} else {
+		val = eval_sub(pLst, idx, 1);
+	}
+	return val;
+}
+
+// The accumulator stays unboxed: an integer while the operands are integers and the results
+// fit, then a double. An operand that isn't a number (a list, or none) hands the rest of
+// the form over to NumOpInfo::apply.
+template<typename K>
+Value CodeBlock::fold_arith(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info) {
+	enum { INT, FLT, ANY } kind;
+	Value acc = eval_operand(pLst, 1);
+	int64_t iacc = 0;
+	double facc = 0.0;
+	if (acc.is_int()) {
+		kind = INT;
+		iacc = acc.get_int();
+	} else if (acc.is_num()) {
+		kind = FLT;
+		facc = acc.get_num();
+	} else {
+		kind = ANY;
+	}
+	for (uint32_t i = 2; i < cnt; ++i) {
+		Value arg = eval_operand(pLst, i);
+		if (kind == INT) {
+			int64_t ires;
+			if (arg.is_int() && K::ival(iacc, arg.get_int(), &ires)) {
+				iacc = ires;
+				continue;
+			}
+			kind = FLT;
+			facc = double(iacc);
+		}
+		if (kind == FLT) {
+			if (arg.is_num()) {
+				facc = K::num(facc, arg.get_num());
+				continue;
+			}
+			kind = ANY;
+			acc.set_num(facc);
+		}
+		acc = info.apply(mCtx, acc, arg);
+	}
+	if (kind == INT) {
+		acc.set_int(iacc);
+	} else if (kind == FLT) {
+		acc.set_num(facc);
+	}
+	return acc;
+}
+
+// min/max keep the selected operand as it is
+template<typename K>
+Value CodeBlock::fold_select(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info) {
+	Value acc = eval_operand(pLst, 1);
+	for (uint32_t i = 2; i < cnt; ++i) {
+		Value arg = eval_operand(pLst, i);
+		if (acc.is_num() && arg.is_num()) {
+			acc = K::val(acc, arg);
+		} else {
+			acc = info.apply(mCtx, acc, arg);
+		}
+	}
+	return acc;
+}
+
+template<typename K>
+Value CodeBlock::fold_bits(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info) {
+	Value acc = eval_operand(pLst, 1);
+	bool num = acc.is_num();
+	int64_t bits = num ? int_bits(acc) : 0;
+	for (uint32_t i = 2; i < cnt; ++i) {
+		Value arg = eval_operand(pLst, i);
+		if (num && arg.is_num()) {
+			bits = K::bits(bits, int_bits(arg));
+		} else {
+			num = false;
+		}
+	}
+	if (num) {
+		acc.set_int(bits);
+	} else {
+		acc.set_none();
+	}
+	return acc;
+}
+
+// (< a b c) is a < b and b < c; every operand is evaluated, none if one isn't a number
+template<typename K>
+Value CodeBlock::chain_cmp(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info) {
+	Value val;
+	Value prev = eval_operand(pLst, 1);
+	bool num = prev.is_num();
+	bool res = !K::ANY;
+	for (uint32_t i = 2; i < cnt; ++i) {
+		Value arg = eval_operand(pLst, i);
+		if (num && arg.is_num()) {
+			if (res != K::ANY) {
+				res = K::test(prev, arg);
+			}
+			prev = arg;
+		} else {
+			num = false;
+		}
+	}
+	if (num) {
+		val.set_int(res ? 1 : 0);
+	} else {
+		val.set_none();
+	}
+	return val;
+}
+
+// numbers are true if they aren't zero, strings and lists are true
+static bool value_true(const Value& val) {
+	return val.is_str() || val.is_list() || (val.is_num() && val.get_num() != 0.0);
+}
+
+Value CodeBlock::eval_logic(CodeList* pLst, const uint32_t cnt, const bool isOr) {
+	Value val;
+	bool res = !isOr;
+	for (uint32_t i = 1; i < cnt && res != isOr && mCtx.get_error() == EvalError::NONE; ++i) {
+		res = value_true(eval_operand(pLst, i));
+	}
+	val.set_int(res ? 1 : 0);
+	return val;
+}
+
+// /= is true unless all the operands are equal
+static struct {
+	const char* pName;
+	NumOpInfo opInfo;
+} s_numOp_tbl[] = {
+	{ "+", { numop_add, &CodeBlock::fold_arith<ListAdd>, 0, int32_t(ListOp::ADD) } },
+	{ "-", { numop_sub, &CodeBlock::fold_arith<ListSub>, 0, int32_t(ListOp::SUB) } },
+	{ "*", { numop_mul, &CodeBlock::fold_arith<ListMul>, 1, int32_t(ListOp::MUL) } },
+	{ "/", { numop_div, &CodeBlock::fold_arith<ListDiv>, 1, int32_t(ListOp::DIV) } },
+	{ "min", { numop_min, &CodeBlock::fold_select<ListMin>, 0, int32_t(ListOp::MIN) } }, // unary forms reduce lists, see eval_sub
+	{ "max", { numop_max, &CodeBlock::fold_select<ListMax>, 0, int32_t(ListOp::MAX) } },
+	{ "logand", { numop_logand, &CodeBlock::fold_bits<BitAnd>, 1, -1 } },
+	{ "logxor", { numop_logxor, &CodeBlock::fold_bits<BitXor>, 0, -1 } },
+	{ "logior", { numop_logior, &CodeBlock::fold_bits<BitIor>, 0, -1 } },
+	{ "=", { numop_eq, &CodeBlock::chain_cmp<CmpEq>, 0, -1 } },
+	{ "/=", { numop_ne, &CodeBlock::chain_cmp<CmpNe>, 0, -1 } },
+	{ ">", { numop_gt, &CodeBlock::chain_cmp<CmpGt>, 0, -1 } },
+	{ ">=", { numop_ge, &CodeBlock::chain_cmp<CmpGe>, 0, -1 } },
+	{ "<", { numop_lt, &CodeBlock::chain_cmp<CmpLt>, 0, -1 } },
+	{ "<=", { numop_le, &CodeBlock::chain_cmp<CmpLe>, 0, -1 } },
+};
+
+static int find_numop(const char* pSym) {
+	size_t numops = XD_ARY_LEN(s_numOp_tbl);
+	for (size_t i = 0; i < numops; ++i) {
+		if (nxCore::str_eq(s_numOp_tbl[i].pName, pSym)) {
+			return int(i);
+		}
+	}
+	return -1;
+}
+
+static struct {
+	const char* pName;
+	CodeItem::Form form;
+} s_form_tbl[] = {
+	{ "if", CodeItem::Form::IF },
+	{ "break", CodeItem::Form::BREAK },
+	{ "defun", CodeItem::Form::DEFUN },
+	{ "while", CodeItem::Form::LOOP },
+	{ "dotimes", CodeItem::Form::LOOP },
+	{ "dolist", CodeItem::Form::LOOP },
+	{ "yield", CodeItem::Form::YIELD },
+	{ "wait", CodeItem::Form::YIELD },
+	{ "defvar", CodeItem::Form::DEFVAR },
+	{ "set", CodeItem::Form::SET },
+	{ "eq", CodeItem::Form::EQ },
+	{ "ne", CodeItem::Form::NE },
+	{ "and", CodeItem::Form::AND },
+	{ "or", CodeItem::Form::OR },
+	{ "list", CodeItem::Form::LIST },
+	{ "lget", CodeItem::Form::LGET },
+	{ "dot", CodeItem::Form::DOT },
+	{ "lset", CodeItem::Form::LSET },
+};
+
+static CodeItem::Form sym_form(const char* pSym, uint8_t* pNumOp) {
+	size_t nforms = XD_ARY_LEN(s_form_tbl);
+	for (size_t i = 0; i < nforms; ++i) {
+		if (nxCore::str_eq(s_form_tbl[i].pName, pSym)) {
+			return s_form_tbl[i].form;
+		}
+	}
+	int numOp = find_numop(pSym);
+	if (numOp < 0) return CodeItem::Form::CALL;
+	*pNumOp = uint8_t(numOp);
+	return CodeItem::Form::NUMOP;
+}
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CodeBlock::init() {
+	mListCnt = 0;
+	mListStack.reset();
+}
+
+void CodeBlock::reset() {
+	PINT_DBG_MSG("Releasing %d lists\n", mListCnt);
+	for (uint32_t i = 0; i < ListStack::CODE_LST_MAX; ++i) {
+		mLists[i].reset();
+	}
+	mListCnt = 0;
+	mListStack.reset();
+}
+
+CodeBlock::CodeBlock(ExecContext& ctx, FuncLibrary* pFuncLib) :
+	mCtx(ctx),
+	mpFuncLib(pFuncLib),
+	mListCnt(0),
+	mLevel(0),
+	mResume(false),
+	mpReadMask(nullptr),
+	mpCall(nullptr)
+{
+	mListStack.reset();
+}
+
+CodeBlock::~CodeBlock() {}
+
+const char* CodeBlock::get_def_name() const {
+	if (mListCnt == 0 || mLists[0].count() < 2) return nullptr;
+	const CodeItem* pItems = mLists[0].get_items();
+	if (!pItems[0].is_sym() || !pItems[1].is_sym()) return nullptr;
+	if (pItems[0].form == CodeItem::Form::DEFVAR || pItems[0].form == CodeItem::Form::SET) {
+		return pItems[1].val.sym;
+	}
+	return nullptr;
+}
+
+CodeList* CodeBlock::new_list() {
+	CodeList* pLst = mListCnt >= ListStack::CODE_LST_MAX ? nullptr : &mLists[mListCnt++];
+	return pLst;
+}
+
+bool CodeBlock::operator()(const cxLexer::Token& tok) {
+	CodeItem item;
+	item.set_none();
+
+	CodeList* pTopLst = mListStack.top();
+
+	if (tok.is_punctuation()) {
+		if (tok.id == cxLexer::TokId::TOK_SEMICOLON) return false;
+		if (tok.id == cxLexer::TokId::TOK_LPAREN) {
+			CodeList* pNewLst = new_list();
+			if (pNewLst == nullptr) return false;
+			mListStack.push(pNewLst);
+			item.set_list(pNewLst);
+		} else if (tok.id == cxLexer::TokId::TOK_RPAREN) {
+			mListStack.pop();
+		} else {
+			item.set_sym(tok.val.c);
+		}
+	} else if (tok.is_symbol()) {
+		item.set_sym(reinterpret_cast<char*>(tok.val.p));
+	} else if (tok.id == cxLexer::TokId::TOK_FLOAT) {
+		item.set_num(tok.val.f);
+	} else if (tok.id == cxLexer::TokId::TOK_INT) {
+		item.set_int(tok.val.i);
+	} else if (tok.is_string()) {
+		const char* pStr = mCtx.add_str(reinterpret_cast<const char*>(tok.val.p));
+		item.set_str(pStr);
+	}
+
+	if (!item.is_none()) {
+		if (pTopLst) {
+			pTopLst->append(item);
+		}
+	}
+	return true;
+}
+
+void CodeBlock::parse(const SrcCode::Line& line) {
+	reset();
+
+	if (line.valid()) {
+		cxLexer lexer;
+		lexer.set_text(line.pText, line.textSize);
+		lexer.scan(*this, s_memLock.get());
+	}
+}
+
+Value CodeBlock::eval_sub(CodeList* pLst, const uint32_t org, const uint32_t slice, const bool stmt) {
+	Value val;
+
+	val.set_none();
+
+	if (!pLst || mCtx.get_error() != EvalError::NONE) return val;
+
+	uint32_t cnt = pLst->count();
+	if (slice > 0) {
+		cnt = org + slice;
+	}
+	if (cnt == 0) return val;
+	CodeItem* pLstItems = pLst->get_items();
+	const FuncDef* pFunc = nullptr;
+	uint32_t start = org;
+	if (slice == 0) {
+		++mLevel;
+		mCtx.burn_fuel();
+		// levels on the way to a suspended form, or the form itself, are not checked against the budget
+		const bool resumed = mResume;
+		if (mResume) {
+			Frame* pFrame = mCtx.get_frame();
+			if (mLevel >= pFrame->depth) {
+				mResume = false;
+				pFrame->depth = 0;
+				if (!pFrame->preempt) {
+					// the form that suspended the script, carry on after it
+					--mLevel;
+					return val;
+				}
+				// stopped by the budget before this form, it runs now
+				pFrame->preempt = 0;
+			} else {
+				start = pFrame->path[mLevel - 1];
+				if (pLstItems[0].is_sym() && pLstItems[0].form == CodeItem::Form::IF) {
+					// back into the running branch without evaluating the condition again
+					val = eval_sub(pLst, start, 1, stmt);
+					start = cnt;
+				} else if (is_loop(pLstItems[0])) {
+					if (start == 1) {
+						// stopped by the budget at the top of an iteration, see eval_loop
+						mResume = false;
+						pFrame->depth = 0;
+						pFrame->preempt = 0;
+					}
+					val = eval_loop(pLst, cnt, stmt, start);
+					start = cnt;
+				}
+			}
+		}
+		if (stmt && !resumed && mLevel <= Frame::DEPTH_MAX && mCtx.budget_spent()) {
+			suspend(0, true);
+			--mLevel;
+			return val;
+		}
+	}
+	for (uint32_t i = start; i < cnt; ++i) {
+		CodeItem* pItem = &pLstItems[i];
+		if (mLevel <= Frame::DEPTH_MAX) {
+			mPath[mLevel - 1] = uint16_t(i);
+		}
+		if (pItem->is_list()) {
+			val = eval_sub(pItem->val.pLst, 0, 0, stmt);
+		} else if (pItem->is_sym()) {
+			CodeItem::Form form = pItem->form;
+			if (slice != 0 || i != 0) {
+				// defun, the loops and yield/wait only head a form, elsewhere they are names like any other
+				if (form == CodeItem::Form::DEFUN || form == CodeItem::Form::LOOP || form == CodeItem::Form::YIELD) {
+					form = CodeItem::Form::CALL;
+				}
+			}
+			switch (form) {
+				case CodeItem::Form::IF:
+					if (i + 1 < cnt) {
+						Value condVal = eval_sub(pLst, 1, 1);
+
+						if (value_true(condVal)) {
+							if (i + 2 < cnt) {
+								val = eval_sub(pLst, 2, 1, stmt);
+							} else {
+								mCtx.set_error(EvalError::BAD_IF_CLAUSE);
+							}
+						} else {
+							if (i + 3 < cnt) {
+								val = eval_sub(pLst, 3, 1, stmt);
+							}
+						}
+						i = cnt;
+					} else {
+						mCtx.set_error(EvalError::BAD_IF_CLAUSE);
+					}
+					break;
+				case CodeItem::Form::BREAK:
+					mCtx.set_break();
+					i = cnt;
+					break;
+				case CodeItem::Form::DEFUN:
+					eval_defun(pLst);
+					i = cnt;
+					break;
+				case CodeItem::Form::LOOP:
+					val = eval_loop(pLst, cnt, stmt, 0);
+					i = cnt;
+					break;
+				case CodeItem::Form::YIELD: {
+						uint32_t ticks = 0;
+						if (i + 1 < cnt) {
+							Value waitVal = eval_sub(pLst, 1, 1);
+							ticks = waitVal.is_num() && waitVal.get_num() > 0.0 ? uint32_t(waitVal.get_num()) : 0;
+						}
+						if (!stmt || mLevel > Frame::DEPTH_MAX) {
+							mCtx.set_error(EvalError::BAD_YIELD);
+						} else if (mCtx.get_error() == EvalError::NONE) {
+							suspend(ticks, false);
+						}
+						i = cnt;
+					}
+					break;
+				case CodeItem::Form::DEFVAR:
+					if (i + 1 < cnt) {
+						CodeItem* pVarNameItem = pItem + 1;
+						if (pVarNameItem->is_sym()) {
+							const char* pVarName = pVarNameItem->val.sym;
+							int varId = mCtx.add_var(pVarName);
+							if (varId >= 0) {
+								Value* pVarVal = mCtx.var_val(varId);
+								if (i + 2 < cnt) {
+									val = eval_sub(pLst, 2, 1);
+									i += 2;
+									if (pVarVal) {
+										*pVarVal = val;
+									}
+								} else {
+									++i;
+									pVarVal->set_none();
+								}
+							} else {
+								mCtx.set_error(EvalError::VAR_CTX_ADD);
+							}
+						} else {
+							mCtx.set_error(EvalError::VAR_SYM);
+						}
+					} else {
+						mCtx.set_error(EvalError::BAD_VAR_CLAUSE);
+					}
+					break;
+				case CodeItem::Form::SET:
+					if (i + 1 < cnt) {
+						CodeItem* pVarNameItem = pItem + 1;
+						// parameters of the running function are assigned in its frame
+						Value* pVal = pVarNameItem->is_arg() ? &mpCall->args[pVarNameItem->val.inum] : mCtx.var_val(resolve_var(pVarNameItem));
+						if (pVal) {
+							if (i + 2 < cnt) {
+								val = eval_sub(pLst, 2, 1);
+								*pVal = val;
+								i += 2;
+							}
+						} else {
+							mCtx.set_error(EvalError::VAR_NOT_FOUND);
+						}
+					}
+					break;
+				case CodeItem::Form::EQ:
+					if (i + 2 < cnt) {
+						Value valA, valB;
+						valA = eval_sub(pLst, 1, 1);
+						valB = eval_sub(pLst, 2, 1);
+						i += 2;
+						if (valA.is_str() && valB.is_str()) {
+							val.set_int(str_eq(valA, valB) ? 1 : 0);
+							i = cnt;
+						} else {
+							mCtx.set_error(EvalError::BAD_OPERAND_TYPE_STR);
+						}
+					} else {
+						mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
+					}
+					break;
+				case CodeItem::Form::NE:
+					if (i + 2 < cnt) {
+						Value valA, valB;
+						valA = eval_sub(pLst, 1, 1);
+						valB = eval_sub(pLst, 2, 1);
+						i += 2;
+						if (valA.is_str() && valB.is_str()) {
+							val.set_int(str_eq(valA, valB) ? 0 : 1);
+							i = cnt;
+						} else {
+							mCtx.set_error(EvalError::BAD_OPERAND_TYPE_STR);
+						}
+					} else {
+						mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
+					}
+					break;
+				case CodeItem::Form::AND:
+				case CodeItem::Form::OR:
+					val = eval_logic(pLst, cnt, form == CodeItem::Form::OR);
+					i = cnt;
+					break;
+				case CodeItem::Form::LIST: {
+						ListHead* pNewLst = mCtx.new_list(cnt - i - 1);
+						if (pNewLst) {
+							for (uint32_t j = i + 1; j < cnt; ++j) {
+								pNewLst->items()[j - i - 1] = eval_sub(pLst, j, 1);
+							}
+							pNewLst->seal();
+							val.set_list(pNewLst);
+						}
+						i = cnt;
+					}
+					break;
+				case CodeItem::Form::LGET:
+				case CodeItem::Form::DOT:
+					if (i + 2 < cnt) {
+						Value valA = eval_sub(pLst, i + 1, 1);
+						Value valB = eval_sub(pLst, i + 2, 1);
+						if (mCtx.get_error() == EvalError::NONE) {
+														val = form == CodeItem::Form::DOT ? list_dot(mCtx, valA, valB) : list_get(mCtx, valA, valB);
+						}
+					} else {
+						mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
+					}
+					i = cnt;
+					break;
+				case CodeItem::Form::LSET:
+					// (lset var idx item): var gets a copy of its list with the item replaced or appended
+					if (i + 3 < cnt) {
+						if (pItem[1].is_sym() || pItem[1].is_arg()) {
+							Value idxVal = eval_sub(pLst, i + 2, 1);
+							val = eval_sub(pLst, i + 3, 1);
+							int varId = pItem[1].is_arg() ? -1 : resolve_var(&pItem[1]);
+							Value* pVal = nullptr;
+							if (mCtx.get_error() == EvalError::NONE) {
+								pVal = pItem[1].is_arg() ? &mpCall->args[pItem[1].val.inum] : mCtx.var_val(varId);
+							}
+							if (pVal) {
+								if (mpReadMask && varId >= 0 && varId < int(READ_MASK_SIZE * 64)) {
+									XD_BIT_ARY_ST(uint64_t, mpReadMask, varId);
+								}
+								Value lstVal = list_set(mCtx, *pVal, idxVal, val);
+								if (lstVal.is_list()) {
+									*pVal = lstVal;
+								}
+							} else if (mCtx.get_error() == EvalError::NONE) {
+								mCtx.set_error(EvalError::VAR_NOT_FOUND);
+							}
+						} else {
+							mCtx.set_error(EvalError::VAR_SYM);
+						}
+					} else {
+						mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
+					}
+					i = cnt;
+					break;
+				case CodeItem::Form::NUMOP: {
+						const NumOpInfo& numOpInfo = s_numOp_tbl[pItem->numOp].opInfo;
+						Value valA;
+						Value valB;
+						if (i + 2 > cnt) {
+							mCtx.set_error(EvalError::BAD_OPERAND_COUNT);
+						} else if (i + 2 == cnt) {
+							valB = eval_sub(pLst, 1, 1);
+							if (numOpInfo.listOp == int32_t(ListOp::MIN) || numOpInfo.listOp == int32_t(ListOp::MAX)) {
+								// (min x) is x, (min lst) the smallest item
+								if (valB.is_list()) {
+									val = list_reduce(mCtx, ListOp(numOpInfo.listOp), valB);
+								} else if (valB.is_num()) {
+									val = valB;
+								}
+							} else {
+								valA.set_int(numOpInfo.unaryVal);
+								val = numOpInfo.apply(mCtx, valA, valB);
+							}
+
+							++i;
+						} else {
+							val = (this->*numOpInfo.kernel)(pLst, cnt, numOpInfo);
+							i = cnt;
+						}
+					}
+					break;
+				default:
+					if ((pFunc = find_func(pItem)) != nullptr) {
+						uint32_t n = cnt - i - 1;
+						Value args[FuncDef::MAX_ARGS];
+						uint32_t nargs = nxCalc::min(n, FuncDef::MAX_ARGS);
+
+						for(uint32_t j = 0; j < nargs; ++j) {
+							args[j] = eval_sub(pLst, i + j + 1, 1);
+							PINT_DBG_MSG("Arg %d : %f\n", j, args[j].get_num());
+						}
+
+						i += n;
+
+						if (pFunc->pScript) {
+							if (n != pFunc->nargs) {
+								mCtx.set_error(EvalError::BAD_FUNC_ARGS);
+							} else if (mpCall && pLst->is_tail()) {
+								// the caller's value is this call's value: its frame is reused once its body returns
+								for (uint32_t j = 0; j < nargs; ++j) {
+									mpCall->args[j] = args[j];
+								}
+								mpCall->pTail = pFunc->pScript;
+							} else {
+								val = call_script(pFunc->pScript, nargs, args);
+							}
+						} else if (mpFuncLib->check_func_args(*pFunc, nargs, args)) {
+							val = mpFuncLib->invoke(*pFunc, mCtx, nargs, args);
+						} else {
+							mCtx.set_error(EvalError::BAD_FUNC_ARGS);
+						}
+					} else { // variable name
+						int varId = resolve_var(pItem);
+						const Value* pVal = mCtx.get_val(varId);
+						if (pVal) {
+							val = *pVal;
+							if (mpReadMask && varId < int(READ_MASK_SIZE * 64)) {
+								XD_BIT_ARY_ST(uint64_t, mpReadMask, varId);
+							}
+						} else {
+							mCtx.set_error(EvalError::VAR_NOT_FOUND);
+						}
+					}
+					break;
+			}
+		} else if (pItem->is_arg()) {
+			val = mpCall->args[pItem->val.inum];
+		} else if (pItem->is_int()) {
+			val.set_int(pItem->val.inum);
+		} else if (pItem->is_num()) {
+			val.set_num(pItem->val.num);
+		} else if (pItem->is_str() && pItem->val.pStr) {
+			// literals are interned by the parser, function bodies keep their own copies
+			val = mpCall ? mCtx.intern(pItem->val.pStr) : str_value(pItem->val.pStr);
+		}
+
+		if (mCtx.get_error() != EvalError::NONE || mCtx.suspended()) {
+			i = cnt;
+		}
+	}
+	if (slice == 0) {
+		--mLevel;
+	}
+	return val;
+}
+
+void CodeBlock::suspend(const uint32_t wait, const bool preempt) {
+	Frame* pFrame = mCtx.get_frame();
+	pFrame->depth = uint8_t(mLevel);
+	pFrame->wait = wait;
+	pFrame->preempt = preempt ? 1 : 0;
+	for (uint32_t i = 0; i + 1 < mLevel; ++i) {
+		pFrame->path[i] = mPath[i];
+		pFrame->iter[i] = mIter[i];
+	}
+	mCtx.set_break();
+}
+
+// (while cond forms...), (dotimes (var count) forms...), (dolist (var list) forms...): the forms run
+// on the parsed list every iteration, the value is that of the last form evaluated. In a statement
+// position a loop is suspended by yield/wait in its forms, and by the budget before its next
+// iteration, and carries on from there when the script is resumed; the count or the list is then
+// evaluated again. Elsewhere (operands, function bodies) the budget running out stops the loop
+// with LOOP_BUDGET. (break) ends the loop, and the script as usual.
+Value CodeBlock::eval_loop(CodeList* pLst, const uint32_t cnt, const bool stmt, const uint32_t resumeAt) {
+	static const uint32_t BODY = 2;
+	Value val;
+	val.set_none();
+	CodeItem* pItems = pLst->get_items();
+	const bool isWhile = pItems[0].val.sym[0] == 'w';
+	const bool isList = pItems[0].val.sym[2] == 'l';
+	const uint32_t lvl = mLevel - 1;
+	uint32_t iter = resumeAt > 0 && lvl < Frame::DEPTH_MAX - 1 ? mCtx.get_frame()->iter[lvl] : 0;
+	uint32_t num = 0;
+	const ListHead* pRange = nullptr;
+	const CodeItem* pVar = nullptr;
+	int varId = -1;
+	if (cnt < BODY) {
+		mCtx.set_error(EvalError::BAD_LOOP_CLAUSE);
+		return val;
+	}
+	if (!isWhile) {
+		CodeList* pHead = pItems[1].is_list() ? pItems[1].val.pLst : nullptr;
+		pVar = pHead && pHead->count() == 2 ? pHead->get_items() : nullptr;
+		if (!pVar || !(pVar->is_sym() || pVar->is_arg())) {
+			mCtx.set_error(EvalError::BAD_LOOP_CLAUSE);
+			return val;
+		}
+		// not on the way to the suspended form
+		const bool resume = mResume;
+		mResume = false;
+		Value range = eval_sub(pHead, 1, 1);
+		mResume = resume;
+		if (isList) {
+			if (range.is_list()) {
+				pRange = range.get_list();
+				num = pRange->count;
+			} else {
+				mCtx.set_error(EvalError::BAD_OPERAND_TYPE_LST);
+			}
+		} else if (range.is_num()) {
+			num = uint32_t(nxCalc::clamp(range.get_num(), 0.0, double(UINT32_MAX)));
+		} else {
+			mCtx.set_error(EvalError::BAD_OPERAND_TYPE_NUM);
+		}
+		if (pVar->is_sym()) {
+			varId = mCtx.add_var(pVar->val.sym);
+			if (varId < 0) {
+				mCtx.set_error(EvalError::VAR_CTX_ADD);
+			}
+		}
+	}
+	uint32_t from = resumeAt > 1 ? resumeAt : BODY;
+	bool top = resumeAt <= 1;
+	bool check = resumeAt == 0;
+	while (mCtx.get_error() == EvalError::NONE && !mCtx.should_break()) {
+		if (top) {
+			// the back edge
+			if (check && iter > 0 && mCtx.budget_spent()) {
+				if (stmt && mLevel < Frame::DEPTH_MAX) {
+					// resumed at item 1, the top of the iteration
+					mPath[lvl] = 1;
+					mIter[lvl] = iter;
+					++mLevel;
+					suspend(0, true);
+					--mLevel;
+				} else {
+					mCtx.set_error(EvalError::LOOP_BUDGET);
+				}
+				break;
+			}
+			check = true;
+			if (isWhile) {
+				if (!value_true(eval_sub(pLst, 1, 1)) || mCtx.get_error() != EvalError::NONE) break;
+			} else {
+				if (iter >= num) break;
+				Value* pVal = pVar->is_arg() ? &mpCall->args[pVar->val.inum] : mCtx.var_val(varId);
+				if (pVal) {
+					if (pRange) {
+						*pVal = pRange->items()[iter];
+					} else {
+						pVal->set_int(int64_t(iter));
+					}
+				}
+			}
+		}
+		if (lvl < Frame::DEPTH_MAX) {
+			mIter[lvl] = iter;
+		}
+		for (uint32_t j = from; j < cnt && mCtx.get_error() == EvalError::NONE && !mCtx.should_break(); ++j) {
+			val = eval_sub(pLst, j, 1, stmt);
+		}
+		from = BODY;
+		top = true;
+		++iter;
+	}
+	return val;
+}
+
+// Registered functions first, then script functions. A miss is cached together with the number of
+// script functions at the time (FUNC_NONE - count): the name is looked up again after a defun.
+// Call sites in function bodies are shared, threads resolving one at the same time store the same index.
+const FuncDef* CodeBlock::find_func(CodeItem* pItem) const {
+	if (!mpFuncLib) return nullptr;
+	if (!mpFuncLib->is_frozen()) {
+		const FuncDef* pFunc = mpFuncLib->find_func(pItem->val.sym);
+		return pFunc ? pFunc : mpFuncLib->get_func(mpFuncLib->find_script(pItem->val.sym));
+	}
+	int32_t none = CodeItem::FUNC_NONE - int32_t(mpFuncLib->get_script_count());
+	if (pItem->func == CodeItem::FUNC_UNRESOLVED || (pItem->func <= CodeItem::FUNC_NONE && pItem->func != none)) {
+		int idx = mpFuncLib->find_index(pItem->val.sym);
+		if (idx < 0) {
+			idx = mpFuncLib->find_script(pItem->val.sym);
+		}
+		pItem->func = idx < 0 ? none : int32_t(idx);
+	}
+	return pItem->func >= 0 ? mpFuncLib->get_func(pItem->func) : nullptr;
+}
+
+// Function bodies are shared by every context calling the function, their names are looked up each time.
+int CodeBlock::resolve_var(CodeItem* pItem) {
+	if (mpCall || !pItem->is_sym()) return mCtx.find_var(pItem->val.sym);
+	uint32_t gen = mCtx.get_scope_gen();
+	if (pItem->var < 0 || pItem->varGen != gen) {
+		pItem->var = mCtx.find_var(pItem->val.sym);
+		pItem->varGen = gen;
+	}
+	return pItem->var;
+}
+
+// (defun name (params) forms): a call evaluates the forms in order, the last one gives the value.
+// Every context running the script defines the function again, the body is only copied if it changed.
+void CodeBlock::eval_defun(CodeList* pLst) {
+	uint32_t cnt = pLst->count();
+	const CodeItem* pItems = pLst->get_items();
+	bool ok = mpFuncLib && !mpCall && cnt > 3 && pItems[1].is_sym() && pItems[2].is_list();
+	const CodeList* pParams = ok ? pItems[2].val.pLst : nullptr;
+	ok = ok && pParams->count() <= FuncDef::MAX_ARGS;
+	for (uint32_t i = 0; ok && i < pParams->count(); ++i) {
+		ok = pParams->get_items()[i].is_sym();
+	}
+	if (!ok) {
+		mCtx.set_error(EvalError::BAD_DEFUN);
+		return;
+	}
+	const FuncDef* pDef = mpFuncLib->get_func(mpFuncLib->find_script(pItems[1].val.sym));
+	if (pDef && script_eq(pDef->pScript, pItems, cnt)) return;
+	ScriptFunc* pFunc = script_create(pItems, cnt);
+	if (!pFunc || mpFuncLib->define_script(pFunc) < 0) {
+		if (pFunc) {
+			script_destroy(pFunc);
+		}
+		mCtx.set_error(EvalError::BAD_DEFUN);
+	}
+}
+
+Value CodeBlock::call_script(const ScriptFunc* pFunc, const uint32_t nargs, const Value* pArgs) {
+	Value val;
+	val.set_none();
+	CallFrame frame;
+	frame.depth = mpCall ? mpCall->depth + 1 : 1;
+	if (frame.depth > CALL_DEPTH_MAX) {
+		mCtx.set_error(EvalError::CALL_DEPTH);
+		return val;
+	}
+	for (uint32_t i = 0; i < nargs; ++i) {
+		frame.args[i] = pArgs[i];
+	}
+	frame.pTail = nullptr;
+	frame.pPrev = mpCall;
+	mpCall = &frame;
+	while (pFunc) {
+		CodeList* pBody = &pFunc->pLists[0];
+		for (uint32_t i = 0; i < pBody->count() && mCtx.get_error() == EvalError::NONE; ++i) {
+			val = eval_sub(pBody, i, 1);
+		}
+		pFunc = frame.pTail;
+		frame.pTail = nullptr;
+	}
+	mpCall = frame.pPrev;
+	return val;
+}
+
+void CodeBlock::eval(const bool resume) {
+	mCtx.set_error(EvalError::NONE);
+	mLevel = 0;
+	mResume = resume && mCtx.suspended();
+	eval_sub(&mLists[0], 0, 0, true);
+	if (mResume) {
+		// the line no longer leads to the suspended form
+		mResume = false;
+		mCtx.get_frame()->depth = 0;
+	}
+}
+
+void CodeBlock::print_sub(const CodeList* pLst, int lvl) const {
+	CodeItem* pItems = pLst->get_items();
+	uint32_t sz = pLst->count();
+	for (uint32_t i = 0; i < sz; ++i) {
+		const CodeItem& item = pItems[i];
+		if (item.is_list()) {
+			PINT_DBG_MSG("%*c" FMT_B_BLUE "- LST" FMT_OFF " %p\n", lvl, ' ', item.val.pLst);
+			print_sub(item.val.pLst, lvl+1);
+		} else if (item.is_int()) {
+			PINT_DBG_MSG("%*c" FMT_B_GREEN "INT" FMT_OFF " %lld\n", lvl, ' ', (long long)item.val.inum);
+		} else if (item.is_num()) {
+			PINT_DBG_MSG("%*c" FMT_B_GREEN "NUM" FMT_OFF " %f\n", lvl, ' ', item.val.num);
+		} else if (item.is_sym()) {
+			PINT_DBG_MSG("%*c" FMT_B_GREEN "SYM" FMT_OFF " %s\n", lvl, ' ', item.val.sym);
+		} else if (item.is_str()) {
+			PINT_DBG_MSG("%*c" FMT_B_GREEN "STR" FMT_B_YELLOW " \"%s\"" FMT_OFF "\n", lvl, ' ', item.val.pStr);
+		} else if (item.is_arg()) {
+			PINT_DBG_MSG("%*c" FMT_B_GREEN "ARG" FMT_OFF " %d\n", lvl, ' ', int(item.val.inum));
+		}
+	}
+}
+
+void CodeBlock::print() const {
+	if (mListCnt == 0) return;
+	PINT_DBG_MSG("# lists: %d\n", mListCnt);
+	print_sub(mLists, 1);
+}
+
+void CodeBlock::from_tokens(cxLexer::Token* pTop, const size_t ntok) {
+	reset();
+	if (pTop) {
+		for (size_t i = 0; i < ntok; ++i) {
+			bool tokRes = (*this)(pTop[i]);
+			if (!tokRes) break;
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CodeItem::set_none() {
+	type = Type::NON;
+	val.num = 0;
+}
+bool CodeItem::is_none() const {
+	return type == Type::NON;
+}
+
+void CodeItem::set_sym(const char* pStr) {
+	type = Type::SYM;
+	func = FUNC_UNRESOLVED;
+	size_t sz = nxCalc::clamp(nxCore::str_len(pStr), size_t(0), Value::SYM_MAX_LEN);
+	nxCore::mem_copy(val.sym, pStr, sz);
+	val.sym[sz] = '\x0';
+	numOp = 0;
+	form = sym_form(val.sym, &numOp);
+	var = -1;
+	varGen = 0;
+}
+bool CodeItem::is_sym() const {
+	return type == Type::SYM;
+}
+
+void CodeItem::set_num(double num) {
+	type = Type::NUM;
+	val.num = num;
+}
+bool CodeItem::is_num() const {
+	return type == Type::NUM;
+}
+
+void CodeItem::set_int(int64_t num) {
+	type = Type::INT;
+	val.inum = num;
+}
+
+bool CodeItem::is_int() const {
+	return type == Type::INT;
+}
+
+void CodeItem::set_str(const char* pStr) {
+	type = Type::STR;
+	val.pStr = pStr;
+}
+bool CodeItem::is_str() const {
+	return type == Type::STR;
+}
+
+void CodeItem::set_list(CodeList* pLst) {
+	type = Type::LST;
+	val.pLst = pLst;
+}
+bool CodeItem::is_list() const {
+	return type == Type::LST;
+}
+
+void CodeItem::set_arg(uint32_t slot) {
+	type = Type::ARG;
+	val.inum = int64_t(slot);
+}
+bool CodeItem::is_arg() const {
+	return type == Type::ARG;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CodeList::init() {
+	if (mpItems) {
+		size_t sz = mCapacity * sizeof(CodeItem);
+		nxCore::mem_zero(mpItems, sz);
+	} else {
+		mCapacity = 0;
+	}
+	mCount = 0;
+}
+
+void CodeList::reset() {
+	if (mpItems) {
+		if (mpItems != mItems) {
+			s_memLock.acquire();
+			nxCore::mem_free(mpItems);
+			s_memLock.release();
+		}
+		mpItems = nullptr;
+	}
+	mCount = 0;
+	mCapacity = 0;
+	mTail = false;
+}
+
+bool CodeList::valid() const {
+	return (mpItems != nullptr);
+}
+
+void CodeList::append(const CodeItem& itm) {
+	if (mpItems == nullptr) {
+#if 0
+		size_t sz = mChunkSize * sizeof(CodeItem);
+		s_memLock.acquire();
+		mpItems = reinterpret_cast<CodeItem*>(nxCore::mem_alloc(sz));
+		s_memLock.release();
+		mCapacity = mChunkSize;
+#else
+		mpItems = mItems;
+		mCapacity = PINT_CL_CHUNK_SZ;
+#endif
+	}
+	if (mCount >= mCapacity) {
+		size_t newCap = mCapacity + mChunkSize;
+		size_t newSz = newCap * sizeof(CodeItem);
+		s_memLock.acquire();
+		CodeItem* pNewItems = reinterpret_cast<CodeItem*>(nxCore::mem_alloc(newSz));
+		s_memLock.release();
+		if (pNewItems) {
+			nxCore::mem_copy(pNewItems, mpItems, mCapacity * sizeof(CodeItem));
+			if (mpItems != mItems) {
+				s_memLock.acquire();
+				nxCore::mem_free(mpItems);
+				s_memLock.release();
+			}
+			mpItems = pNewItems;
+			mCapacity += mChunkSize;
+		}
+	}
+	mpItems[mCount++] = itm;
+}
+
+CodeItem* CodeList::get_items() const {
+	return mpItems;
+}
+
+uint32_t CodeList::count() const {
+	return mCount;
+}
+
+uint32_t CodeList::capacity() const {
+	return mCapacity;
+}
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CodeList* ListStack::top() {
+	return ptr - 1 < 0 ? nullptr : lists[ptr - 1];
+}
+
+void ListStack::push(CodeList* pLst) {
+	if (ptr < CODE_LST_MAX) {
+		lists[ptr++] = pLst;
+	}
+}
+
+CodeList* ListStack::pop() {
+	CodeList* pList = top();
+	if (pList) {
+		ptr--;
+	}
+	return pList;
+}
+
+} // Pint
+
@@ -1,295 +1,1108 @@
-namespace Pint {
-
-struct CodeItem;
-class CodeList;
-struct ListStack;
-class ExecContext;
-
-class SrcCode {
-protected:
-	const char* mpSrc;
-	size_t mSrcSize;
-
-	size_t mSrcLoc;
-	size_t mLineLoc;
-	size_t mLineNo;
-
-public:
-	struct Line {
-		const char* pText;
-		size_t textSize;
-		size_t no;
-
-		bool valid() const;
-
-		void print() const;
-	};
-
-	SrcCode(const char* pSrc, size_t srcSize);
-
-	~SrcCode() {}
-
-	void restart();
-
-	bool eof() const;
-
-	Line get_line();
-
-	void make_cache_key(char* pBuf, const size_t bufSize);
-
-	const char* get_source();
-
-	size_t source_size() const;
-};
-
-struct Value {
-	static const size_t SYM_MAX_LEN = 63;
-
-	enum class Type : uint32_t {
-		NON = 0,
-		NUM,
-		STR
-	};
-
-	union {
-		const char* pStr;
-		double num;
-	} val;
-
-	Type type;
-
-	void set_none();
-	bool is_none() const;
-
-	void set_num(double num);
-	bool is_num() const;
-
-	void set_str(const char* pStr);
-	bool is_str() const;
-};
-
-enum class EvalError : int32_t {
-	NONE = 0,
-	BAD_VAR_CLAUSE = 1,           // bad defvar/set clause structure
-	VAR_SYM = 2,                 // variable name should be a symbol
-	VAR_CTX_ADD = 3,             // can't add variable to the exec context
-	BAD_OPERAND_COUNT = 4,       // invalid operand type in calculation
-	BAD_OPERAND_TYPE_NUM = 5,    // invalid operand type: NUM expected
-	BAD_OPERAND_TYPE_SYM = 6,    // invalid operand type : SYM expected
-	BAD_OPERAND_TYPE_STR = 7,    // invalid operand type : STR expected
-	VAR_NOT_FOUND = 8,           // variable not found
-	BAD_IF_CLAUSE = 9,           // missing condition expression in if
-	BAD_FUNC_ARGS = 10,          // Bad argument number or arguments types for a function call
-};
-
-typedef Value (*Func)(ExecContext& ctx, const uint32_t nargs, Value* pArgs);
-
-struct FuncDef {
-	static const uint32_t MAX_ARGS = 10;
-	const char* pName;
-	Func func;
-	uint32_t nargs;
-	Value::Type resultType;
-	Value::Type argTypes[MAX_ARGS];
-};
-
-class FuncLibrary {
-protected:
-	typedef cxStrMap<FuncDef> FuncMap;
-
-	FuncMap* mpFuncMap;
-public:
-	FuncLibrary();
-	~FuncLibrary();
-
-	void init();
-	void reset();
-	bool register_func(const FuncDef* pFuncDef, const uint32_t nfunc);
-	bool register_func(const FuncDef& def);
-
-	bool find(const char* pName, FuncDef* pDef);
-	bool check_func_args(const FuncDef& def, const uint32_t nargs, const Value* pArgs);
-
-	static FuncLibrary* create_default();
-};
-
-class ExecContext {
-protected:
-	typedef cxStrMap<int> VarMap;
-	static const size_t CODE_VAR_MAX = 256;
-
-	cxStrStore* mpStrs;
-	VarMap* mpVarMap;
-	void* mpBinding;
-	Value mVarVals[CODE_VAR_MAX];
-	const char* mpVarNames[CODE_VAR_MAX];
-	size_t mVarCnt;
-	EvalError mErrCode;
-	bool mBreak;
-public:
-
-	ExecContext();
-	~ExecContext();
-
-	void init(void* pBinding = nullptr);
-	void reset();
-
-	char* add_str(const char* pStr);
-
-	int add_var(const char* pName);
-	int find_var(const char* pName) const;
-
-	Value* var_val(int id);
-	Value* var_val(const char* pName);
-
-	double get_num_val(const char* pVarName, const double defVal = 0.0);
-
-	void clear_vars();
-	void print_vars();
-
-	void set_break(const bool brk = true);
-	bool should_break() const;
-
-	void set_error(const EvalError errCode);
-	EvalError get_error() const;
-	void print_error() const;
-
-	void set_local_binding(void* pBinding);
-	void* get_local_binding();
-};
-
-struct CodeItem {
-	static const size_t SYM_MAX_LEN = 63;
-
-	enum class Type : uint32_t {
-		NON = 0,
-		SYM,
-		NUM,
-		STR,
-		LST
-	};
-
-	union {
-		char sym[SYM_MAX_LEN+1];
-		const char* pStr;
-		CodeList* pLst;
-		double num;
-	} val;
-
-	Type type;
-
-	void set_none();
-	bool is_none() const;
-
-	void set_sym(const char* pStr);
-	bool is_sym() const;
-
-	void set_num(double num);
-	bool is_num() const;
-
-	void set_str(const char* pStr);
-	bool is_str() const;
-
-	void set_list(CodeList* pLst);
-	bool is_list() const;
-};
-
-#if !defined(PINT_CL_CHUNK_SZ)
-	#define PINT_CL_CHUNK_SZ 16
-#endif
-
-class CodeList {
-protected:
-	CodeItem* mpItems;
-	uint32_t mChunkSize;
-	uint32_t mCount;
-	uint32_t mCapacity;
-	CodeItem mItems[PINT_CL_CHUNK_SZ];
-
-public:
-	CodeList(const uint32_t chunkSize = PINT_CL_CHUNK_SZ) // ifndef macro
-	:
-	mpItems(nullptr),
-	mChunkSize(chunkSize),
-	mCount(0),
-	mCapacity(0)
-	{
-		init();
-	}
-
-	~CodeList() {
-		reset();
-	}
-
-	void init();
-
-	void reset();
-
-	bool valid() const;
-
-	void append(const CodeItem& itm);
-
-	CodeItem* get_items() const;
-
-	uint32_t count() const;
-	uint32_t capacity() const;
-};
-
-struct ListStack {
-	static const int CODE_LST_MAX = 256;
-
-	CodeList* lists[CODE_LST_MAX];
-	int ptr;
-
-	void reset() { ptr = 0; }
-
-	CodeList* top();
-
-	void push(CodeList* pLst);
-
-	CodeList* pop();
-};
-
-class CodeBlock : public cxLexer::TokenFunc {
-protected:
-	ExecContext& mCtx;
-	FuncLibrary* mpFuncLib;
-	ListStack mListStack;
-	CodeList mLists[ListStack::CODE_LST_MAX];
-	uint32_t mListCnt;
-
-	void print_sub(const CodeList* lst, int lvl = 0) const;
-
-	bool eval_numeric_values(CodeList* pLst, const uint32_t org, const uint32_t slice, Value* pValues);
-
-	Value eval_sub(CodeList* pLst, const uint32_t org = 0, const uint32_t slice = 0);
-
-public:
-	CodeBlock(ExecContext& ctx, FuncLibrary* pFuncLib = nullptr);
-
-	~CodeBlock();
-
-	CodeList* new_list();
-
-	virtual bool operator()(const cxLexer::Token& tok);
-
-	void parse(const SrcCode::Line& line);
-
-	void eval();
-
-	void init();
-
-	void reset();
-
-	void print() const;
-
-	void from_tokens(cxLexer::Token* pTop, const size_t ntok);
-};
-
-void interp(const char* pSrc, size_t srcSize, ExecContext* pCtx, FuncLibrary* pFuncLib);
-
-void set_mem_lock(sxLock* pLock);
-
-void cache(const char* pSrc, size_t srcSize);
-
-} // Pint
+namespace Pint {
+
+struct CodeItem;
+class CodeList;
+struct ListStack;
+class ExecContext;
+class ContextPool;
+struct VarPage;
+struct VarTable;
+struct StrChain;
+struct StrHeap;
+struct GlobalState;
+struct GlobalVersion;
+struct GlobalStage;
+struct RngStream;
+struct SessionDefs;
+struct SchedState;
+struct FuncMemo;
+struct ListHead;
+struct ListBlock;
+struct NumOpInfo;
+struct ScriptFunc;
+struct ScriptTable;
+struct CallFrame;
+
+class SrcCode {
+protected:
+	const char* mpSrc;
+	size_t mSrcSize;
+
+	size_t mSrcLoc;
+	size_t mLineLoc;
+	size_t mLineNo;
+
+public:
+	struct Line {
+		const char* pText;
+		size_t textSize;
+		size_t no;
+
+		bool valid() const;
+
+		void print() const;
+	};
+
+	SrcCode(const char* pSrc, size_t srcSize);
+
+	~SrcCode() {}
+
+	void restart();
+
+	bool eof() const;
+
+	Line get_line();
+
+	void make_cache_key(char* pBuf, const size_t bufSize);
+
+	// the next get_line() returns the line starting at loc
+	void seek(const size_t loc, const size_t lineNo);
+
+	const char* get_source();
+
+	size_t source_size() const;
+};
+
+// NaN-boxed: floats are stored as doubles with NaNs canonicalized, the other types live in
+// the negative quiet NaN space, tag in the top 16 bits, 48-bit integers and string and list
+// pointers in the low bits. Integers are numbers too: is_num() and get_num() accept them,
+// get_type() tells them apart (NUM arguments of library functions accept INT).
+// Strings interned by an ExecContext carry their own tag, see str_eq().
+struct Value {
+	static const size_t SYM_MAX_LEN = 63;
+
+	enum class Type : uint32_t {
+		NON = 0,
+		NUM,
+		STR,
+		LST,
+		INT
+	};
+
+	static const uint64_t TAG_MASK = 0xFFFF000000000000ULL;
+	static const uint64_t TAG_INT = 0xFFF9000000000000ULL;
+	static const uint64_t TAG_NON = 0xFFFA000000000000ULL;
+	static const uint64_t TAG_LST = 0xFFFB000000000000ULL;
+	static const uint64_t TAG_STR = 0xFFFC000000000000ULL;
+	static const uint64_t TAG_ISTR = 0xFFFD000000000000ULL;
+	static const uint64_t TAG_STR_MASK = 0xFFFE000000000000ULL; // STR and ISTR
+	static const uint64_t NAN_BITS = 0x7FF8000000000000ULL;
+	static const int64_t INT_MAX_VAL = (int64_t(1) << 47) - 1;
+	static const int64_t INT_MIN_VAL = -(int64_t(1) << 47);
+
+	uint64_t bits;
+
+	void set_none() { bits = TAG_NON; }
+	bool is_none() const { return (bits & TAG_MASK) == TAG_NON; }
+
+	void set_num(double num) {
+		union { double d; uint64_t u; } cvt;
+		cvt.d = num;
+		bits = num == num ? cvt.u : NAN_BITS;
+	}
+	bool is_num() const { return bits < TAG_NON; }
+	bool is_float() const { return bits < TAG_INT; }
+	double get_num() const {
+		if (is_int()) return double(get_int());
+		union { uint64_t u; double d; } cvt;
+		cvt.u = bits;
+		return cvt.d;
+	}
+
+	// out of the 48-bit range the value is stored as a float
+	void set_int(const int64_t num) {
+		if (num >= INT_MIN_VAL && num <= INT_MAX_VAL) {
+			bits = TAG_INT | (uint64_t(num) & ~TAG_MASK);
+		} else {
+			set_num(double(num));
+		}
+	}
+	bool is_int() const { return (bits & TAG_MASK) == TAG_INT; }
+	int64_t get_int() const { return int64_t(bits << 16) >> 16; }
+
+	void set_str(const char* pStr) { bits = TAG_STR | uint64_t(uintptr_t(pStr)); }
+	bool is_str() const { return (bits & TAG_STR_MASK) == TAG_STR; }
+	bool is_interned() const { return (bits & TAG_MASK) == TAG_ISTR; }
+	const char* get_str() const { return reinterpret_cast<const char*>(uintptr_t(bits & ~TAG_MASK)); }
+
+	void set_list(const ListHead* pLst) { bits = TAG_LST | uint64_t(uintptr_t(pLst)); }
+	bool is_list() const { return (bits & TAG_MASK) == TAG_LST; }
+	const ListHead* get_list() const { return reinterpret_cast<const ListHead*>(uintptr_t(bits & ~TAG_MASK)); }
+
+	Type get_type() const {
+		if (is_float()) return Type::NUM;
+		switch (bits & TAG_MASK) {
+			case TAG_INT: return Type::INT;
+			case TAG_STR:
+			case TAG_ISTR: return Type::STR;
+			case TAG_LST: return Type::LST;
+			default: return Type::NON;
+		}
+	}
+};
+
+// List values are immutable arrays allocated in the arena of the context that made them,
+// items follow the head. Lists of floats are plain arrays of doubles, lists of integers are
+// converted as the kernels load them, see list_arith().
+struct ListHead {
+	static const uint32_t NUM_FLOATS = 1;
+	static const uint32_t NUM_INTS = 2;
+
+	uint32_t count;
+	uint32_t numeric; // NUM_FLOATS: every item is a float, NUM_INTS: every item is an integer
+
+	Value* items() { return reinterpret_cast<Value*>(this + 1); }
+	const Value* items() const { return reinterpret_cast<const Value*>(this + 1); }
+
+	// called once the items are filled in
+	void seal() {
+		const Value* pItems = items();
+		uint32_t nfloats = 0;
+		uint32_t nints = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (pItems[i].is_float()) {
+				++nfloats;
+			} else if (pItems[i].is_int()) {
+				++nints;
+			} else {
+				break;
+			}
+		}
+		numeric = nfloats == count ? NUM_FLOATS : nints == count ? NUM_INTS : 0;
+	}
+};
+
+enum class EvalError : int32_t {
+	NONE = 0,
+	BAD_VAR_CLAUSE = 1,           // bad defvar/set clause structure
+	VAR_SYM = 2,                 // variable name should be a symbol
+	VAR_CTX_ADD = 3,             // can't add variable to the exec context
+	BAD_OPERAND_COUNT = 4,       // invalid operand type in calculation
+	BAD_OPERAND_TYPE_NUM = 5,    // invalid operand type: NUM expected
+	BAD_OPERAND_TYPE_SYM = 6,    // invalid operand type : SYM expected
+	BAD_OPERAND_TYPE_STR = 7,    // invalid operand type : STR expected
+	VAR_NOT_FOUND = 8,           // variable not found
+	BAD_IF_CLAUSE = 9,           // missing condition expression in if
+	BAD_FUNC_ARGS = 10,          // Bad argument number or arguments types for a function call
+	FUNC_NOT_FOUND = 11,         // function not found in the library
+	BAD_YIELD = 12,              // yield/wait outside of a statement position or nested too deep
+	BAD_LIST_LENGTH = 13,        // element-wise operation on lists of different lengths
+	BAD_LIST_INDEX = 14,         // list index out of range
+	BAD_OPERAND_TYPE_LST = 15,   // invalid operand type : LST expected
+	BAD_DEFUN = 16,              // bad defun clause, or the function can't be defined
+	CALL_DEPTH = 17,             // calls to script functions nested too deep
+	BAD_LOOP_CLAUSE = 18,        // bad while/dotimes/dolist clause structure
+	LOOP_BUDGET = 19,            // the budget ran out in a loop that can't be suspended
+};
+
+typedef Value (*Func)(ExecContext& ctx, const uint32_t nargs, Value* pArgs);
+
+struct FuncDef {
+	static const uint32_t MAX_ARGS = 10;
+	const char* pName;
+	Func func;
+	uint32_t nargs;
+	Value::Type resultType;
+	Value::Type argTypes[MAX_ARGS];
+	bool typed; // generated by bind_func: func checks the argument types itself
+	bool pure;  // the result depends only on the arguments, see FuncLibrary::set_memo
+	const ScriptFunc* pScript; // defun: func is nullptr, the calling CodeBlock evaluates the body
+};
+
+class FuncLibrary {
+protected:
+	typedef cxStrMap<int> FuncMap;
+
+	FuncMap* mpFuncMap;  // name -> index in mpFuncs
+	FuncDef* mpFuncs;
+	uint32_t mFuncNum;
+	uint32_t mFuncCap;
+	// frozen: collision-free table over the names, see freeze()
+	int32_t* mpSlots;
+	uint32_t* mpSeeds;
+	uint32_t mSlotMask;
+	uint32_t mBucketMask;
+	FuncMemo* mpMemo;
+	ScriptTable* mpScripts;
+
+	bool build_slots(const uint32_t nslots, const uint32_t nbuckets);
+
+public:
+	static const int SCRIPT_BASE = 1 << 24; // indices of script functions
+	static const uint32_t SCRIPT_MAX = 256;
+
+	FuncLibrary();
+	~FuncLibrary();
+
+	void init();
+	void reset();
+	bool register_func(const FuncDef* pFuncDef, const uint32_t nfunc);
+	bool register_func(const FuncDef& def);
+
+	bool find(const char* pName, FuncDef* pDef);
+	bool check_func_args(const FuncDef& def, const uint32_t nargs, const Value* pArgs);
+
+	// Functions can't be registered after freeze(): the library is immutable and can be shared
+	// between threads, indices returned by find_index() stay valid and may be cached by call sites.
+	bool freeze();
+	bool is_frozen() const;
+
+	// -1 if there is no such function
+	int find_index(const char* pName) const;
+	const FuncDef* get_func(const int idx) const;
+	uint32_t get_func_count() const;
+	// pointers into an unfrozen library are invalidated by register_func
+	const FuncDef* find_func(const char* pName) const;
+
+	struct MemoStats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions; // entries replaced by a different call
+	};
+
+	// Results of pure functions are cached by their arguments in a table of capacity entries
+	// (rounded up to a power of 2) shared by all contexts, 0 disables the cache. Calls with
+	// string arguments, or string or list results, aren't cached. Set it up before sharing
+	// the library.
+	bool set_memo(const uint32_t capacity);
+	void clear_memo();
+	MemoStats get_memo_stats() const;
+
+	// calls def.func, through the memo cache for pure functions; def must come from this library
+	Value invoke(const FuncDef& def, ExecContext& ctx, const uint32_t nargs, Value* pArgs);
+
+	// Functions defined by scripts with defun. They're shared by all the contexts using the library,
+	// can be defined from any thread once the library is initialized, and are kept until reset(); a
+	// definition replaced by a later defun stays valid for the calls still running it. Their indices
+	// start at SCRIPT_BASE and are accepted by get_func(), find_index() doesn't return them.
+	// define_script takes pFunc over, -1 if it can't be defined: the name belongs to a registered
+	// function, SCRIPT_MAX functions are defined or the library isn't initialized.
+	int define_script(ScriptFunc* pFunc);
+	int find_script(const char* pName) const;
+	uint32_t get_script_count() const;
+
+	static FuncLibrary* create_default();
+};
+
+// Variables shared by many contexts, e.g. the "Global" flags read by every NPC.
+// Values are kept in immutable versions: readers pin the current version and read it
+// without locking, writers publish a new version with a whole batch applied at once.
+// Versions are freed by writers once nobody has them pinned.
+// Variables are declared by the host, contexts can only read and assign them.
+class GlobalStore {
+public:
+	static const size_t VAR_MAX = 128;
+
+protected:
+	GlobalState* mpState;
+
+	GlobalVersion* publish(GlobalVersion* pVer);
+
+public:
+	GlobalStore();
+	~GlobalStore();
+
+	void init(const char* pDomName = "Global");
+	// contexts must have been detached by then
+	void reset();
+
+	const char* get_domain_name() const;
+
+	int add_var(const char* pName, const Value* pVal = nullptr);
+	int find_var(const char* pName) const;
+	uint32_t get_var_count() const;
+	bool get(int idx, Value* pVal) const;
+
+	// all the values become visible together, strings are copied into the store
+	bool commit(const int* pIdx, const Value* pVals, const uint32_t n);
+
+	GlobalVersion* pin() const;
+	static void retain(GlobalVersion* pVer);
+	static void unpin(GlobalVersion* pVer);
+	static uint64_t get_serial(const GlobalVersion* pVer);
+	static int find_var(const GlobalVersion* pVer, const char* pName);
+	static const Value* get_val(const GlobalVersion* pVer, int idx);
+};
+
+// Position of a script suspended by (yield) or (wait N): the line and the item index
+// at every list level down to the yield form, with the iteration of the loops on the way.
+// Yields are only allowed where the result of the form is not used, so no operand
+// temporaries need to be kept.
+struct Frame {
+	static const uint32_t DEPTH_MAX = 8;
+
+	const char* pSrc;
+	uint32_t srcSize;
+	uint32_t lineLoc;
+	uint32_t lineNo;
+	uint32_t wait;    // resume() calls to skip
+	uint16_t path[DEPTH_MAX - 1];
+	uint32_t iter[DEPTH_MAX - 1];
+	uint8_t depth;    // level of the yield form, 0: not suspended
+	uint8_t preempt;  // stopped by the budget before the form at depth, which still has to run
+};
+
+class ExecContext {
+public:
+	static const size_t CODE_VAR_MAX = 256;
+	static const size_t VAR_PAGE_SIZE = 16;
+	static const size_t VAR_PAGE_NUM = CODE_VAR_MAX / VAR_PAGE_SIZE;
+	static const size_t DOMAIN_MAX = 16;
+	static const size_t DOMAIN_STACK_MAX = 8;
+	static const int ROOT_DOMAIN = 0;
+	static const int GLOBAL_ID_BASE = int(CODE_VAR_MAX);
+	static const uint64_t RNG_DEFAULT_SEED = 0x9E3779B97F4A7C15ULL;
+
+protected:
+	typedef cxStrMap<int> VarMap;
+
+	// Variable names and values are shared with forks and copied on write:
+	// values per page, the name table on the first add_var after a fork.
+	// Strings and lists are never copied, a fork freezes the current stores into the shared chain.
+	StrHeap* mpStrs;
+	ListBlock* mpLists;
+	StrChain* mpStrChain;
+	VarTable* mpVars;
+	VarPage* mpPages[VAR_PAGE_NUM];
+	void* mpBinding;
+	uint8_t mDomStack[DOMAIN_STACK_MAX]; // [0] is always the root domain
+	uint32_t mDomDepth;
+	uint32_t mScopeGen;
+	GlobalStore* mpGlobals;
+	GlobalVersion* mpGlbVer;
+	GlobalStage* mpGlbStage;
+	int mGlbDom;
+	ContextPool* mpPool;
+	uint32_t mPoolSlot;
+	Frame mFrame;
+	uint32_t mFuel;
+	double mDeadline;
+	bool mFuelLimit;
+	RngStream* mpRng;
+	EvalError mErrCode;
+	bool mBreak;
+
+	void release_vars();
+	void reset_domains();
+	void bind_globals();
+	void release_globals();
+	bool own_vars();
+public:
+
+	ExecContext();
+	~ExecContext();
+
+	void init(void* pBinding = nullptr);
+	void reset();
+
+	// Strings are interned: a string already in the context or in the stores it was forked from
+	// isn't added again. collect_strs() frees the strings no variable refers to; interp and
+	// Session run it between lines once the heap has doubled since the last collection, so
+	// a string kept only by the host or by another parsed CodeBlock may go away there.
+	const char* add_str(const char* pStr);
+	// add_str as an interned string value, none if pStr is nullptr
+	Value intern(const char* pStr);
+	// always = false: only if the heap has doubled since the last collection
+	void collect_strs(const bool always = true);
+
+	// New list of count none items, to be filled in and sealed before it's used as a value.
+	ListHead* new_list(const uint32_t count);
+	// the items must belong to this context: strings and lists are not copied
+	const ListHead* add_list(const Value* pItems, const uint32_t count);
+	// val with its strings and lists (deeply) copied into this context
+	Value copy_value(const Value& val);
+
+	// Variables live in domains (namespaces), the root domain has an empty name.
+	// Each domain keeps its own name map and a dense list of slots; variable ids stay
+	// dense across the whole context, get_domain_var maps a domain slot to its id.
+	int add_domain(const char* pName);
+	int find_domain(const char* pName) const;
+	const char* get_domain_name(int dom) const;
+	uint32_t get_domain_count() const;
+	uint32_t get_domain_var_count(int dom) const;
+	int get_domain_var(int dom, uint32_t slot) const;
+	int get_var_domain(int id) const;
+
+	// Names are resolved through the domain stack, innermost domain first, down to the root.
+	// set_domain makes the stack root + pName, missing domains are created.
+	bool set_domain(const char* pName);
+	bool push_domain(const char* pName);
+	bool pop_domain();
+	int get_domain() const;
+	uint32_t get_scope_depth() const;
+	int get_scope_domain(uint32_t lvl) const;
+
+	// changes whenever a name may resolve to a different id: the domain stack changed or a variable was added
+	uint32_t get_scope_gen() const;
+
+	// adds to the innermost domain, returns the existing id if the name is already there
+	int add_var(const char* pName);
+	int add_var(int dom, const char* pName);
+	int find_var(const char* pName) const;
+	int find_var(int dom, const char* pName) const;
+
+	// writable value, copies a shared page first
+	Value* var_val(int id);
+	Value* var_val(const char* pName);
+
+	const Value* get_val(int id) const;
+	const Value* get_val(const char* pName) const;
+
+	// local variables, globals are not counted
+	uint32_t get_var_count() const;
+	const char* get_var_name(int id) const;
+
+	// pDst becomes a copy-on-write clone of this context
+	void fork(ExecContext* pDst);
+
+	// Compact binary image of the variables and their domains, see pint.cpp for the layout.
+	// The domain stack is not stored, restore() leaves the root domain as the only scope.
+	// With pBase (a full snapshot of an ancestor state, baseSize bytes) only the variables that
+	// differ from it are stored. Returns the snapshot size, nothing is written if bufSize is too small.
+	size_t snapshot(void* pBuf, const size_t bufSize, const void* pBase = nullptr, const size_t baseSize = 0) const;
+	bool restore(const void* pSnap, const size_t snapSize, const void* pBase = nullptr, const size_t baseSize = 0);
+
+	// Variables of the store's domain resolve to the store, with ids from GLOBAL_ID_BASE.
+	// Reads see the version pinned by the last sync_globals() (set_globals pins the current one),
+	// assignments stay in the context until commit_globals() publishes them as one batch.
+	void set_globals(GlobalStore* pStore);
+	GlobalStore* get_globals() const;
+	void sync_globals();
+	bool commit_globals();
+	uint64_t get_globals_serial() const;
+
+	double get_num_val(const char* pVarName, const double defVal = 0.0);
+
+	void clear_vars();
+	void print_vars();
+
+	void set_break(const bool brk = true);
+	bool should_break() const;
+
+	bool suspended() const;
+	Frame* get_frame();
+
+	// Limits the work done by the following interp()/resume() calls: fuel is the number of
+	// lists to evaluate, micros the time from now; 0 disables a limit, (0, 0) disables both.
+	// When the budget runs out the script is suspended before its next statement.
+	void set_budget(const uint32_t fuel, const double micros = 0.0);
+	uint32_t get_fuel() const;
+	void burn_fuel();
+	bool budget_spent() const;
+	// suspended by the budget rather than by yield/wait
+	bool out_of_budget() const;
+
+	// Random numbers for the script, generated in blocks from a stream owned by the context.
+	// A fork continues the same sequence as its source, split_rng re-keys the stream into an
+	// independent one. Without seed_rng the stream starts from RNG_DEFAULT_SEED, so unseeded
+	// contexts give the same sequence on any thread.
+	void seed_rng(const uint64_t seed);
+	void split_rng(const uint64_t key);
+	uint64_t rng_next();
+	double rng_01();
+
+	void set_error(const EvalError errCode);
+	EvalError get_error() const;
+	void print_error() const;
+
+	void set_local_binding(void* pBinding);
+	void* get_local_binding();
+
+	// pooled variables are read and written in the pool's columns, see ContextPool
+	ContextPool* get_pool() const;
+	uint32_t get_pool_slot() const;
+
+	friend class ContextPool;
+};
+
+// Variables of many contexts stored by column: variable k of every context in the pool is one
+// contiguous array, so conditions over the whole pool are evaluated without visiting contexts.
+// Contexts join as forks of the pool's template and keep the usual ExecContext API: the
+// template's variables (ids below get_column_count()) live in the columns, variables added
+// later by a context stay in that context. Leaving the pool (remove, reset or clear_vars of
+// the context) copies the values back into the context. Adding and removing isn't thread-safe.
+class ContextPool {
+public:
+	static const uint32_t SLOT_ALIGN = 64;
+
+	enum class Cmp : uint32_t {
+		EQ = 0,
+		NE,
+		LT,
+		LE,
+		GT,
+		GE,
+		SET  // string, or non-zero number, as in check_flag
+	};
+
+protected:
+	ExecContext mTemplate;
+	Value* mpCols;          // mColNum columns of mCapacity values
+	ExecContext** mppCtxs;  // slot -> context, nullptr for free slots
+	uint32_t* mpFree;
+	uint32_t mColNum;
+	uint32_t mCapacity;     // multiple of SLOT_ALIGN
+	uint32_t mSlotNum;      // slots ever used
+	uint32_t mFreeNum;
+
+public:
+	ContextPool();
+	~ContextPool();
+
+	// the layout (variable ids, names and domains) and the initial values come from tmpl
+	bool init(ExecContext& tmpl, const uint32_t capacity);
+	void reset();
+
+	// pCtx becomes a fork of the template in a free slot, false if the pool is full
+	bool add(ExecContext* pCtx);
+	void remove(ExecContext* pCtx);
+
+	uint32_t get_capacity() const;
+	uint32_t get_column_count() const;
+	int find_column(const char* pName) const;
+	Value* get_column(int id) const;
+	Value* get_cell(int id, uint32_t slot) const;
+	ExecContext* get_context(uint32_t slot) const;
+
+	// Selections are bit masks over the slots, get_mask_size() words.
+	uint32_t get_mask_size() const;
+	uint32_t select_all(uint64_t* pSel) const;
+	// keeps the selected slots whose value of variable id satisfies the condition, returns
+	// how many are left; numeric comparisons are false for non-numbers
+	uint32_t filter(uint64_t* pSel, int id, const Cmp cmp, const double val = 0.0) const;
+	uint32_t count(const uint64_t* pSel) const;
+	// false if no selected slot has a number there
+	bool get_min(const uint64_t* pSel, int id, double* pRes) const;
+	bool get_max(const uint64_t* pSel, int id, double* pRes) const;
+	double get_sum(const uint64_t* pSel, int id) const;
+};
+
+// Element-wise list arithmetic. Either operand of list_arith may be a number, broadcast over
+// the other list; two lists must have the same length (BAD_LIST_LENGTH). Numeric lists go
+// through SSE2/AVX kernels when the build targets them, items that aren't numbers give none
+// like the scalar numeric ops. Results are new lists in ctx.
+enum class ListOp : uint32_t {
+	ADD,
+	SUB,
+	MUL,
+	DIV,
+	MIN,
+	MAX
+};
+
+Value list_arith(ExecContext& ctx, const ListOp op, const Value& valA, const Value& valB);
+// folds the items of a numeric list with op, none for an empty list
+Value list_reduce(ExecContext& ctx, const ListOp op, const Value& val);
+Value list_dot(ExecContext& ctx, const Value& valA, const Value& valB);
+// item idx, BAD_LIST_INDEX if it's out of range
+Value list_get(ExecContext& ctx, const Value& lst, const Value& idx);
+// copy of the list with item idx replaced, idx == count appends
+Value list_set(ExecContext& ctx, const Value& lst, const Value& idx, const Value& item);
+// deep comparison, numbers by value
+bool list_eq(const ListHead* pLstA, const ListHead* pLstB);
+// String values: two interned strings of one context are equal only if they're the same
+// pointer, other strings are compared by content.
+bool str_eq(const Value& valA, const Value& valB);
+
+// Typed bindings: plain C++ functions registered without a hand-written Func wrapper.
+//   static double fit(double x, double a, double b, double c, double d);
+//   funcLib.register_func(PINT_BIND_FUNC("math_fit", fit));
+//   funcLib.register_func(Pint::bind_func("twice", [](double x) { return x * 2.0; }));
+// Parameter and result types: double, float, int, bool (NUM; int, bool results are INT),
+// const char* (STR), const ListHead* (LST), Value (any type). void results are NON.
+// An ExecContext& first parameter receives the calling context. Lambdas must be captureless.
+// The wrapper and the FuncDef signature are generated at compile time; the wrapper checks
+// the argument types while unpacking them, so check_func_args passes typed functions through.
+
+template<typename T> struct ValueBind;
+
+template<> struct ValueBind<double> {
+	static const Value::Type TYPE = Value::Type::NUM;
+	static bool check(const Value& v) { return v.is_num(); }
+	static double get(const Value& v) { return v.get_num(); }
+	static void put(Value& v, const double x) { v.set_num(x); }
+};
+
+template<> struct ValueBind<float> {
+	static const Value::Type TYPE = Value::Type::NUM;
+	static bool check(const Value& v) { return v.is_num(); }
+	static float get(const Value& v) { return float(v.get_num()); }
+	static void put(Value& v, const float x) { v.set_num(double(x)); }
+};
+
+template<> struct ValueBind<int> {
+	static const Value::Type TYPE = Value::Type::NUM;
+	static bool check(const Value& v) { return v.is_num(); }
+	static int get(const Value& v) { return v.is_int() ? int(v.get_int()) : int(v.get_num()); }
+	static void put(Value& v, const int x) { v.set_int(x); }
+};
+
+template<> struct ValueBind<bool> {
+	static const Value::Type TYPE = Value::Type::NUM;
+	static bool check(const Value& v) { return v.is_num(); }
+	static bool get(const Value& v) { return v.get_num() != 0.0; }
+	static void put(Value& v, const bool x) { v.set_int(x ? 1 : 0); }
+};
+
+template<> struct ValueBind<const char*> {
+	static const Value::Type TYPE = Value::Type::STR;
+	static bool check(const Value& v) { return v.is_str(); }
+	static const char* get(const Value& v) { return v.get_str(); }
+	static void put(Value& v, const char* pStr) { v.set_str(pStr); }
+};
+
+template<> struct ValueBind<const ListHead*> {
+	static const Value::Type TYPE = Value::Type::LST;
+	static bool check(const Value& v) { return v.is_list(); }
+	static const ListHead* get(const Value& v) { return v.get_list(); }
+	static void put(Value& v, const ListHead* pLst) { v.set_list(pLst); }
+};
+
+template<> struct ValueBind<Value> {
+	static const Value::Type TYPE = Value::Type::NON;
+	static bool check(const Value&) { return true; }
+	static Value get(const Value& v) { return v; }
+	static void put(Value& v, const Value& x) { v = x; }
+};
+
+template<> struct ValueBind<const Value&> : ValueBind<Value> {};
+
+template<> struct ValueBind<void> {
+	static const Value::Type TYPE = Value::Type::NON;
+};
+
+template<typename R> struct BindResult {
+	template<typename FN, typename... P> static Value call(FN f, P&&... args) {
+		Value res;
+		ValueBind<R>::put(res, f(static_cast<P&&>(args)...));
+		return res;
+	}
+};
+
+template<> struct BindResult<void> {
+	template<typename FN, typename... P> static Value call(FN f, P&&... args) {
+		Value res;
+		f(static_cast<P&&>(args)...);
+		res.set_none();
+		return res;
+	}
+};
+
+template<uint32_t... I> struct BindIdx {};
+template<uint32_t N, uint32_t... I> struct BindIdxGen : BindIdxGen<N - 1, N - 1, I...> {};
+template<uint32_t... I> struct BindIdxGen<0, I...> { typedef BindIdx<I...> Type; };
+
+template<typename... A> struct BindArgs {
+	static const uint32_t NARGS = uint32_t(sizeof...(A));
+	typedef typename BindIdxGen<NARGS>::Type Idx;
+
+	template<uint32_t... I> static bool check(const uint32_t nargs, const Value* pArgs, BindIdx<I...>) {
+		const bool ok[] = { nargs >= NARGS, (I < nargs && ValueBind<A>::check(pArgs[I]))... };
+		bool res = true;
+		for (uint32_t i = 0; i < NARGS + 1; ++i) {
+			res &= ok[i];
+		}
+		return res;
+	}
+
+	static void describe(FuncDef* pDef) {
+		const Value::Type types[] = { Value::Type::NON, ValueBind<A>::TYPE... };
+		for (uint32_t i = 0; i < NARGS; ++i) {
+			pDef->argTypes[i] = types[i + 1];
+		}
+		pDef->nargs = NARGS;
+	}
+};
+
+template<typename FN> struct FuncBinder;
+
+template<typename R, typename... A> struct FuncBinder<R (*)(A...)> : BindArgs<A...> {
+	typedef BindArgs<A...> Args;
+	typedef R Result;
+
+	template<uint32_t... I> static Value invoke(R (*f)(A...), ExecContext& ctx, Value* pArgs, BindIdx<I...>) {
+		return BindResult<R>::call(f, ValueBind<A>::get(pArgs[I])...);
+	}
+};
+
+template<typename R, typename... A> struct FuncBinder<R (*)(ExecContext&, A...)> : BindArgs<A...> {
+	typedef BindArgs<A...> Args;
+	typedef R Result;
+
+	template<uint32_t... I> static Value invoke(R (*f)(ExecContext&, A...), ExecContext& ctx, Value* pArgs, BindIdx<I...>) {
+		return BindResult<R>::call(f, ctx, ValueBind<A>::get(pArgs[I])...);
+	}
+};
+
+template<typename FN> Value bind_call(FN f, ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	typedef FuncBinder<FN> Binder;
+	typedef typename Binder::Args::Idx Idx;
+	if (!Binder::Args::check(nargs, pArgs, Idx())) {
+		Value res;
+		res.set_none();
+		ctx.set_error(EvalError::BAD_FUNC_ARGS);
+		return res;
+	}
+	return Binder::invoke(f, ctx, pArgs, Idx());
+}
+
+template<typename FN> FuncDef bind_def(const char* pName, Func func) {
+	typedef FuncBinder<FN> Binder;
+	static_assert(Binder::Args::NARGS <= FuncDef::MAX_ARGS, "too many arguments for a Pint function");
+	FuncDef def = {};
+	def.pName = pName;
+	def.func = func;
+	def.resultType = ValueBind<typename Binder::Result>::TYPE;
+	def.typed = true;
+	Binder::Args::describe(&def);
+	return def;
+}
+
+// the function is a template argument, the wrapper calls it directly
+template<typename FN, FN F> Value bound_func(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+	return bind_call(F, ctx, nargs, pArgs);
+}
+
+template<typename FN, FN F> FuncDef bind_func(const char* pName) {
+	return bind_def<FN>(pName, bound_func<FN, F>);
+}
+
+#define PINT_BIND_FUNC(_name_, _func_) Pint::bind_func<decltype(&_func_), &_func_>(_name_)
+
+template<typename M> struct LambdaSig;
+template<typename C, typename R, typename... A> struct LambdaSig<R (C::*)(A...) const> {
+	typedef R (*Type)(A...);
+};
+
+// a lambda can't be a template argument in C++11: its function pointer is kept per lambda type
+template<typename L> struct LambdaBind {
+	typedef typename LambdaSig<decltype(&L::operator())>::Type FuncPtr;
+	static FuncPtr s_func;
+
+	static Value call(ExecContext& ctx, const uint32_t nargs, Value* pArgs) {
+		return bind_call(s_func, ctx, nargs, pArgs);
+	}
+};
+
+template<typename L> typename LambdaBind<L>::FuncPtr LambdaBind<L>::s_func = nullptr;
+
+template<typename L> FuncDef bind_func(const char* pName, const L& lambda, decltype(&L::operator()) = nullptr) {
+	LambdaBind<L>::s_func = lambda;
+	return bind_def<typename LambdaBind<L>::FuncPtr>(pName, LambdaBind<L>::call);
+}
+
+struct CodeItem {
+	static const size_t SYM_MAX_LEN = 63;
+
+	enum class Type : uint32_t {
+		NON = 0,
+		SYM,
+		NUM,
+		STR,
+		LST,
+		INT,
+		ARG  // defun parameter, val.inum is its slot in the call frame
+	};
+
+	// what a symbol does at the head of a form, set by set_sym; CALL: a function or a variable
+	enum class Form : uint8_t {
+		CALL = 0,
+		IF,
+		BREAK,
+		DEFUN,
+		LOOP, // while, dotimes, dolist
+		YIELD, // yield, wait
+		DEFVAR,
+		SET,
+		EQ,
+		NE,
+		AND,
+		OR,
+		LIST,
+		LGET,
+		DOT,
+		LSET,
+		NUMOP
+	};
+
+	union {
+		char sym[SYM_MAX_LEN+1];
+		const char* pStr;
+		CodeList* pLst;
+		double num;
+		int64_t inum;
+	} val;
+
+	Type type;
+	int32_t func; // symbols: FuncLibrary index cached by the call site, or FUNC_*
+	Form form;
+	uint8_t numOp; // NUMOP: the operator's entry in the numeric operator table
+	int32_t var; // symbols outside function bodies: variable id, valid while varGen is the context's scope generation
+	uint32_t varGen;
+
+	static const int32_t FUNC_UNRESOLVED = -1;
+	static const int32_t FUNC_NONE = -2;
+
+	void set_none();
+	bool is_none() const;
+
+	void set_sym(const char* pStr);
+	bool is_sym() const;
+
+	void set_num(double num);
+	bool is_num() const;
+
+	void set_int(int64_t num);
+	bool is_int() const;
+
+	void set_str(const char* pStr);
+	bool is_str() const;
+
+	void set_list(CodeList* pLst);
+	bool is_list() const;
+
+	void set_arg(uint32_t slot);
+	bool is_arg() const;
+};
+
+#if !defined(PINT_CL_CHUNK_SZ)
+	#define PINT_CL_CHUNK_SZ 16
+#endif
+
+class CodeList {
+protected:
+	CodeItem* mpItems;
+	uint32_t mChunkSize;
+	uint32_t mCount;
+	uint32_t mCapacity;
+	bool mTail;
+	CodeItem mItems[PINT_CL_CHUNK_SZ];
+
+public:
+	CodeList(const uint32_t chunkSize = PINT_CL_CHUNK_SZ) // ifndef macro
+	:
+	mpItems(nullptr),
+	mChunkSize(chunkSize),
+	mCount(0),
+	mCapacity(0),
+	mTail(false)
+	{
+		init();
+	}
+
+	~CodeList() {
+		reset();
+	}
+
+	void init();
+
+	void reset();
+
+	bool valid() const;
+
+	void append(const CodeItem& itm);
+
+	CodeItem* get_items() const;
+
+	uint32_t count() const;
+	uint32_t capacity() const;
+
+	// in a defun body, the value of the list is the value of the function:
+	// a call to a script function there replaces the caller's frame
+	void set_tail(const bool tail) { mTail = tail; }
+	bool is_tail() const { return mTail; }
+};
+
+struct ListStack {
+	static const int CODE_LST_MAX = 256;
+
+	CodeList* lists[CODE_LST_MAX];
+	int ptr;
+
+	void reset() { ptr = 0; }
+
+	CodeList* top();
+
+	void push(CodeList* pLst);
+
+	CodeList* pop();
+};
+
+class CodeBlock : public cxLexer::TokenFunc {
+protected:
+	ExecContext& mCtx;
+	FuncLibrary* mpFuncLib;
+	ListStack mListStack;
+	CodeList mLists[ListStack::CODE_LST_MAX];
+	uint32_t mListCnt;
+	// list levels entered by eval_sub, item index per level for yield frames
+	uint32_t mLevel;
+	uint16_t mPath[Frame::DEPTH_MAX];
+	uint32_t mIter[Frame::DEPTH_MAX]; // loop iteration per level
+	bool mResume;
+	uint64_t* mpReadMask;
+	CallFrame* mpCall; // innermost script function being evaluated
+
+	void print_sub(const CodeList* lst, int lvl = 0) const;
+
+	bool eval_numeric_values(CodeList* pLst, const uint32_t org, const uint32_t slice, Value* pValues);
+
+	// stmt: the value of the list isn't used, (yield) can suspend there
+	Value eval_sub(CodeList* pLst, const uint32_t org = 0, const uint32_t slice = 0, const bool stmt = false);
+
+	// operand idx of pLst, numeric literals are read without going through eval_sub
+	Value eval_operand(CodeList* pLst, const uint32_t idx);
+	// and/or: the operands after the one that decides the result aren't evaluated
+	Value eval_logic(CodeList* pLst, const uint32_t cnt, const bool isOr);
+
+	// while/dotimes/dolist; resumeAt: item to resume the suspended loop at, 0 to start it
+	Value eval_loop(CodeList* pLst, const uint32_t cnt, const bool stmt, const uint32_t resumeAt);
+
+	// defines the function in the library, see FuncLibrary::define_script
+	void eval_defun(CodeList* pLst);
+	// runs a script function's body, tail calls in it reuse the frame
+	Value call_script(const ScriptFunc* pFunc, const uint32_t nargs, const Value* pArgs);
+
+	// saves the path to the current level into the context's frame
+	void suspend(const uint32_t wait, const bool preempt);
+
+	// resolved once per call site with a frozen library
+	const FuncDef* find_func(CodeItem* pItem) const;
+	// resolved again once the context's scopes change
+	int resolve_var(CodeItem* pItem);
+
+public:
+	// n-ary numeric forms: one kernel per operator folds the operands of pLst as they're evaluated;
+	// public only to be referenced from the operator table
+	template<typename K> Value fold_arith(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info);
+	template<typename K> Value fold_select(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info);
+	template<typename K> Value fold_bits(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info);
+	template<typename K> Value chain_cmp(CodeList* pLst, const uint32_t cnt, const NumOpInfo& info);
+
+	static const uint32_t READ_MASK_SIZE = uint32_t((ExecContext::CODE_VAR_MAX + GlobalStore::VAR_MAX) / 64);
+	static const uint32_t CALL_DEPTH_MAX = 128;
+
+	CodeBlock(ExecContext& ctx, FuncLibrary* pFuncLib = nullptr);
+
+	~CodeBlock();
+
+	CodeList* new_list();
+
+	virtual bool operator()(const cxLexer::Token& tok);
+
+	void parse(const SrcCode::Line& line);
+
+	// resume: continue from the context's frame instead of the start of the line
+	void eval(const bool resume = false);
+
+	// ids of the variables read by eval() are accumulated into pMask[READ_MASK_SIZE]
+	void set_read_mask(uint64_t* pMask) { mpReadMask = pMask; }
+
+	// variable assigned by the parsed line if it's a defvar or set form
+	const char* get_def_name() const;
+
+	void init();
+
+	void reset();
+
+	void print() const;
+
+	void from_tokens(cxLexer::Token* pTop, const size_t ntok);
+};
+
+void interp(const char* pSrc, size_t srcSize, ExecContext* pCtx, FuncLibrary* pFuncLib);
+
+// Continues a script suspended by (yield) or (wait N); the source passed to interp
+// must still be valid. Only the suspended line is parsed again, earlier lines are not re-run.
+// Returns true while the script stays suspended.
+bool resume(ExecContext* pCtx, FuncLibrary* pFuncLib);
+
+// Keeps a context and an evaluator alive between calls: append() runs only the lines it adds,
+// the variables, strings and domains made by the earlier code stay in the context.
+class Session {
+protected:
+	ExecContext* mpCtx;
+	FuncLibrary* mpFuncLib;
+	CodeBlock* mpBlk;
+	char* mpSrc;      // everything appended so far, suspended scripts resume from here
+	size_t mSrcSize;
+	size_t mSrcCap;
+	size_t mLineNo;
+	SessionDefs* mpDefs;  // reactive mode only
+	uint64_t mDirty[CodeBlock::READ_MASK_SIZE];
+	bool mOwnCtx;
+
+	bool reserve(const size_t size);
+
+public:
+	Session();
+	~Session();
+
+	// pCtx = nullptr: the session makes its own context
+	void init(FuncLibrary* pFuncLib, ExecContext* pCtx = nullptr);
+	void reset();
+
+	ExecContext* get_context() { return mpCtx; }
+	const char* get_source() const { return mpSrc; }
+	size_t get_source_size() const { return mSrcSize; }
+
+	// The code is evaluated right away, or after the rest of a suspended script when it's resumed.
+	// A chunk is taken as complete lines. Returns false if the new code stopped with an error.
+	bool append(const char* pSrc, size_t srcSize);
+	bool append(const char* pSrc);
+
+	// continues a script suspended by yield/wait or the budget, true while it stays suspended
+	bool resume();
+
+	// drops the variables and the code
+	void clear();
+
+	// Reactive mode: top-level defvar/set lines appended from now on are recorded together with
+	// the variables their evaluation read. After the host changes variables and touches them,
+	// update() re-runs only the definitions depending on them, directly or through other
+	// definitions, in source order. Returns the number of lines evaluated.
+	void set_reactive(const bool enable);
+	bool is_reactive() const { return mpDefs != nullptr; }
+	void touch(int id);
+	bool touch(const char* pName);
+	uint32_t update();
+};
+
+struct Job {
+	const char* pSrc;
+	size_t srcSize;
+	ExecContext* pCtx;
+	void* pBinding;
+	EvalError err; // set when the job is done
+};
+
+// Runs batches of interp() jobs on a fixed pool of workers, the thread calling run()
+// is worker 0. A batch is split into a contiguous range per worker, a worker out of
+// jobs steals from the end of the others' ranges. Contexts must be distinct per job.
+class Scheduler {
+protected:
+	SchedState* mpState;
+
+	static void worker_main(SchedState* pState, const uint32_t idx);
+	static void drain(SchedState* pState, const uint32_t idx);
+
+public:
+	Scheduler();
+	~Scheduler();
+
+	// nworkers = 0: one per hardware thread
+	void init(FuncLibrary* pFuncLib, const uint32_t nworkers = 0);
+	void reset();
+
+	uint32_t get_worker_count() const;
+
+	// returns once every job is done, the result is the number of jobs stopped by an error
+	uint32_t run(Job* pJobs, const uint32_t njobs);
+};
+
+void set_mem_lock(sxLock* pLock);
+sxLock* get_mem_lock();
+
+void cache(const char* pSrc, size_t srcSize);
+
+} // Pint
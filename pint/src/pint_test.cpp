@@ -1,6 +1,8 @@
 #include "crosscore.hpp"
 #include "pint.hpp"
 
+#include <thread>
+
 static void dbgmsg_impl(const char* pMsg) {
 	::fprintf(stderr, "%s", pMsg);
 	::fflush(stderr);
@@ -48,28 +50,363 @@ static const Pint::FuncDef s_glb_plr_kind2_desc = {
 	"glb_plr_kind", glb_plr_kind2, 0, Pint::Value::Type::NUM, {}
 };
 
-Pint::Value math_fit(Pint::ExecContext& ctx, const uint32_t nargs, Pint::Value* pArgs) {
-	Pint::Value res;
-	double val = pArgs[0].val.num;
-	double oldMin = pArgs[1].val.num;
-	double oldMax = pArgs[2].val.num;
-	double newMin = pArgs[3].val.num;
-	double newMax = pArgs[4].val.num;
-	res.set_num(nxCalc::fit(val, oldMin, oldMax, newMin, newMax));
-	return res;
+static double math_fit(double val, double oldMin, double oldMax, double newMin, double newMax) {
+	return nxCalc::fit(val, oldMin, oldMax, newMin, newMax);
+}
+
+static const int REACTIVE_INPUTS = 8;
+static const int REACTIVE_DERIVED = 240;
+static double s_reactiveIn[REACTIVE_INPUTS];
+
+static double reactive_in(int idx) {
+	return s_reactiveIn[idx % REACTIVE_INPUTS];
+}
+
+// Derived variables over a few inputs, one input changes per iteration:
+// re-running the whole script vs recomputing the definitions that depend on it.
+static void reactive_bench(Pint::FuncLibrary& funcLib, const int iters) {
+	static char src[32 * 1024];
+	size_t srcSize = 0;
+	for (int i = 0; i < REACTIVE_INPUTS; ++i) {
+		s_reactiveIn[i] = double(i);
+		srcSize += ::sprintf(&src[srcSize], "(defvar in%d (reactive_in %d))\n", i, i);
+	}
+	for (int i = 0; i < REACTIVE_DERIVED; ++i) {
+		if (i < REACTIVE_INPUTS) {
+			srcSize += ::sprintf(&src[srcSize], "(defvar d%d (* in%d 2))\n", i, i);
+		} else {
+			srcSize += ::sprintf(&src[srcSize], "(defvar d%d (+ (* d%d 0.5) (* in%d 2) 1))\n", i, i - REACTIVE_INPUTS, i % REACTIVE_INPUTS);
+		}
+	}
+	char lastName[16];
+	::sprintf(lastName, "d%d", REACTIVE_DERIVED - 1);
+
+	Pint::ExecContext ctx;
+	ctx.init();
+	double t0 = nxSys::time_micros();
+	for (int i = 0; i < iters; ++i) {
+		s_reactiveIn[REACTIVE_INPUTS - 1] = double(i);
+		Pint::interp(src, srcSize, &ctx, &funcLib);
+	}
+	double tfull = nxSys::time_micros() - t0;
+	double full = ctx.get_num_val(lastName);
+	ctx.reset();
+
+	Pint::Session session;
+	session.init(&funcLib);
+	session.set_reactive(true);
+	session.append(src, srcSize);
+	Pint::ExecContext* pCtx = session.get_context();
+	int inId = pCtx->find_var("in7");
+	uint32_t nlines = 0;
+	t0 = nxSys::time_micros();
+	for (int i = 0; i < iters; ++i) {
+		s_reactiveIn[REACTIVE_INPUTS - 1] = double(i);
+		pCtx->var_val(inId)->set_num(double(i));
+		session.touch(inId);
+		nlines = session.update();
+	}
+	double tupd = nxSys::time_micros() - t0;
+	double upd = pCtx->get_num_val(lastName);
+	session.reset();
+
+	nxCore::dbg_msg("%d definitions, 1 input changed: full run %.2f us, update %.2f us (%d lines), x%.1f, %s\n",
+		REACTIVE_DERIVED, tfull / iters, tupd / iters, nlines, tfull / nxCalc::max(tupd, 1.0e-3),
+		full == upd ? "same result" : "RESULTS DIFFER");
+}
+
+// A script evaluated in a fresh context and library: the value left in r and the error are compared
+// with the expected ones. With fuel, the script runs in slices of that budget until it's done.
+struct ScriptCheck {
+	const char* pSrc;
+	double res;
+	Pint::EvalError err;
+	uint32_t fuel;
+};
+
+static void run_checks(const ScriptCheck* pChecks, const uint32_t nchecks, const char* pTitle) {
+	uint32_t nfail = 0;
+	for (uint32_t i = 0; i < nchecks; ++i) {
+		const ScriptCheck& chk = pChecks[i];
+		Pint::FuncLibrary lib;
+		Pint::ExecContext ctx;
+		lib.init();
+		ctx.init();
+		ctx.set_budget(chk.fuel);
+		Pint::interp(chk.pSrc, ::strlen(chk.pSrc), &ctx, &lib);
+		while (chk.fuel && ctx.suspended()) {
+			ctx.set_budget(chk.fuel);
+			Pint::resume(&ctx, &lib);
+		}
+		double res = ctx.get_num_val("r", -1.0);
+		Pint::EvalError err = ctx.get_error();
+		if (res != chk.res || err != chk.err) {
+			nxCore::dbg_msg("%s -> %f, error %d, expected %f, error %d\n", chk.pSrc, res, int(err), chk.res, int(chk.err));
+			++nfail;
+		}
+		ctx.reset();
+		lib.reset();
+	}
+	nxCore::dbg_msg("%s checks: %d of %d failed\n", pTitle, nfail, nchecks);
 }
 
-static const Pint::FuncDef s_df_math_fit_desc = {
-	"math_fit", math_fit, 5, Pint::Value::Type::NUM,
-	{Pint::Value::Type::NUM, Pint::Value::Type::NUM, Pint::Value::Type::NUM, Pint::Value::Type::NUM, Pint::Value::Type::NUM}
+// n-ary forms on the edges of the 48-bit integer range, where the integer accumulator
+// hands over to the float one
+static const ScriptCheck s_opChecks[] = {
+	{ "(defvar r (+ 1 2 3 4))", 10.0 },
+	{ "(defvar r (- 10 1 2 3))", 4.0 },
+	{ "(defvar r (/ 12 4 3))", 1.0 },
+	{ "(defvar r (/ 7 2))", 3.5 },
+	{ "(defvar r (+ 140737488355327 1))", 140737488355328.0 },
+	{ "(defvar r (- (+ 140737488355327 1) 1))", 140737488355327.0 },
+	{ "(defvar r (- 0 140737488355327 1 1))", -140737488355329.0 },
+	{ "(defvar r (* 140737488355327 2 1))", 281474976710654.0 },
+	{ "(defvar r (< 1 2 3))", 1.0 },
+	{ "(defvar r (< 1 3 2))", 0.0 }
+};
+
+// element-wise forms on integer lists, alone and with floats
+static const ScriptCheck s_listChecks[] = {
+	{ "(defvar r (lget (+ (list 1 2 3 4 5) (list 10 20 30 40 50)) 4))", 55.0 },
+	{ "(defvar r (lget (/ (list 8 9 10 12 7) (list 2 2 5 4 7)) 1))", 4.5 },
+	{ "(defvar r (lget (* (list 1 2 140737488355327 4) 2) 2))", 281474976710654.0 },
+	{ "(defvar r (lget (- (list 1 2 3 4 5) 0.5) 4))", 4.5 },
+	{ "(defvar r (lget (+ (list 1 2 3 4) (list 0.5 0.5 0.5 0.5)) 3))", 4.5 },
+	{ "(defvar r (lget (min (list 1 5 3 7) (list 4 2 6 0.5)) 3))", 0.5 },
+	{ "(defvar r (lget (max (list 1 5 3 7 2) 4) 4))", 4.0 }
+};
+
+// conditions: none (a failed comparison) is false, strings and lists are true
+static const ScriptCheck s_flowChecks[] = {
+	{ "(defvar r (if (< 1 \"a\") 1 2))", 2.0 },
+	{ "(defvar r (if \"abc\" 1 2))", 1.0 },
+	{ "(defvar r (if (list 0) 1 2))", 1.0 },
+	{ "(defvar r (if 0 1 2))", 2.0 },
+	{ "(defvar r (if 0.5 1 2))", 1.0 },
+	{ "(defvar r 0)\n(dotimes (i 10) (set r (+ r i)))", 45.0 },
+	{ "(defvar r 0)\n(dotimes (i 4) (defvar t i) (set r (+ r t)))", 6.0 },
+	{ "(defvar l (list))\n(dotimes (i 5) (lset l i (* i 2)))\n(defvar r (lget l 4))", 8.0 }
 };
 
+// script functions: recursion, tail calls in deep recursion, definition and call errors
+static const ScriptCheck s_defunChecks[] = {
+	{ "(defun sq (x) (* x x))\n(defvar r (sq 7))", 49.0 },
+	{ "(defun fact (n acc) (if (<= n 1) acc (fact (- n 1) (* n acc))))\n(defvar r (fact 10 1))", 3628800.0 },
+	{ "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))\n(defvar r (fib 15))", 610.0 },
+	{ "(defun ev (k) (if (= k 0) 1 (od (- k 1))))\n(defun od (k) (if (= k 0) 0 (ev (- k 1))))\n(defvar r (ev 1001))", 0.0 },
+	{ "(defun count (n) (if (> n 0) (count (- n 1)) 99))\n(defvar r (count 1000000))", 99.0 },
+	{ "(defun inc (x) (set x (+ x 1)) (* x 10))\n(defvar r (inc 4))", 50.0 },
+	{ "(defvar r 5)\n(defun bad x 1)", 5.0, Pint::EvalError::BAD_DEFUN },
+	{ "(defvar r 5)\n(defun deep (n) (+ 1 (deep n)))\n(deep 1)", 5.0, Pint::EvalError::CALL_DEPTH }
+};
+
+// loops, (break) in them, and loops run in slices of a small budget
+static const ScriptCheck s_loopChecks[] = {
+	{ "(defvar r 0)\n(while (< r 10) (set r (+ r 3)))", 12.0 },
+	{ "(defvar r 1)\n(dolist (x (list 3 4 5)) (set r (* r x)))", 60.0 },
+	{ "(defvar r 0)\n(dotimes (i 10) (if (= i 4) (break)) (set r (+ r i)))", 6.0 },
+	{ "(defvar r 0)\n(while 1 (set r (+ r 1)) (if (= r 7) (break)))", 7.0 },
+	{ "(defvar r 0)\n(dolist (x (list 1 2 3 4)) (if (> x 2) (break)) (set r (+ r x)))", 3.0 },
+	{ "(defvar r 0)\n(dotimes (i 100) (set r (+ r i)))", 4950.0, Pint::EvalError::NONE, 5 },
+	{ "(defvar r 0)\n(while (< r 50) (set r (+ r 1)))", 50.0, Pint::EvalError::NONE, 3 },
+	{ "(defun spin (n) (dotimes (i n) (set n n)) n)\n(defvar r 1)\n(spin 1000)", 1.0, Pint::EvalError::LOOP_BUDGET, 20 }
+};
+
+// jobs on scheduler workers define and call the same functions in a frozen library, every
+// other job with a different parameter name, so the bodies are replaced while others run them
+static void defun_mt_check() {
+	static const char* s_srcs[] = {
+		"(defun sq (x) (* x x))\n(defun fact (n acc) (if (<= n 1) acc (fact (- n 1) (* n acc))))\n(defvar r (+ (sq 7) (fact 10 1)))",
+		"(defun sq (y) (* y y))\n(defun fact (n acc) (if (<= n 1) acc (fact (- n 1) (* n acc))))\n(defvar r (+ (sq 7) (fact 10 1)))"
+	};
+	static const int NJOBS = 128;
+	static const int NRUNS = 8;
+	Pint::FuncLibrary lib;
+	lib.init();
+	lib.freeze();
+	Pint::ExecContext* pCtxs = new Pint::ExecContext[NJOBS];
+	Pint::Job* pJobs = new Pint::Job[NJOBS];
+	for (int i = 0; i < NJOBS; ++i) {
+		pCtxs[i].init();
+		pJobs[i].pSrc = s_srcs[i & 1];
+		pJobs[i].srcSize = ::strlen(s_srcs[i & 1]);
+		pJobs[i].pCtx = &pCtxs[i];
+		pJobs[i].pBinding = nullptr;
+	}
+	Pint::Scheduler sched;
+	sched.init(&lib, 4);
+	int nfail = 0;
+	for (int n = 0; n < NRUNS; ++n) {
+		nfail += int(sched.run(pJobs, NJOBS));
+		for (int i = 0; i < NJOBS; ++i) {
+			if (pCtxs[i].get_num_val("r", -1.0) != 3628849.0) {
+				++nfail;
+			}
+		}
+	}
+	sched.reset();
+	for (int i = 0; i < NJOBS; ++i) {
+		pCtxs[i].reset();
+	}
+	delete[] pJobs;
+	delete[] pCtxs;
+	lib.reset();
+	nxCore::dbg_msg("defun MT checks: %d of %d jobs failed\n", nfail, NJOBS * NRUNS);
+}
+
+// unseeded contexts run by scheduler workers get the same sequence as one run alone
+static void rng_check() {
+	static const char* pSrc = "(defvar r (glb_rng_01))";
+	static const int NJOBS = 64;
+	Pint::FuncLibrary lib;
+	lib.init();
+	lib.freeze();
+	Pint::ExecContext ref;
+	ref.init();
+	Pint::interp(pSrc, ::strlen(pSrc), &ref, &lib);
+	double res = ref.get_num_val("r", -1.0);
+	ref.reset();
+	Pint::ExecContext* pCtxs = new Pint::ExecContext[NJOBS];
+	Pint::Job* pJobs = new Pint::Job[NJOBS];
+	for (int i = 0; i < NJOBS; ++i) {
+		pCtxs[i].init();
+		pJobs[i].pSrc = pSrc;
+		pJobs[i].srcSize = ::strlen(pSrc);
+		pJobs[i].pCtx = &pCtxs[i];
+		pJobs[i].pBinding = nullptr;
+	}
+	Pint::Scheduler sched;
+	sched.init(&lib, 4);
+	sched.run(pJobs, NJOBS);
+	sched.reset();
+	int nfail = 0;
+	for (int i = 0; i < NJOBS; ++i) {
+		if (pCtxs[i].get_num_val("r", -1.0) != res) {
+			++nfail;
+		}
+		pCtxs[i].reset();
+	}
+	delete[] pJobs;
+	delete[] pCtxs;
+	nxCore::dbg_msg("rng checks: %d of %d jobs differ\n", nfail, NJOBS);
+}
+
+// delta snapshots restore against their base, a truncated base is rejected
+static void snap_check() {
+	static char s_full[4096];
+	static char s_delta[4096];
+	Pint::ExecContext src;
+	src.init();
+	for (int i = 0; i < 8; ++i) {
+		char name[16];
+		::sprintf(name, "v%d", i);
+		src.var_val(src.add_var(name))->set_num(double(i));
+	}
+	size_t fullSize = src.snapshot(s_full, sizeof(s_full));
+	Pint::ExecContext chg;
+	chg.init();
+	src.fork(&chg);
+	chg.var_val("v5")->set_num(55.0);
+	size_t deltaSize = chg.snapshot(s_delta, sizeof(s_delta), s_full, fullSize);
+	Pint::ExecContext dst;
+	dst.init();
+	bool ok = deltaSize > 0 && deltaSize < fullSize;
+	ok = ok && dst.restore(s_delta, deltaSize, s_full, fullSize) && dst.get_num_val("v5") == 55.0 && dst.get_num_val("v7") == 7.0;
+	ok = ok && !dst.restore(s_delta, deltaSize, s_full, fullSize - 1);
+	ok = ok && chg.snapshot(s_delta, sizeof(s_delta), s_full, fullSize / 2) == 0;
+	dst.reset();
+	chg.reset();
+	src.reset();
+	nxCore::dbg_msg("snapshot checks: %s\n", ok ? "ok" : "FAILED");
+}
+
+static void script_checks() {
+	run_checks(s_opChecks, XD_ARY_LEN(s_opChecks), "op");
+	run_checks(s_listChecks, XD_ARY_LEN(s_listChecks), "list");
+	run_checks(s_flowChecks, XD_ARY_LEN(s_flowChecks), "flow");
+	run_checks(s_defunChecks, XD_ARY_LEN(s_defunChecks), "defun");
+	run_checks(s_loopChecks, XD_ARY_LEN(s_loopChecks), "loop");
+	defun_mt_check();
+	rng_check();
+	snap_check();
+}
+
+// each operator applied to 8 integer and then 8 float literals, the form is parsed once
+static void op_bench(Pint::FuncLibrary& funcLib, const int iters) {
+	run_checks(s_opChecks, XD_ARY_LEN(s_opChecks), "op");
+	static const char* s_ops[] = {
+		"+", "-", "*", "/", "min", "max", "logand", "logxor", "logior",
+		"=", "/=", ">", ">=", "<", "<=", "and", "or"
+	};
+	static const int OPERANDS = 8;
+	Pint::ExecContext ctx;
+	ctx.init();
+	for (size_t i = 0; i < XD_ARY_LEN(s_ops); ++i) {
+		double t[2];
+		for (int k = 0; k < 2; ++k) {
+			char src[128];
+			size_t srcSize = ::sprintf(src, "(%s", s_ops[i]);
+			for (int j = 0; j < OPERANDS; ++j) {
+				srcSize += k ? ::sprintf(&src[srcSize], " %.1f", double(OPERANDS - j) * 0.5) : ::sprintf(&src[srcSize], " %d", OPERANDS - j);
+			}
+			srcSize += ::sprintf(&src[srcSize], ")");
+			Pint::SrcCode::Line line;
+			line.pText = src;
+			line.textSize = srcSize;
+			line.no = 1;
+			Pint::CodeBlock blk(ctx, &funcLib);
+			blk.init();
+			blk.parse(line);
+			double t0 = nxSys::time_micros();
+			for (int n = 0; n < iters; ++n) {
+				blk.eval();
+			}
+			t[k] = (nxSys::time_micros() - t0) * 1.0e3 / double(iters);
+			blk.reset();
+		}
+		nxCore::dbg_msg("%-6s int %6.1f ns, float %6.1f ns\n", s_ops[i], t[0], t[1]);
+	}
+	ctx.reset();
+}
+
+// runs the program as njobs jobs with 1 to all hardware threads
+static void bench(const char* pSrc, size_t srcSize, Pint::FuncLibrary& funcLib, const int njobs) {
+	Pint::ExecContext* pCtxs = new Pint::ExecContext[njobs];
+	Pint::Job* pJobs = new Pint::Job[njobs];
+	for (int i = 0; i < njobs; ++i) {
+		pCtxs[i].init();
+		pCtxs[i].seed_rng(uint64_t(i));
+		pJobs[i].pSrc = pSrc;
+		pJobs[i].srcSize = srcSize;
+		pJobs[i].pCtx = &pCtxs[i];
+		pJobs[i].pBinding = nullptr;
+	}
+	uint32_t ncores = nxCalc::max(std::thread::hardware_concurrency(), 1U);
+	double t1 = 0.0;
+	for (uint32_t n = 1; n <= ncores; ++n) {
+		Pint::Scheduler sched;
+		sched.init(&funcLib, n);
+		sched.run(pJobs, njobs); // warm-up
+		double t0 = nxSys::time_micros();
+		uint32_t nerr = sched.run(pJobs, njobs);
+		double t = nxSys::time_micros() - t0;
+		sched.reset();
+		if (n == 1) t1 = t;
+		nxCore::dbg_msg("%2d workers: %.0f jobs/s, x%.2f, %d errors\n", n, double(njobs) * 1.0e6 / t, t1 / t, nerr);
+	}
+	for (int i = 0; i < njobs; ++i) {
+		pCtxs[i].reset();
+	}
+	delete[] pJobs;
+	delete[] pCtxs;
+}
+
 int main(int argc, char* argv[]) {
 	nxApp::init_params(argc, argv);
 	init_sys();
 
 	if (nxApp::get_args_count() < 1) {
-		nxCore::dbg_msg("pint_test <src_path>\n");
+		nxCore::dbg_msg("pint_test <src_path> [-bench:<jobs>] [-fuel:<lists per slice>] [-session:1] [-reactive:<iterations>] [-memo:<entries>] [-opbench:<iterations>] [-check:1]\n");
 	} else {
 		const char* pSrcPath = nxApp::get_arg(0);
 		if (pSrcPath) {
@@ -84,11 +421,65 @@ int main(int argc, char* argv[]) {
 
 				funcLib.register_func(s_glb_plr_kind_desc);
 				funcLib.register_func(s_glb_plr_kind2_desc);
-				funcLib.register_func(s_df_math_fit_desc);
+				Pint::FuncDef fitDef = PINT_BIND_FUNC("math_fit", math_fit);
+				fitDef.pure = true;
+				funcLib.register_func(fitDef);
+				funcLib.register_func(PINT_BIND_FUNC("reactive_in", reactive_in));
+				funcLib.freeze();
+				int memoSize = nxApp::get_int_opt("memo", 0);
+				funcLib.set_memo(uint32_t(nxCalc::max(memoSize, 0)));
 
 				nxCore::rng_seed(1);
 
-				Pint::interp(pSrc, srcSize, &ctx, &funcLib);
+				int reactiveIters = nxApp::get_int_opt("reactive", 0);
+				if (reactiveIters > 0) {
+					reactive_bench(funcLib, reactiveIters);
+				}
+
+				if (nxApp::get_int_opt("check", 0) != 0) {
+					script_checks();
+				}
+
+				int opIters = nxApp::get_int_opt("opbench", 0);
+				if (opIters > 0) {
+					op_bench(funcLib, opIters);
+				}
+
+				int benchJobs = nxApp::get_int_opt("bench", 0);
+				if (benchJobs > 0) {
+					bench(pSrc, srcSize, funcLib, benchJobs);
+				}
+
+				// -session:1 feeds the program to a Pint::Session line by line
+				Pint::Session session;
+				bool useSession = nxApp::get_int_opt("session", 0) != 0;
+				int fuel = nxApp::get_int_opt("fuel", 0);
+				ctx.set_budget(uint32_t(nxCalc::max(fuel, 0)));
+				if (useSession) {
+					session.init(&funcLib, &ctx);
+					size_t org = 0;
+					for (size_t i = 0; i < srcSize; ++i) {
+						if (pSrc[i] == '\n' || i + 1 == srcSize) {
+							if (!session.append(&pSrc[org], i + 1 - org)) break;
+							org = i + 1;
+						}
+					}
+				} else {
+					Pint::interp(pSrc, srcSize, &ctx, &funcLib);
+				}
+				int slices = 1;
+				while (ctx.suspended()) {
+					ctx.set_budget(uint32_t(nxCalc::max(fuel, 0)));
+					if (useSession) {
+						session.resume();
+					} else {
+						Pint::resume(&ctx, &funcLib);
+					}
+					++slices;
+				}
+				if (fuel > 0) {
+					nxCore::dbg_msg("%d slices\n", slices);
+				}
 
 				Pint::EvalError err = ctx.get_error();
 				if (err != Pint::EvalError::NONE) {
@@ -96,6 +487,13 @@ int main(int argc, char* argv[]) {
 				}
 
 				ctx.print_vars();
+				if (memoSize > 0) {
+					Pint::FuncLibrary::MemoStats memo = funcLib.get_memo_stats();
+					uint64_t calls = memo.hits + memo.misses;
+					nxCore::dbg_msg("memo: %d hits, %d misses (%.1f%%), %d evictions\n", int(memo.hits), int(memo.misses),
+					                calls ? double(memo.hits) * 100.0 / double(calls) : 0.0, int(memo.evictions));
+				}
+				session.reset();
 				ctx.reset();
 
 				nxCore::bin_unload(pSrc);
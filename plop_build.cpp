@@ -0,0 +1,491 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+#include <crosscore.hpp>
+
+#include "plot_prog.hpp"
+#include "plop_build.hpp"
+
+namespace PlopBuild {
+
+typedef PlopData::Op Op;
+
+void BinWriter::write_bytes(const void* pData, const size_t size) {
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pData);
+	mBytes.insert(mBytes.end(), pBytes, pBytes + size);
+}
+
+void BinWriter::write_u32(const uint32_t val) {
+	uint8_t bytes[4] = { uint8_t(val), uint8_t(val >> 8), uint8_t(val >> 16), uint8_t(val >> 24) };
+	write_bytes(bytes, sizeof(bytes));
+}
+
+void BinWriter::write_u16(const uint16_t val) {
+	uint8_t bytes[2] = { uint8_t(val), uint8_t(val >> 8) };
+	write_bytes(bytes, sizeof(bytes));
+}
+
+void BinWriter::align(const size_t alignment) {
+	size_t newSize = XD_ALIGN(mBytes.size(), alignment);
+	mBytes.resize(newSize, 0);
+}
+
+void BinWriter::patch(const size_t at, const uint32_t val) {
+	if (at + 4 <= mBytes.size()) {
+		mBytes[at] = uint8_t(val);
+		mBytes[at + 1] = uint8_t(val >> 8);
+		mBytes[at + 2] = uint8_t(val >> 16);
+		mBytes[at + 3] = uint8_t(val >> 24);
+	}
+}
+
+bool BinWriter::save(const char* pOutPath) const {
+	FILE* pOut = nxSys::fopen_w_bin(pOutPath);
+	if (!pOut) {
+		return false;
+	}
+	size_t nwritten = ::fwrite(mBytes.data(), 1, mBytes.size(), pOut);
+	::fclose(pOut);
+	return nwritten == mBytes.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int32_t StrList::add(const std::string& str) {
+	std::unordered_map<std::string, int32_t>::const_iterator it = mIds.find(str);
+	if (it != mIds.end()) {
+		return it->second;
+	}
+	int32_t id = int32_t(mStrs.size());
+	mStrs.push_back(str);
+	mIds[str] = id;
+	return id;
+}
+
+void StrList::write(BinWriter& bw) const {
+	size_t top = bw.pos();
+	uint32_t n = count();
+	bw.write_u32(0); // -> size
+	bw.write_u32(n);
+	size_t offsTop = bw.pos();
+	for (uint32_t i = 0; i < n; ++i) {
+		bw.write_u32(0);
+	}
+	for (uint32_t i = 0; i < n; ++i) {
+		bw.write_u16(nxCore::str_hash16(mStrs[i].c_str()));
+	}
+	for (uint32_t i = 0; i < n; ++i) {
+		bw.patch(offsTop + i * 4, uint32_t(bw.pos() - top));
+		bw.write_str(mStrs[i]);
+	}
+	bw.patch(top, uint32_t(bw.pos() - top));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void DataExporter::write(BinWriter& bw) {
+	size_t top = bw.pos();
+	bw.write_fourcc(mpSig);
+	bw.write_u32(0); // flags
+	bw.write_u32(0); // -> file size
+	bw.write_u32(0); // -> head size
+	bw.write_u32(0); // -> strings
+	bw.write_i16(-1); // name id
+	bw.write_i16(-1); // path id
+	bw.write_u32(0); // file path length
+	bw.write_u32(0); // reserved
+	write_head(bw, top);
+	bw.patch(top + 0xC, uint32_t(bw.pos() - top));
+	write_data(bw, top);
+	bw.align(0x10);
+	bw.patch(top + 0x10, uint32_t(bw.pos() - top));
+	mStrs.write(bw);
+	bw.patch(top + 8, uint32_t(bw.pos() - top));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// str.isspace() for ASCII
+static bool is_py_space(const char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r') || (c >= '\x1c' && c <= '\x1f');
+}
+
+static bool is_digit(const char c) {
+	return c >= '0' && c <= '9';
+}
+
+static void replace_all(std::string& str, const std::string& from, const std::string& to) {
+	size_t pos = 0;
+	while ((pos = str.find(from, pos)) != std::string::npos) {
+		str.replace(pos, from.size(), to);
+		pos += to.size();
+	}
+}
+
+// float(tok)
+static bool parse_py_float(const std::string& tok, double* pVal) {
+	static const char* specials[] = { "inf", "infinity", "nan" };
+	size_t i = 0;
+	size_t n = tok.size();
+	bool neg = false;
+	if (i < n && (tok[i] == '+' || tok[i] == '-')) {
+		neg = tok[i] == '-';
+		++i;
+	}
+	std::string rest = tok.substr(i);
+	for (size_t j = 0; j < rest.size(); ++j) {
+		rest[j] = char(::tolower(rest[j]));
+	}
+	for (size_t j = 0; j < XD_ARY_LEN(specials); ++j) {
+		if (rest == specials[j]) {
+			double val = j < 2 ? HUGE_VAL : NAN;
+			*pVal = neg ? -val : val;
+			return true;
+		}
+	}
+
+	// digits may be separated by single underscores
+	std::string num = tok.substr(0, i);
+	size_t ndigits = 0;
+	bool dot = false;
+	bool exp = false;
+	for (; i < n; ++i) {
+		char c = tok[i];
+		if (is_digit(c)) {
+			++ndigits;
+			num += c;
+		} else if (c == '_') {
+			if (i == 0 || !is_digit(tok[i - 1]) || i + 1 >= n || !is_digit(tok[i + 1])) return false;
+		} else if (c == '.' && !dot && !exp) {
+			dot = true;
+			num += c;
+		} else if ((c == 'e' || c == 'E') && !exp && ndigits > 0) {
+			exp = true;
+			num += c;
+			if (i + 1 < n && (tok[i + 1] == '+' || tok[i + 1] == '-')) {
+				num += tok[++i];
+			}
+			if (i + 1 >= n || !is_digit(tok[i + 1])) return false;
+		} else {
+			return false;
+		}
+	}
+	if (ndigits == 0) return false;
+	*pVal = ::strtod(num.c_str(), nullptr);
+	return true;
+}
+
+// re.match(r"""\s*(,@|[('`,)]|"(?:[\\].|[^\\"])*"|[^\s('"`,)]*)(.*)""", line)
+static void match_tok(const std::string& line, const size_t org, size_t* pTokBeg, size_t* pTokEnd) {
+	size_t n = line.size();
+	size_t i = org;
+	while (i < n && is_py_space(line[i])) {
+		++i;
+	}
+	*pTokBeg = i;
+	if (i + 1 < n && line[i] == ',' && line[i + 1] == '@') {
+		*pTokEnd = i + 2;
+		return;
+	}
+	if (i < n && ::strchr("('`,)", line[i])) {
+		*pTokEnd = i + 1;
+		return;
+	}
+	if (i < n && line[i] == '"') {
+		size_t j = i + 1;
+		while (j < n) {
+			if (line[j] == '\\') {
+				if (j + 1 >= n || line[j + 1] == '\n') break;
+				j += 2;
+			} else if (line[j] == '"') {
+				*pTokEnd = j + 1;
+				return;
+			} else {
+				++j;
+			}
+		}
+	}
+	while (i < n && !is_py_space(line[i]) && !::strchr("('\"`,)", line[i])) {
+		++i;
+	}
+	*pTokEnd = i;
+}
+
+static bool parse_block(const std::vector<std::string>& toks, size_t* pIdx, Expr* pExpr) {
+	if (*pIdx >= toks.size()) return false;
+	const std::string& tok = toks[(*pIdx)++];
+	if (tok == "(") {
+		pExpr->kind = Expr::Kind::LST;
+		while (true) {
+			if (*pIdx >= toks.size()) return false;
+			if (toks[*pIdx] == ")") break;
+			pExpr->items.push_back(Expr());
+			if (!parse_block(toks, pIdx, &pExpr->items.back())) return false;
+		}
+		++(*pIdx);
+	} else if (parse_py_float(tok, &pExpr->num)) {
+		pExpr->kind = Expr::Kind::NUM;
+	} else {
+		pExpr->kind = Expr::Kind::SYM;
+		pExpr->sym = tok;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void PlopBlock::emit_str(const std::string& str) {
+	int32_t sid = mStrs.add(str);
+	mStrLocs.push_back(mCode.size());
+	mCode.push_back(uint32_t(sid));
+}
+
+bool PlopBlock::compile(const Expr& code) {
+	mCode.clear();
+	mStrLocs.clear();
+	mStk.clear();
+	mpErr = nullptr;
+	return compile_sub(code);
+}
+
+bool PlopBlock::compile_sub(const Expr& code) {
+	if (code.kind == Expr::Kind::LST) {
+		const std::vector<Expr>& items = code.items;
+		size_t n = items.size();
+		if (n == 0) {
+			mCode.push_back(uint32_t(Op::NOP));
+			return true;
+		}
+		mCode.push_back(uint32_t(Op::BEGIN));
+		mStk.push_back(mCode.size());
+		mCode.push_back(0);
+
+		const Expr& op = items[0];
+		const char* pOp = op.kind == Expr::Kind::SYM ? op.sym.c_str() : "";
+		bool res = true;
+
+		if (nxCore::str_eq(pOp, "defvar") || nxCore::str_eq(pOp, "set")) {
+			if (n < 3 || items[1].kind != Expr::Kind::SYM) {
+				mpErr = "bad defvar/set clause";
+				return false;
+			}
+			mCode.push_back(uint32_t(pOp[0] == 'd' ? Op::VAR : Op::SET));
+			emit_str(items[1].sym);
+			res = compile_sub(items[2]);
+		} else if (nxCore::str_eq(pOp, "lset")) {
+			if (n < 4 || items[1].kind != Expr::Kind::SYM) {
+				mpErr = "bad lset clause";
+				return false;
+			}
+			mCode.push_back(uint32_t(Op::LSET));
+			emit_str(items[1].sym);
+			size_t patchPos = mCode.size();
+			mCode.push_back(0);
+			res = compile_sub(items[2]);
+			mCode[patchPos] = uint32_t(mCode.size());
+			res = res && compile_sub(items[3]);
+		} else if (nxCore::str_eq(pOp, "lget")) {
+			if (n < 3 || items[1].kind != Expr::Kind::SYM) {
+				mpErr = "bad lget clause";
+				return false;
+			}
+			mCode.push_back(uint32_t(Op::LGET));
+			emit_str(items[1].sym);
+			res = compile_sub(items[2]);
+		} else if (nxCore::str_eq(pOp, "if")) {
+			if (n < 4) {
+				mpErr = "bad if clause";
+				return false;
+			}
+			mCode.push_back(uint32_t(Op::IF));
+			size_t patchPos = mCode.size();
+			mCode.push_back(0);
+			mCode.push_back(0);
+			res = compile_sub(items[1]);
+			mCode[patchPos] = uint32_t(mCode.size());
+			res = res && compile_sub(items[2]);
+			mCode[patchPos + 1] = uint32_t(mCode.size());
+			res = res && compile_sub(items[3]);
+		} else {
+			static const struct {
+				const char* pName;
+				Op op;
+			} s_ops[] = {
+				{ "+", Op::ADD }, { "-", Op::SUB }, { "*", Op::MUL }, { "/", Op::DIV },
+				{ "neg", Op::NEG }, { "=", Op::EQ }, { "/=", Op::NE }, { "<", Op::LT },
+				{ ">", Op::GT }, { "<=", Op::LE }, { ">=", Op::GE }, { "not", Op::NOT },
+				{ "and", Op::AND }, { "or", Op::OR }, { "xor", Op::XOR }, { "min", Op::MIN },
+				{ "max", Op::MAX }, { "list", Op::LIST }, { "nop", Op::NOP }
+			};
+			Op blkOp = Op::CALL;
+			for (size_t i = 0; i < XD_ARY_LEN(s_ops); ++i) {
+				if (nxCore::str_eq(pOp, s_ops[i].pName)) {
+					blkOp = s_ops[i].op;
+					break;
+				}
+			}
+			mCode.push_back(uint32_t(blkOp));
+			mCode.push_back(uint32_t(n - 1));
+			if (blkOp == Op::CALL) {
+				res = compile_sub(op);
+			}
+			for (size_t i = 1; i < n && res; ++i) {
+				res = compile_sub(items[i]);
+			}
+		}
+		if (!res) return false;
+
+		size_t patchPos = mStk.back();
+		mStk.pop_back();
+		mCode[patchPos] = uint32_t(mCode.size());
+		mCode.push_back(uint32_t(Op::END));
+	} else if (code.kind == Expr::Kind::SYM) {
+		const std::string& sym = code.sym;
+		if (sym[0] == '"') {
+			// string literals are replaced with "<id>" before parsing
+			size_t n = sym.size();
+			if (n < 3 || sym[n - 1] != '"') {
+				mpErr = "bad string literal";
+				return false;
+			}
+			uint32_t sid = 0;
+			for (size_t i = 1; i < n - 1; ++i) {
+				if (!is_digit(sym[i])) {
+					mpErr = "bad string literal";
+					return false;
+				}
+				sid = sid * 10 + uint32_t(sym[i] - '0');
+			}
+			mCode.push_back(uint32_t(Op::SVAL));
+			mCode.push_back(sid);
+		} else {
+			mCode.push_back(uint32_t(Op::SYM));
+			emit_str(sym);
+		}
+	} else {
+		mCode.push_back(uint32_t(Op::FVAL));
+		mCode.push_back(nxCore::f32_get_bits(float(code.num)));
+	}
+	return true;
+}
+
+void PlopBlock::write(BinWriter& bw) const {
+	for (size_t i = 0, j = 0; i < mCode.size(); ++i) {
+		uint32_t word = mCode[i];
+		if (j < mStrLocs.size() && mStrLocs[j] == i) {
+			word = uint32_t(mStrs.get_write_id(int32_t(word)));
+			++j;
+		}
+		bw.write_u32(word);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool PlopExporter::compile(const std::string& src) {
+	std::vector<std::vector<std::string> > blkToks;
+	mBlocks.clear();
+	mErr.clear();
+
+	size_t lineTop = 0;
+	while (lineTop <= src.size()) {
+		size_t lineEnd = src.find('\n', lineTop);
+		if (lineEnd == std::string::npos) {
+			lineEnd = src.size();
+		}
+		std::string line = src.substr(lineTop, lineEnd - lineTop);
+		lineTop = lineEnd + 1;
+
+		size_t icomment = line.find(';');
+		if (icomment != std::string::npos) {
+			line.resize(icomment);
+		}
+		replace_all(line, "\t", " ");
+
+		// register string literals and replace them with their ids
+		std::string ltmp = line;
+		size_t cur = 0;
+		while (true) {
+			size_t tokBeg = 0;
+			size_t tokEnd = 0;
+			match_tok(line, cur, &tokBeg, &tokEnd);
+			if (tokEnd >= line.size()) break;
+			if (tokBeg == tokEnd) {
+				mErr = "unterminated string: " + line;
+				return false;
+			}
+			if (line[tokBeg] == '"') {
+				std::string tok = line.substr(tokBeg, tokEnd - tokBeg);
+				int32_t sid = mStrs.add(tok.substr(1, tok.size() - 2));
+				replace_all(ltmp, tok, "\"" + std::to_string(sid) + "\"");
+			}
+			cur = tokEnd;
+		}
+
+		replace_all(ltmp, "(", " ( ");
+		replace_all(ltmp, ")", " ) ");
+		std::vector<std::string> toks;
+		size_t i = 0;
+		while (i < ltmp.size()) {
+			while (i < ltmp.size() && is_py_space(ltmp[i])) {
+				++i;
+			}
+			size_t tokTop = i;
+			while (i < ltmp.size() && !is_py_space(ltmp[i])) {
+				++i;
+			}
+			if (i > tokTop) {
+				toks.push_back(ltmp.substr(tokTop, i - tokTop));
+			}
+		}
+		if (!toks.empty()) {
+			blkToks.push_back(toks);
+		}
+	}
+
+	if (blkToks.empty()) {
+		mErr = "no code";
+		return false;
+	}
+
+	for (size_t i = 0; i < blkToks.size(); ++i) {
+		Expr expr;
+		size_t idx = 0;
+		if (!parse_block(blkToks[i], &idx, &expr)) {
+			mErr = "unbalanced parentheses in block " + std::to_string(i);
+			return false;
+		}
+		mBlocks.push_back(PlopBlock(mStrs));
+		if (!mBlocks.back().compile(expr)) {
+			mErr = std::string(mBlocks.back().get_error()) + " in block " + std::to_string(i);
+			return false;
+		}
+	}
+	return true;
+}
+
+void PlopExporter::write_head(BinWriter& bw, const size_t top) {
+	bw.write_fourcc("info");
+	uint32_t nblk = uint32_t(mBlocks.size());
+	bw.write_u32(nblk);
+	mBodyOffsPos = bw.pos();
+	bw.write_u32(0); // -> body
+	mBlkCatTop = bw.pos();
+	for (uint32_t i = 0; i < nblk; ++i) {
+		bw.write_u32(0); // -> blk code
+		bw.write_u32(mBlocks[i].size());
+	}
+}
+
+void PlopExporter::write_data(BinWriter& bw, const size_t top) {
+	bw.align(0x10);
+	bw.patch(mBodyOffsPos, uint32_t(bw.pos() - top));
+	bw.write_fourcc("code");
+	for (size_t i = 0; i < mBlocks.size(); ++i) {
+		bw.align(0x10);
+		bw.patch(mBlkCatTop + i * 8, uint32_t(bw.pos() - top));
+		mBlocks[i].write(bw);
+	}
+}
+
+} // PlopBuild
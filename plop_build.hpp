@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// Native counterparts of plop.py/xcore.py used by drac_build.
+// The output follows the Python exporters word for word, so the helpers
+// below deliberately keep the Python semantics (including its quirks).
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace PlopBuild {
+
+// xcore.BinWriter
+class BinWriter {
+protected:
+	std::vector<uint8_t> mBytes;
+
+public:
+	size_t pos() const { return mBytes.size(); }
+	const uint8_t* data() const { return mBytes.data(); }
+
+	void write_bytes(const void* pData, const size_t size);
+	void write_u32(const uint32_t val);
+	void write_i32(const int32_t val) { write_u32(uint32_t(val)); }
+	void write_u16(const uint16_t val);
+	void write_i16(const int16_t val) { write_u16(uint16_t(val)); }
+	void write_fourcc(const char* pFourCC) { write_bytes(pFourCC, 4); }
+	void write_str(const std::string& str) { write_bytes(str.c_str(), str.size() + 1); }
+	void align(const size_t alignment);
+	void patch(const size_t at, const uint32_t val);
+	void append(const BinWriter& bw) { write_bytes(bw.data(), bw.pos()); }
+
+	bool save(const char* pOutPath) const;
+};
+
+// xcore.StrList
+class StrList {
+protected:
+	std::vector<std::string> mStrs;
+	std::unordered_map<std::string, int32_t> mIds;
+
+public:
+	int32_t add(const std::string& str);
+	int32_t get_write_id(const int32_t id) const { return id < 0 ? -1 : id; }
+	uint32_t count() const { return uint32_t(mStrs.size()); }
+
+	void write(BinWriter& bw) const;
+};
+
+// xcore.BaseExporter
+class DataExporter {
+protected:
+	const char* mpSig;
+	StrList mStrs;
+
+	virtual void write_head(BinWriter& bw, const size_t top) = 0;
+	virtual void write_data(BinWriter& bw, const size_t top) = 0;
+
+public:
+	DataExporter(const char* pSig) : mpSig(pSig) {}
+	virtual ~DataExporter() {}
+
+	StrList& get_str_list() { return mStrs; }
+
+	void write(BinWriter& bw);
+};
+
+// plop.parse_block result
+struct Expr {
+	enum class Kind : uint32_t {
+		NUM = 0,
+		SYM,
+		LST
+	};
+
+	Kind kind;
+	double num;
+	std::string sym;
+	std::vector<Expr> items;
+};
+
+// plop.PlopBlock
+class PlopBlock {
+protected:
+	StrList& mStrs;
+	std::vector<uint32_t> mCode;
+	std::vector<size_t> mStrLocs;
+	std::vector<size_t> mStk;
+	const char* mpErr;
+
+	void emit_str(const std::string& str);
+	bool compile_sub(const Expr& code);
+
+public:
+	PlopBlock(StrList& strs) : mStrs(strs), mpErr(nullptr) {}
+
+	bool compile(const Expr& code);
+	const char* get_error() const { return mpErr; }
+	uint32_t size() const { return uint32_t(mCode.size()); }
+
+	void write(BinWriter& bw) const;
+};
+
+// plop.PlopExporter
+class PlopExporter : public DataExporter {
+protected:
+	std::vector<PlopBlock> mBlocks;
+	size_t mBodyOffsPos;
+	size_t mBlkCatTop;
+	std::string mErr;
+
+	virtual void write_head(BinWriter& bw, const size_t top);
+	virtual void write_data(BinWriter& bw, const size_t top);
+
+public:
+	PlopExporter() : DataExporter("PLOP"), mBodyOffsPos(0), mBlkCatTop(0) {}
+
+	bool compile(const std::string& src);
+	const char* get_error() const { return mErr.c_str(); }
+};
+
+} // PlopBuild
@@ -3,6 +3,7 @@
 
 #include <crosscore.hpp>
 #include "plot_prog.hpp"
+#include "plop_pack.hpp"
 
 int main(int argc, char* argv[]) {
 	nxApp::init_params(argc, argv);
@@ -11,10 +12,11 @@ int main(int argc, char* argv[]) {
 	const char* pOutPath = nxApp::get_opt("out");
 	pOutPath = pOutPath ? pOutPath : "./out.dis";
 
-	sxData* pData = nxData::load(pPath);
+	sxData* pData = PlopPack::load(pPath);
 	if (pData) {
 		PlopData* pPlopData = pData->as<PlopData>();
 		pPlopData->disasm(pOutPath);
+		PlopPack::unload(pData);
 	}
 
 	nxApp::reset();
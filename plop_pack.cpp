@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+#include <crosscore.hpp>
+
+#include "plop_pack.hpp"
+
+const uint32_t PlopPack::KIND = XD_FOURCC('P', 'K', 'L', 'Z');
+
+bool PlopPack::valid(const size_t fileSize) const {
+	if (fileSize < sizeof(PlopPack)) return false;
+	if (mKind != KIND) return false;
+	if (mChunkSize == 0 || mRawSize == 0) return false;
+	if (mChunkNum != (mRawSize + mChunkSize - 1) / mChunkSize) return false;
+	size_t headSize = sizeof(uint32_t) * (4 + mChunkNum + 1);
+	if (fileSize < headSize) return false;
+	for (uint32_t i = 0; i < mChunkNum; ++i) {
+		if (mChunkOffs[i] < headSize || mChunkOffs[i] > mChunkOffs[i + 1]) return false;
+	}
+	return get_packed_size() <= fileSize;
+}
+
+size_t PlopPack::unpack_block(const uint8_t* pSrc, const size_t srcSize, uint8_t* pDst, const size_t dstSize) {
+	const uint8_t* pSrcEnd = pSrc + srcSize;
+	uint8_t* pOut = pDst;
+	uint8_t* pOutEnd = pDst + dstSize;
+
+	while (pSrc < pSrcEnd) {
+		uint32_t tok = *pSrc++;
+
+		size_t litLen = tok >> 4;
+		if (litLen == 0xF) {
+			uint8_t ext = 0xFF;
+			while (ext == 0xFF) {
+				if (pSrc >= pSrcEnd) return 0;
+				ext = *pSrc++;
+				litLen += ext;
+			}
+		}
+		if (litLen > size_t(pSrcEnd - pSrc) || litLen > size_t(pOutEnd - pOut)) return 0;
+		nxCore::mem_copy(pOut, pSrc, litLen);
+		pOut += litLen;
+		pSrc += litLen;
+
+		if (pSrc >= pSrcEnd) break; // trailing literals
+
+		if (pSrcEnd - pSrc < 2) return 0;
+		size_t offs = size_t(pSrc[0]) | (size_t(pSrc[1]) << 8);
+		pSrc += 2;
+
+		size_t matchLen = tok & 0xF;
+		if (matchLen == 0xF) {
+			uint8_t ext = 0xFF;
+			while (ext == 0xFF) {
+				if (pSrc >= pSrcEnd) return 0;
+				ext = *pSrc++;
+				matchLen += ext;
+			}
+		}
+		matchLen += MIN_MATCH;
+		if (offs == 0 || offs > size_t(pOut - pDst) || matchLen > size_t(pOutEnd - pOut)) return 0;
+
+		// matches may overlap the bytes being written, copy forward byte by byte
+		const uint8_t* pMatch = pOut - offs;
+		for (size_t i = 0; i < matchLen; ++i) {
+			pOut[i] = pMatch[i];
+		}
+		pOut += matchLen;
+	}
+
+	return size_t(pOut - pDst);
+}
+
+bool PlopPack::unpack_chunk(const uint32_t chunkId, uint8_t* pArena) const {
+	if (chunkId >= mChunkNum || !pArena) return false;
+	uint32_t rawSize = get_chunk_raw_size(chunkId);
+	uint8_t* pDst = pArena + size_t(chunkId) * mChunkSize;
+	size_t len = unpack_block(get_chunk(chunkId), get_chunk_size(chunkId), pDst, rawSize);
+	return len == rawSize;
+}
+
+bool PlopPack::unpack(uint8_t* pArena) const {
+	bool res = true;
+	for (uint32_t i = 0; i < mChunkNum && res; ++i) {
+		res = unpack_chunk(i, pArena);
+	}
+	return res;
+}
+
+sxData* PlopPack::load(const char* pPath) {
+	uint32_t kind = 0;
+	FILE* pIn = nxSys::fopen_r_bin(pPath);
+	if (!pIn) {
+		return nullptr;
+	}
+	size_t nread = ::fread(&kind, sizeof(kind), 1, pIn);
+	::fclose(pIn);
+	if (nread != 1 || kind != KIND) {
+		return nxData::load(pPath);
+	}
+
+	sxData* pData = nullptr;
+	size_t size = 0;
+	void* pBin = nxCore::raw_bin_load(pPath, &size);
+	if (pBin) {
+		PlopPack* pPack = reinterpret_cast<PlopPack*>(pBin);
+		if (pPack->valid(size)) {
+			uint8_t* pArena = reinterpret_cast<uint8_t*>(nxCore::mem_alloc(pPack->mRawSize, "PlopPack:arena"));
+			if (pArena) {
+				if (pPack->unpack(pArena)) {
+					pData = reinterpret_cast<sxData*>(pArena);
+				} else {
+					nxCore::dbg_msg("PlopPack: corrupted data in \"%s\"\n", pPath);
+					nxCore::mem_free(pArena);
+				}
+			}
+		}
+		nxCore::bin_unload(pBin);
+	}
+	return pData;
+}
+
+void PlopPack::unload(sxData* pData) {
+	nxData::unload(pData);
+}
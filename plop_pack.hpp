@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+// Compressed container for DRAC/PLOP files, see plop_pack.py for the packer.
+// The raw file is split into fixed-size chunks, each compressed independently
+// with a byte-oriented LZ codec, so that chunks can be decoded straight into
+// their place in a single arena holding the original sxData image.
+struct PlopPack {
+	static const uint32_t CHUNK_SIZE = 0x10000;
+	static const uint32_t MIN_MATCH = 4;
+
+	uint32_t mKind;
+	uint32_t mRawSize;
+	uint32_t mChunkSize;
+	uint32_t mChunkNum;
+	uint32_t mChunkOffs[1]; // mChunkNum + 1 entries, the last one is the end of packed data
+
+	uint32_t get_packed_size() const {
+		return mChunkOffs[mChunkNum];
+	}
+
+	const uint8_t* get_chunk(const uint32_t chunkId) const {
+		return XD_INCR_PTR(this, mChunkOffs[chunkId]);
+	}
+
+	uint32_t get_chunk_size(const uint32_t chunkId) const {
+		return mChunkOffs[chunkId + 1] - mChunkOffs[chunkId];
+	}
+
+	uint32_t get_chunk_raw_size(const uint32_t chunkId) const {
+		uint32_t offs = chunkId * mChunkSize;
+		return nxCalc::min(mChunkSize, mRawSize - offs);
+	}
+
+	bool valid(const size_t fileSize) const;
+
+	bool unpack_chunk(const uint32_t chunkId, uint8_t* pArena) const;
+
+	bool unpack(uint8_t* pArena) const;
+
+	static size_t unpack_block(const uint8_t* pSrc, const size_t srcSize, uint8_t* pDst, const size_t dstSize);
+
+	static sxData* load(const char* pPath);
+
+	static void unload(sxData* pData);
+
+	static const uint32_t KIND;
+};
@@ -0,0 +1,84 @@
+import sys
+import struct
+
+try: xrange
+except: xrange = range
+
+# see plop_pack.hpp for the container layout
+KIND = b"PKLZ"
+CHUNK_SIZE = 0x10000
+MIN_MATCH = 4
+MAX_OFFS = 0xFFFF
+
+def write_len(out, n):
+	while n >= 0xFF:
+		out.append(0xFF)
+		n -= 0xFF
+	out.append(n)
+
+def emit_seq(out, src, litTop, litEnd, offs, matchLen):
+	litLen = litEnd - litTop
+	mlen = matchLen - MIN_MATCH if matchLen else 0
+	tok = (min(litLen, 0xF) << 4) | min(mlen, 0xF)
+	out.append(tok)
+	if litLen >= 0xF: write_len(out, litLen - 0xF)
+	out.extend(src[litTop:litEnd])
+	if matchLen:
+		out.append(offs & 0xFF)
+		out.append((offs >> 8) & 0xFF)
+		if mlen >= 0xF: write_len(out, mlen - 0xF)
+
+def pack_block(src):
+	out = bytearray()
+	n = len(src)
+	table = {}
+	anchor = 0
+	i = 0
+	while i + MIN_MATCH <= n:
+		key = bytes(src[i:i + MIN_MATCH])
+		cand = table.get(key, -1)
+		table[key] = i
+		if cand >= 0 and i - cand <= MAX_OFFS:
+			mlen = MIN_MATCH
+			while i + mlen < n and src[cand + mlen] == src[i + mlen]:
+				mlen += 1
+			emit_seq(out, src, anchor, i, i - cand, mlen)
+			i += mlen
+			anchor = i
+		else:
+			i += 1
+	if anchor < n:
+		emit_seq(out, src, anchor, n, 0, 0)
+	return out
+
+def pack(raw):
+	raw = bytearray(raw)
+	rawSize = len(raw)
+	nchunk = (rawSize + CHUNK_SIZE - 1) // CHUNK_SIZE
+	headSize = 4 * (4 + nchunk + 1)
+	chunks = [pack_block(raw[i * CHUNK_SIZE : (i + 1) * CHUNK_SIZE]) for i in xrange(nchunk)]
+	offs = [headSize]
+	for chunk in chunks:
+		offs.append(offs[-1] + len(chunk))
+	out = bytearray(KIND)
+	out.extend(struct.pack("<III", rawSize, CHUNK_SIZE, nchunk))
+	for o in offs:
+		out.extend(struct.pack("<I", o))
+	for chunk in chunks:
+		out.extend(chunk)
+	return out
+
+def pack_file(fname):
+	f = open(fname, "rb")
+	raw = f.read()
+	f.close()
+	if raw[:4] == KIND: return
+	packed = pack(raw)
+	f = open(fname, "wb")
+	f.write(packed)
+	f.close()
+	sys.stdout.write("%s: %d -> %d bytes\n" % (fname, len(raw), len(packed)))
+
+if __name__ == '__main__':
+	for fname in sys.argv[1:]:
+		pack_file(fname)
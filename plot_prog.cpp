@@ -1,118 +1,180 @@
-/* SPDX-License-Identifier: MIT */
-/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
-
-#include <crosscore.hpp>
-
-#include "plot_prog.hpp"
-
-
-static const char* s_opNames[] = { 
-#if defined(PLOP_OP) 
-#	undef PLOP_OP
-#endif
-#define PLOP_OP(SYM, ID) #SYM ,
-#include "plop_op.inc"
-#undef PLOP_OP
-};
-
-const uint32_t PlopData::KIND = XD_FOURCC('P', 'L', 'O', 'P');
-
-void PlopData::disasm(FILE* pOut) {
-	char buf[256];
-	for (uint32_t bkid = 0, lvl = 0; bkid < mBlkNum; ++bkid) {
-		uint32_t* pCode = get_block_code(bkid);
-		uint32_t len = mBlks[bkid].mLen;
-		uint32_t sid = -1;
-
-		for (uint32_t i = 0; i < len;) {
-			Op op = Op(pCode[i]);
-			::fprintf(pOut, "%3d:", i);
-			lvl = (op == Op::END) && (lvl > 0) ? lvl - 1 : lvl;
-			for (uint32_t l = 0; l < lvl; ++l) { ::fprintf(pOut, "\t"); }
-			uint32_t strid = uint32_t(op) - uint32_t(Op::_BASE_);
-			const char* pOpName = s_opNames[uint32_t(op) - uint32_t(Op::_BASE_)];
-			::fprintf(pOut, "%s ", s_opNames[uint32_t(op) - uint32_t(Op::_BASE_)]);
-			++i;
-
-			switch (op) {
-				case Op::BEGIN: {
-						uint32_t eloc = pCode[i];
-						::fprintf(pOut, " < %d >\n", eloc);
-						++i;
-						++lvl;
-					}
-					break;
-				case Op::NOP:
-				case Op::END:
-					::fprintf(pOut, "\n");
-					break;
-				case Op::VAR:
-				case Op::SYM:
-				case Op::SET: {
-						sid = pCode[i];
-						::fprintf(pOut, " %d ; %s\n", sid, get_str(sid));
-						++i;
-					}
-					break;
-				case Op::LSET: {
-						sid = pCode[i];
-						uint32_t val = pCode[i + 1];
-						::fprintf(pOut, " %d <%d>; %s\n", sid, val, get_str(sid));
-						i += 2;
-					}
-					break;
-				case Op::LGET: {
-						sid = pCode[i];
-						::fprintf(pOut, " %d; %s\n", sid, get_str(sid));
-						++i;
-					}
-					break;
-				case Op::FVAL: {
-						float fval = nxCore::f32_set_bits(pCode[i]);
-						::fprintf(pOut, " %f\n", fval);
-						++i;
-					}
-					break;
-				case Op::SVAL: {
-						sid = pCode[i];
-						::fprintf(pOut, " %d ; %s\n", sid, get_str(sid));
-						++i;
-					}
-					break;
-				case Op::IF: {
-						uint32_t yes = pCode[i];
-						uint32_t no = pCode[i + 1];
-						::fprintf(pOut, "(%d, %d)\n", yes, no);
-						i += 2;
-					}
-					break;
-				case Op::ADD:
-				case Op::SUB:
-				case Op::MUL:
-				case Op::DIV:
-				case Op::NEG:
-				case Op::EQ :
-				case Op::NE :
-				case Op::LT :
-				case Op::GT :
-				case Op::LE :
-				case Op::GE :
-				case Op::NOT:
-				case Op::AND:
-				case Op::OR :
-				case Op::XOR: 
-				case Op::MIN:
-				case Op::MAX:
-				case Op::CALL:
-				case Op::LIST: {
-						uint32_t narg = pCode[i];
-						::fprintf(pOut, " ( %d )\n", narg);
-						++i;
-					}
-					break;
-
-			}
-		}
-
-	}
-}
+/* SPDX-License-Identifier: MIT */
+/* SPDX-FileCopyrightText: 2022 Glib Novodran <novodran@gmail.com> */
+
+#include <crosscore.hpp>
+
+#include "plot_prog.hpp"
+
+
+static const char* s_opNames[] = { 
+#if defined(PLOP_OP) 
+#	undef PLOP_OP
+#endif
+#define PLOP_OP(SYM, ID) #SYM ,
+#include "plop_op.inc"
+#undef PLOP_OP
+};
+
+const uint32_t PlopData::KIND = XD_FOURCC('P', 'L', 'O', 'P');
+
+void PlopData::disasm(FILE* pOut) {
+	char buf[256];
+	for (uint32_t bkid = 0, lvl = 0; bkid < mBlkNum; ++bkid) {
+		uint32_t* pCode = get_block_code(bkid);
+		uint32_t len = mBlks[bkid].mLen;
+		uint32_t sid = -1;
+
+		for (uint32_t i = 0; i < len;) {
+			Op op = Op(pCode[i]);
+			::fprintf(pOut, "%3d:", i);
+			lvl = (op == Op::END) && (lvl > 0) ? lvl - 1 : lvl;
+			for (uint32_t l = 0; l < lvl; ++l) { ::fprintf(pOut, "\t"); }
+			uint32_t strid = uint32_t(op) - uint32_t(Op::_BASE_);
+			const char* pOpName = s_opNames[uint32_t(op) - uint32_t(Op::_BASE_)];
+			::fprintf(pOut, "%s ", s_opNames[uint32_t(op) - uint32_t(Op::_BASE_)]);
+			++i;
+
+			switch (op) {
+				case Op::BEGIN: {
+						uint32_t eloc = pCode[i];
+						::fprintf(pOut, " < %d >\n", eloc);
+						++i;
+						++lvl;
+					}
+					break;
+				case Op::NOP:
+				case Op::END:
+					::fprintf(pOut, "\n");
+					break;
+				case Op::VAR:
+				case Op::SYM:
+				case Op::SET: {
+						sid = pCode[i];
+						::fprintf(pOut, " %d ; %s\n", sid, get_str(sid));
+						++i;
+					}
+					break;
+				case Op::LSET: {
+						sid = pCode[i];
+						uint32_t val = pCode[i + 1];
+						::fprintf(pOut, " %d <%d>; %s\n", sid, val, get_str(sid));
+						i += 2;
+					}
+					break;
+				case Op::LGET: {
+						sid = pCode[i];
+						::fprintf(pOut, " %d; %s\n", sid, get_str(sid));
+						++i;
+					}
+					break;
+				case Op::FVAL: {
+						float fval = nxCore::f32_set_bits(pCode[i]);
+						::fprintf(pOut, " %f\n", fval);
+						++i;
+					}
+					break;
+				case Op::SVAL: {
+						sid = pCode[i];
+						::fprintf(pOut, " %d ; %s\n", sid, get_str(sid));
+						++i;
+					}
+					break;
+				case Op::IF: {
+						uint32_t yes = pCode[i];
+						uint32_t no = pCode[i + 1];
+						::fprintf(pOut, "(%d, %d)\n", yes, no);
+						i += 2;
+					}
+					break;
+				case Op::ADD:
+				case Op::SUB:
+				case Op::MUL:
+				case Op::DIV:
+				case Op::NEG:
+				case Op::EQ :
+				case Op::NE :
+				case Op::LT :
+				case Op::GT :
+				case Op::LE :
+				case Op::GE :
+				case Op::NOT:
+				case Op::AND:
+				case Op::OR :
+				case Op::XOR: 
+				case Op::MIN:
+				case Op::MAX:
+				case Op::CALL:
+				case Op::LIST: {
+						uint32_t narg = pCode[i];
+						::fprintf(pOut, " ( %d )\n", narg);
+						++i;
+					}
+					break;
+
+			}
+		}
+
+	}
+}
+
+int32_t Drama::find_node(const char* pName) const {
+	const int32_t* pIds = get_node_field(NodeField::ID);
+	if (pName && pIds) {
+		for (uint32_t i = 0; i < mNodeNum; ++i) {
+			if (nxCore::str_eq(get_str(pIds[i]), pName)) {
+				return int32_t(i);
+			}
+		}
+	}
+	return -1;
+}
+
+void Drama::dump_plop_info(FILE* pOut, PlopData* pPlop, const uint32_t id, const char* pBinName) {
+	if (pPlop) {
+		::fprintf(pOut, "[ plop id:[%d] ; nblk: %d ]\n", id,  pPlop ? pPlop->mBlkNum : 0);
+		if (pBinName) {
+			pPlop->save(pBinName);
+		}
+	}
+}
+
+void Drama::dump_info(FILE* pOut, const bool savePlops) {
+	char buf[32] = {};
+	nxCore::dbg_msg("Dumping %s", pOut);
+	::fprintf(pOut, "Total %d nodes\n", mNodeNum);
+	for(uint32_t i = 0; i < mNodeNum; ++i) {
+		::fprintf(pOut, "____________________________________\n");
+		::fprintf(pOut, "Node %d id='%s'\n\n", i, get_str(get_node_id(i)));
+		::fprintf(pOut, "[Before]: ");
+
+		int32_t plopId = get_node_before(i);
+		PlopData* pPlop = get_plop_data(plopId);
+		if (pPlop) {
+			XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "before_%d.plop", i);
+			dump_plop_info(pOut, pPlop, plopId, savePlops ? buf : nullptr);
+
+			XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "before_%d.dpl", i);
+			pPlop->disasm(buf);
+		} else {
+			::fprintf(pOut, "[NONE]\n");
+		}
+
+		int32_t plsay = get_node_plsay(i);
+		int32_t say = get_node_say(i);
+		::fprintf(pOut, "[Player says]: %s\n", plsay >= 0 ? get_str(plsay) : "[NONE]");
+		::fprintf(pOut, "[Character says]: %s\n", say >= 0 ? get_str(say) : "[NONE]");
+
+		::fprintf(pOut, "[After]: ");
+
+		plopId = get_node_after(i);
+		pPlop = get_plop_data(plopId);
+		if (pPlop) {
+			XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "after_%d.plop", i);
+			dump_plop_info(pOut, pPlop, plopId, savePlops ? buf : nullptr);
+
+			XD_SPRINTF(XD_SPRINTF_BUF(buf, sizeof(buf)), "after_%d.dpl", i);
+			pPlop->disasm(buf);
+		}
+
+	}
+}
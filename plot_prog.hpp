@@ -65,3 +65,59 @@ struct PlopData : sxData {
 
 	static const uint32_t KIND;
 };
+
+struct Drama : sxData {
+
+	static const uint32_t KIND = XD_FOURCC('D', 'R', 'A', 'C');
+
+	uint32_t mHeadTag;
+	uint32_t mNodeNum;
+	uint32_t mPlopNum;
+	uint32_t mNodesOffs;    // -> ids[mNodeNum], before[mNodeNum], after[mNodeNum]
+	uint32_t mDialogueOffs; // -> plsay[mNodeNum], say[mNodeNum], placed after the plops
+	uint32_t mPlopCat[1];
+
+	enum class NodeField : uint32_t {
+		ID = 0,
+		BEFORE,
+		AFTER
+	};
+
+	enum class DialogueField : uint32_t {
+		PLSAY = 0,
+		SAY
+	};
+
+	const int32_t* get_node_field(const NodeField field) const {
+		return mNodesOffs ? reinterpret_cast<const int32_t*>(XD_INCR_PTR(this, mNodesOffs)) + uint32_t(field) * mNodeNum : nullptr;
+	}
+
+	const int32_t* get_dialogue_field(const DialogueField field) const {
+		return mDialogueOffs ? reinterpret_cast<const int32_t*>(XD_INCR_PTR(this, mDialogueOffs)) + uint32_t(field) * mNodeNum : nullptr;
+	}
+
+	int32_t get_node_id(const uint32_t nodeIdx) const { return get_node_field(NodeField::ID)[nodeIdx]; }
+	int32_t get_node_before(const uint32_t nodeIdx) const { return get_node_field(NodeField::BEFORE)[nodeIdx]; }
+	int32_t get_node_after(const uint32_t nodeIdx) const { return get_node_field(NodeField::AFTER)[nodeIdx]; }
+	int32_t get_node_plsay(const uint32_t nodeIdx) const { return get_dialogue_field(DialogueField::PLSAY)[nodeIdx]; }
+	int32_t get_node_say(const uint32_t nodeIdx) const { return get_dialogue_field(DialogueField::SAY)[nodeIdx]; }
+
+	PlopData* get_plop_data(const int32_t plopId) const {
+		return (plopId < mPlopNum) && (plopId >= 0) ? reinterpret_cast<PlopData*>(XD_INCR_PTR(this, mPlopCat[plopId])) : nullptr;
+	}
+
+	int32_t find_node(const char* pName) const;
+
+	void dump_plop_info(FILE* pOut, PlopData* pPlop, const uint32_t id, const char* pBinName);
+
+	void dump_info(FILE* pOut, const bool savePlops);
+
+	void dump_info(const char* pOutPath, bool savePlop) {
+		FILE* pOut = nxSys::fopen_w_txt(pOutPath);
+		if (!pOut) {
+			return;
+		}
+		dump_info(pOut, savePlop);
+		::fclose(pOut);
+	}
+};